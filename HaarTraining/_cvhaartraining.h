@@ -70,6 +70,10 @@
 
 #define CV_STAGE_CART_FILE_NAME "AdaBoostCARTHaarClassifier.txt"
 
+/* early rejection trace of the stage. It is kept out of CV_STAGE_CART_FILE_NAME
+   because that file is also read by cvLoadHaarClassifierCascade */
+#define CV_STAGE_TRACE_FILE_NAME "RejectionTrace.txt"
+
 #define CV_HAAR_FEATURE_MAX      3
 #define CV_HAAR_FEATURE_DESC_MAX 20
 
@@ -223,6 +227,34 @@ typedef struct CvCARTHaarClassifier
     float* val;
 } CvCARTHaarClassifier;
 
+/*
+ * lookup table classifier
+ *
+ * The normalized haar feature value range [minval, minval + count / binscale[
+ * is split into <count> bins. Values out of the range fall into the boundary bins.
+ */
+typedef struct CvLUTHaarClassifier
+{
+    CV_INT_HAAR_CLASSIFIER_FIELDS()
+
+    int count;     /* number of bins */
+    int compidx;
+    CvTHaarFeature feature;
+    CvFastHaarFeature fastfeature;
+    float minval;
+    float binscale;
+    float* val;    /* confidence of each bin */
+} CvLUTHaarClassifier;
+
+CV_INLINE int icvGetLUTBin( float val, float minval, float binscale, int count )
+{
+    int bin;
+
+    bin = cvFloor( (val - minval) * binscale );
+
+    return MAX( 0, MIN( count - 1, bin ) );
+}
+
 /* internal stage classifier */
 typedef struct CvStageHaarClassifier
 {
@@ -231,6 +263,10 @@ typedef struct CvStageHaarClassifier
     int count;
     float threshold;
     CvIntHaarClassifier** classifier;
+
+    /* early rejection trace. Evaluation stops as soon as the sum of the first i+1
+       weak classifiers is less than rejection[i]. -FLT_MAX disables it */
+    float* rejection;
 } CvStageHaarClassifier;
 
 /* internal cascade classifier */
@@ -346,6 +382,66 @@ typedef struct CvVecFile
 
 int icvGetHaarTraininDataFromVecCallback( CvMat* img, void* userdata );
 
+/*
+ * .vec file format version 2
+ *
+ * The header is followed by <count> records of <recsize> bytes. Each record holds
+ * one sample as <height> rows of <width> 8-bit pixels and is padded with zeros
+ * up to the multiple of CV_VEC2_ALIGN bytes. The file ends with the index of
+ * <count> 64-bit record offsets located at <indexofs>.
+ * Unlike the original format (short per pixel, no index) the file may be mapped
+ * into memory and its samples may be accessed randomly and concurrently.
+ */
+#define CV_VEC2_MAGIC "VEC2"
+#define CV_VEC2_ALIGN 16
+
+typedef struct CvVec2Header
+{
+    char  magic[4];
+    int   count;
+    int   width;
+    int   height;
+    int   recsize;
+    int   reserved;
+    int64 indexofs;
+} CvVec2Header;
+
+typedef struct CvVecMap
+{
+    int    count;
+    int    width;
+    int    height;
+    uchar* base;  /* beginning of the mapped file */
+    size_t size;  /* size of the mapped file */
+    int64* index; /* record offsets */
+} CvVecMap;
+
+/* pointer to the pixels of the <idx>-th sample, rows are <width> bytes apart */
+CV_INLINE uchar* icvGetVecMapSample( CvVecMap* map, int idx )
+{
+    return map->base + map->index[idx];
+}
+
+/*
+ * icvWriteVec2Header, icvWriteVec2Sample, icvEndVec2File
+ *
+ * Write .vec file of version 2. icvEndVec2File must be called after the last
+ * sample is written. It appends the index and updates the header.
+ */
+void icvWriteVec2Header( FILE* file, int width, int height );
+void icvWriteVec2Sample( FILE* file, CvArr* sample );
+void icvEndVec2File( FILE* file, int count, int width, int height );
+
+/*
+ * icvOpenVecMap
+ *
+ * Map .vec file of version 2 into memory
+ * Return NULL if the file can not be mapped or it is not a valid version 2 file
+ */
+CvVecMap* icvOpenVecMap( const char* filename );
+
+void icvReleaseVecMap( CvVecMap** map );
+
 /*
  * icvGetHaarTrainingDataFromVec
  *
@@ -368,6 +464,11 @@ void icvInitCARTHaarClassifier( CvCARTHaarClassifier* carthaar, CvCARTClassifier
 float icvEvalCARTHaarClassifier( CvIntHaarClassifier* classifier,
                                  sum_type* sum, sum_type* tilted, float normfactor );
 
+CvIntHaarClassifier* icvCreateLUTHaarClassifier( int count );
+
+float icvEvalLUTHaarClassifier( CvIntHaarClassifier* classifier,
+                                sum_type* sum, sum_type* tilted, float normfactor );
+
 CvIntHaarClassifier* icvCreateStageHaarClassifier( int count, float threshold );
 
 void icvReleaseStageHaarClassifier( CvIntHaarClassifier** classifier );
@@ -388,12 +489,29 @@ void icvLoadHaarFeature( CvTHaarFeature* feature, FILE* file );
 
 void icvSaveCARTHaarClassifier( CvIntHaarClassifier* classifier, FILE* file );
 
+/* Also loads lookup table classifiers saved by icvSaveLUTHaarClassifier */
 CvIntHaarClassifier* icvLoadCARTHaarClassifier( FILE* file, int step );
 
+void icvSaveLUTHaarClassifier( CvIntHaarClassifier* classifier, FILE* file );
+
+/* Saves a lookup table classifier as the equivalent CART classifier, a balanced
+   tree of splits at the bin boundaries, which cvLoadHaarClassifierCascade reads */
+void icvSaveLUTHaarClassifierAsCART( CvIntHaarClassifier* classifier, FILE* file );
+
 void icvSaveStageHaarClassifier( CvIntHaarClassifier* classifier, FILE* file );
 
 CvIntHaarClassifier* icvLoadCARTStageHaarClassifier( const char* filename, int step );
 
+/* Copies the stages of the cascade directory <dirname> into <cartname> with lookup
+   table classifiers saved as CART classifiers. Returns the number of stages copied */
+int icvConvertLUTCascadeToCART( const char* dirname, const char* cartname, int step );
+
+void icvSaveStageRejectionTrace( CvIntHaarClassifier* classifier, FILE* file );
+
+/* Returns 0 and leaves early rejection disabled if <file> does not hold a trace
+   matching the stage */
+int icvLoadStageRejectionTrace( CvIntHaarClassifier* classifier, FILE* file );
+
 
 /* tree cascade classifier */
 
@@ -405,6 +523,17 @@ void icvSetLeafNode( CvTreeCascadeClassifier* tree, CvTreeCascadeNode* leaf );
 float icvEvalTreeCascadeClassifierFilter( CvIntHaarClassifier* classifier, sum_type* sum,
                                           sum_type* tilted, float normfactor );
 
+/*
+ * icvEvalTreeCascadeMargin
+ *
+ * Returns the maximal difference between the stage sum and the stage threshold
+ * over the leaves reached by the sample or -FLT_MAX if no leaf is reached.
+ * Leaves are evaluated without early rejection, so the result may be compared
+ * with any shift of the last stage threshold.
+ */
+float icvEvalTreeCascadeMargin( CvIntHaarClassifier* classifier, sum_type* sum,
+                                sum_type* tilted, float normfactor );
+
 CvTreeCascadeNode* icvCreateTreeCascadeNode();
 
 void icvReleaseTreeCascadeNodes( CvTreeCascadeNode** node );
@@ -414,7 +543,8 @@ void icvReleaseTreeCascadeClassifier( CvIntHaarClassifier** classifier );
 /* Prints out current tree structure to <stdout> */
 void icvPrintTreeCascade( CvTreeCascadeNode* root );
 
-/* Loads tree cascade classifier */
+/* Loads tree cascade classifier. Stages without tree links (saved by
+   cvCreateCascadeClassifier) are chained linearly */
 CvIntHaarClassifier* icvLoadTreeCascadeClassifier( const char* filename, int step,
                                                    int* splits );
 
@@ -0,0 +1,583 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                        Intel License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000, Intel Corporation, all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   * The name of Intel Corporation may not be used to endorse or promote products
+//     derived from this software without specific prior written permission.
+//
+// This software is provided by the copyright holders and contributors "as is" and
+// any express or implied warranties, including, but not limited to, the implied
+// warranties of merchantability and fitness for a particular purpose are disclaimed.
+// In no event shall the Intel Corporation or contributors be liable for any direct,
+// indirect, incidental, special, exemplary, or consequential damages
+// (including, but not limited to, procurement of substitute goods or services;
+// loss of use, data, or profits; or business interruption) however caused
+// and on any theory of liability, whether in contract, strict liability,
+// or tort (including negligence or otherwise) arising in any way out of
+// the use of this software, even if advised of the possibility of such damage.
+//
+//M*/
+
+/*
+ * cvevaluation.cpp
+ *
+ * evaluation of trained cascade classifiers on sets of marked up images.
+ */
+
+#include <cvhaartraining.h>
+#include <_cvhaartraining.h>
+
+#include <cv.h>
+#include <highgui.h>
+#include <float.h>
+#include <stdio.h>
+
+/* size of integral image tiles in windows. Each tile is integrated and scanned
+   separately, so the cascade features are computed once for the tile row step */
+#define CV_EVAL_TILE_WINDOWS 8
+
+/* marked up image */
+typedef struct CvEvalImage
+{
+    char*   filename;
+    int     count;
+    CvRect* objects;
+} CvEvalImage;
+
+/* window which reached the last stage */
+typedef struct CvEvalCandidate
+{
+    CvRect rect;
+    float  margin;
+} CvEvalCandidate;
+
+/* per thread data */
+typedef struct CvEvalWorker
+{
+    CvMat*        sum;
+    CvMat*        tilted;
+    CvMat*        sqsum;
+    CvMemStorage* storage;
+    int*          hits;
+    int*          falsealarms;
+    int           processed;
+} CvEvalWorker;
+
+
+/*
+ * icvReadEvalImages
+ *
+ * Read marked up image descriptions from <infoname> into the sequence of CvEvalImage
+ */
+static
+CvSeq* icvReadEvalImages( const char* infoname, CvMemStorage* storage )
+{
+    char fullname[PATH_MAX];
+    char format[32];
+    char* filename;
+    FILE* info;
+    CvSeq* images;
+    CvEvalImage image;
+    int line;
+    int error;
+    int i;
+
+    info = fopen( infoname, "r" );
+    if( info == NULL ) return NULL;
+
+    images = cvCreateSeq( 0, sizeof( *images ), sizeof( image ), storage );
+
+    strcpy( fullname, infoname );
+    filename = strrchr( fullname, '\\' );
+    if( filename == NULL )
+    {
+        filename = strrchr( fullname, '/' );
+    }
+    if( filename == NULL )
+    {
+        filename = fullname;
+    }
+    else
+    {
+        filename++;
+    }
+    /* the file name must fit into the rest of <fullname> */
+    sprintf( format, "%%%ds %%d", (int) (PATH_MAX - (filename - fullname) - 1) );
+
+    for( line = 1, error = 0; !error; line++ )
+    {
+        if( fscanf( info, format, filename, &image.count ) != 2 ) break;
+        error = ( image.count < 0 );
+        image.filename = (char*) cvMemStorageAlloc( storage, strlen( fullname ) + 1 );
+        strcpy( image.filename, fullname );
+        image.objects = (CvRect*) cvMemStorageAlloc( storage,
+            sizeof( *image.objects ) * MAX( image.count, 1 ) );
+        for( i = 0; i < image.count && !error; i++ )
+        {
+            error = ( fscanf( info, "%d %d %d %d", &image.objects[i].x, &image.objects[i].y,
+                              &image.objects[i].width, &image.objects[i].height ) != 4 );
+        }
+        if( error )
+        {
+
+#if CV_VERBOSE
+            fprintf( stderr, "%s(%d) : parse error", infoname, line );
+#endif /* CV_VERBOSE */
+
+            break;
+        }
+        cvSeqPush( images, &image );
+    }
+    fclose( info );
+
+    return images;
+}
+
+/* rectangles similarity used for grouping of detections, the same as in cvHaarDetectObjects */
+static
+int icvIsEqualRect( CvRect r1, CvRect r2 )
+{
+    int distance = cvRound( r1.width * 0.2 );
+
+    return r2.x <= r1.x + distance && r2.x >= r1.x - distance &&
+           r2.y <= r1.y + distance && r2.y >= r1.y - distance &&
+           r2.width <= cvRound( r1.width * 1.2 ) &&
+           cvRound( r2.width * 1.2 ) >= r1.width;
+}
+
+/*
+ * rectangle <idx> lies inside another one which has more neighbors (or has less than
+ * 3 neighbors itself), the same as the filtering of cvHaarDetectObjects
+ */
+static
+int icvIsNestedDetection( CvRect* dets, int* neighbors, int count, int idx )
+{
+    CvRect r1 = dets[idx];
+    int j;
+
+    for( j = 0; j < count; j++ )
+    {
+        CvRect r2 = dets[j];
+        int distance = cvRound( r2.width * 0.2 );
+
+        if( j != idx &&
+            r1.x >= r2.x - distance &&
+            r1.y >= r2.y - distance &&
+            r1.x + r1.width <= r2.x + r2.width + distance &&
+            r1.y + r1.height <= r2.y + r2.height + distance &&
+            (neighbors[j] > MAX( 3, neighbors[idx] ) || neighbors[idx] < 3) )
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static
+int icvMatchObject( CvRect det, CvRect obj, double maxsizediff, double maxposdiff )
+{
+    return fabs( det.x + det.width * 0.5 - obj.x - obj.width * 0.5 )
+               <= maxposdiff * obj.width &&
+           fabs( det.y + det.height * 0.5 - obj.y - obj.height * 0.5 )
+               <= maxposdiff * obj.height &&
+           det.width <= maxsizediff * obj.width &&
+           det.width * maxsizediff >= obj.width;
+}
+
+/* sorts candidates by descending margin */
+static
+int CV_CDECL icvCmpCandidates( const void* a, const void* b, void* )
+{
+    float ma = ((const CvEvalCandidate*) a)->margin;
+    float mb = ((const CvEvalCandidate*) b)->margin;
+
+    return (ma < mb) - (ma > mb);
+}
+
+static
+int icvFindRoot( int* parent, int i )
+{
+    while( parent[i] != i )
+    {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+
+    return i;
+}
+
+/*
+ * icvScanImage
+ *
+ * Scan all windows of <img> and push the windows which reach the last stage into
+ * <candidates>. Each scale is processed by tiles of the worker integral images
+ */
+static
+void icvScanImage( CvIntHaarClassifier* cascade, CvSize winsize, IplImage* img,
+                   double scalefactor, CvEvalWorker* worker, CvSeq* candidates )
+{
+    CvSize tilesize = cvSize( worker->sum->cols - 1, worker->sum->rows - 1 );
+    int spanx = tilesize.width - winsize.width + 1;
+    int spany = tilesize.height - winsize.height + 1;
+    /* sum, tilted and sqsum buffers have the same row step in elements */
+    int sumstep = worker->sum->step / sizeof( sum_type );
+    double factor;
+    CvMat* scaled;
+    CvMat roi;
+    CvMat sum, tilted, sqsum;
+    CvEvalCandidate candidate;
+    CvRect normrect;
+    int p0, p1, p2, p3;
+    double area;
+    int tx, ty, tw, th, x, y;
+
+    normrect = cvRect( 1, 1, winsize.width - 2, winsize.height - 2 );
+    p0 = normrect.x + sumstep * normrect.y;
+    p1 = normrect.x + normrect.width + sumstep * normrect.y;
+    p2 = normrect.x + sumstep * (normrect.y + normrect.height);
+    p3 = normrect.x + normrect.width + sumstep * (normrect.y + normrect.height);
+    area = normrect.width * normrect.height;
+
+    for( factor = 1.0; ; factor *= scalefactor )
+    {
+        CvSize size = cvSize( cvRound( img->width / factor ), cvRound( img->height / factor ) );
+
+        if( size.width < winsize.width || size.height < winsize.height ) break;
+
+        scaled = cvCreateMat( size.height, size.width, CV_8UC1 );
+        cvResize( img, scaled, (factor > 1.0) ? CV_INTER_AREA : CV_INTER_LINEAR );
+
+        for( ty = 0; ty + winsize.height <= size.height; ty += spany )
+        {
+            for( tx = 0; tx + winsize.width <= size.width; tx += spanx )
+            {
+                tw = MIN( tilesize.width, size.width - tx );
+                th = MIN( tilesize.height, size.height - ty );
+                cvGetSubRect( scaled, &roi, cvRect( tx, ty, tw, th ) );
+
+                /* headers of the tile size with the row step of the worker buffers */
+                sum = cvMat( th + 1, tw + 1, CV_SUM_MAT_TYPE, worker->sum->data.ptr );
+                tilted = cvMat( th + 1, tw + 1, CV_SUM_MAT_TYPE, worker->tilted->data.ptr );
+                sqsum = cvMat( th + 1, tw + 1, CV_SQSUM_MAT_TYPE, worker->sqsum->data.ptr );
+                sum.step = worker->sum->step;
+                tilted.step = worker->tilted->step;
+                sqsum.step = worker->sqsum->step;
+                sum.type &= ~CV_MAT_CONT_FLAG;
+                tilted.type &= ~CV_MAT_CONT_FLAG;
+                sqsum.type &= ~CV_MAT_CONT_FLAG;
+                cvIntegral( &roi, &sum, &sqsum, &tilted );
+
+                for( y = 0; y + winsize.height <= th && y < spany; y++ )
+                {
+                    for( x = 0; x + winsize.width <= tw && x < spanx; x++ )
+                    {
+                        sum_type* s = sum.data.i + y * sumstep + x;
+                        sqsum_type* sq = sqsum.data.db + y * sumstep + x;
+                        double valsum = (double) s[p0] - s[p1] - s[p2] + s[p3];
+                        double valsqsum = sq[p0] - sq[p1] - sq[p2] + sq[p3];
+                        float normfactor = (float) sqrt( area * valsqsum - valsum * valsum );
+
+                        candidate.margin = icvEvalTreeCascadeMargin( cascade, s,
+                            tilted.data.i + y * sumstep + x, normfactor );
+                        if( candidate.margin > -FLT_MAX )
+                        {
+                            candidate.rect = cvRect( cvRound( (tx + x) * factor ),
+                                                     cvRound( (ty + y) * factor ),
+                                                     cvRound( winsize.width * factor ),
+                                                     cvRound( winsize.height * factor ) );
+                            cvSeqPush( candidates, &candidate );
+                        }
+                    }
+                }
+            }
+        }
+
+        cvReleaseMat( &scaled );
+    }
+}
+
+/*
+ * icvAccumulateROC
+ *
+ * Count hits and false alarms of each ROC point for one image.
+ * <candidates> must be sorted by descending margin, <order> lists the ROC points
+ * by descending threshold. Candidates are added to the groups incrementally while
+ * the threshold decreases, so the grouping is done once for all the points
+ */
+static
+void icvAccumulateROC( CvEvalCandidate* candidates, int count, CvEvalImage* image,
+                       int minneighbors, double maxsizediff, double maxposdiff,
+                       int numpoints, CvCascadeEvalPoint* roc, int* order,
+                       CvEvalWorker* worker )
+{
+    int* parent;
+    int* members;
+    double* rects;
+    CvRect* dets;
+    int* neighbors;
+    uchar* hit;
+    int added = 0;
+    int numdets;
+    int i, j, k, o;
+
+    parent = (int*) cvMemStorageAlloc( worker->storage, sizeof( int ) * MAX( count, 1 ) );
+    members = (int*) cvMemStorageAlloc( worker->storage, sizeof( int ) * MAX( count, 1 ) );
+    rects = (double*) cvMemStorageAlloc( worker->storage,
+                                         sizeof( double ) * 4 * MAX( count, 1 ) );
+    dets = (CvRect*) cvMemStorageAlloc( worker->storage, sizeof( CvRect ) * MAX( count, 1 ) );
+    neighbors = (int*) cvMemStorageAlloc( worker->storage, sizeof( int ) * MAX( count, 1 ) );
+    hit = (uchar*) cvMemStorageAlloc( worker->storage, MAX( image->count, 1 ) );
+
+    for( k = 0; k < numpoints; k++ )
+    {
+        float threshold = roc[order[k]].threshold - CV_THRESHOLD_EPS;
+        int hits = 0;
+        int falsealarms = 0;
+
+        for( ; added < count && candidates[added].margin >= threshold; added++ )
+        {
+            parent[added] = added;
+            for( j = 0; j < added; j++ )
+            {
+                if( icvIsEqualRect( candidates[j].rect, candidates[added].rect ) )
+                {
+                    parent[icvFindRoot( parent, j )] = icvFindRoot( parent, added );
+                }
+            }
+        }
+
+        for( i = 0; i < added; i++ )
+        {
+            members[i] = 0;
+            rects[4*i] = rects[4*i+1] = rects[4*i+2] = rects[4*i+3] = 0.0;
+        }
+        for( i = 0; i < added; i++ )
+        {
+            j = ( minneighbors > 0 ) ? icvFindRoot( parent, i ) : i;
+            members[j]++;
+            rects[4*j]   += candidates[i].rect.x;
+            rects[4*j+1] += candidates[i].rect.y;
+            rects[4*j+2] += candidates[i].rect.width;
+            rects[4*j+3] += candidates[i].rect.height;
+        }
+
+        numdets = 0;
+        for( i = 0; i < added; i++ )
+        {
+            if( members[i] == 0 || members[i] < minneighbors ) continue;
+
+            dets[numdets] = cvRect( cvRound( rects[4*i] / members[i] ),
+                                    cvRound( rects[4*i+1] / members[i] ),
+                                    cvRound( rects[4*i+2] / members[i] ),
+                                    cvRound( rects[4*i+3] / members[i] ) );
+            neighbors[numdets++] = members[i];
+        }
+
+        memset( hit, 0, MAX( image->count, 1 ) );
+        for( i = 0; i < numdets; i++ )
+        {
+            int matched = 0;
+
+            if( minneighbors > 0 && icvIsNestedDetection( dets, neighbors, numdets, i ) )
+            {
+                continue;
+            }
+            for( o = 0; o < image->count; o++ )
+            {
+                if( icvMatchObject( dets[i], image->objects[o], maxsizediff, maxposdiff ) )
+                {
+                    matched = 1;
+                    if( !hit[o] )
+                    {
+                        hit[o] = 1;
+                        hits++;
+                        break;
+                    }
+                }
+            }
+            if( !matched ) falsealarms++;
+        }
+
+        worker->hits[order[k]] += hits;
+        worker->falsealarms[order[k]] += falsealarms;
+    }
+}
+
+
+int cvEvaluateCascadeClassifier( const char* dirname, const char* infoname,
+                                 int winwidth, int winheight,
+                                 double scalefactor, int minneighbors,
+                                 double maxsizediff, double maxposdiff,
+                                 int numpoints, CvCascadeEvalPoint* roc )
+{
+    int processed = 0;
+    CvIntHaarClassifier* cascade = NULL;
+    CvMemStorage* storage = NULL;
+    int* order = NULL;
+
+    CV_FUNCNAME( "cvEvaluateCascadeClassifier" );
+
+    __BEGIN__;
+
+    CvSeq* images = NULL;
+    CvSize winsize;
+    CvSize tilesize;
+    int objects;
+    int i, j, k;
+
+    /* private variables */
+    CvEvalWorker worker;
+    CvEvalImage* image;
+    IplImage* img;
+    CvSeq* candidates;
+    /* end private variables */
+
+    if( !dirname || !infoname || winwidth <= 2 || winheight <= 2 ||
+        scalefactor <= 1.0 || numpoints < 0 || (numpoints > 0 && !roc) )
+    {
+        CV_ERROR( CV_StsBadArg, "" );
+    }
+
+    winsize = cvSize( winwidth, winheight );
+    tilesize = cvSize( winwidth * CV_EVAL_TILE_WINDOWS, winheight * CV_EVAL_TILE_WINDOWS );
+
+    CV_CALL( cascade = icvLoadTreeCascadeClassifier( dirname, tilesize.width + 1, NULL ) );
+    if( cascade == NULL || ((CvTreeCascadeClassifier*) cascade)->root == NULL )
+    {
+        CV_ERROR( CV_StsError, "Unable to load cascade classifier" );
+    }
+
+    CV_CALL( storage = cvCreateMemStorage() );
+    images = icvReadEvalImages( infoname, storage );
+    if( images == NULL )
+    {
+        CV_ERROR( CV_StsError, "Unable to read marked up images description" );
+    }
+
+    /* ROC points by descending threshold */
+    CV_CALL( order = (int*) cvAlloc( sizeof( *order ) * MAX( numpoints, 1 ) ) );
+    for( k = 0; k < numpoints; k++ )
+    {
+        for( j = k; j > 0 && roc[order[j-1]].threshold < roc[k].threshold; j-- )
+        {
+            order[j] = order[j-1];
+        }
+        order[j] = k;
+        roc[k].hits = roc[k].misses = roc[k].falsealarms = 0;
+    }
+
+    objects = 0;
+    for( i = 0; i < images->total; i++ )
+    {
+        objects += ((CvEvalImage*) cvGetSeqElem( images, i ))->count;
+    }
+
+    #ifdef _OPENMP
+    #pragma omp parallel private(worker, image, img, candidates, k)
+    #endif /* _OPENMP */
+    {
+        worker.sum = cvCreateMat( tilesize.height + 1, tilesize.width + 1, CV_SUM_MAT_TYPE );
+        worker.tilted = cvCreateMat( tilesize.height + 1, tilesize.width + 1,
+                                     CV_SUM_MAT_TYPE );
+        worker.sqsum = cvCreateMat( tilesize.height + 1, tilesize.width + 1,
+                                    CV_SQSUM_MAT_TYPE );
+        worker.storage = cvCreateMemStorage();
+        worker.hits = (int*) cvAlloc( sizeof( int ) * 2 * MAX( numpoints, 1 ) );
+        worker.falsealarms = worker.hits + MAX( numpoints, 1 );
+        memset( worker.hits, 0, sizeof( int ) * 2 * MAX( numpoints, 1 ) );
+        worker.processed = 0;
+
+        #ifdef _OPENMP
+        #pragma omp for schedule(dynamic)
+        #endif /* _OPENMP */
+        for( i = 0; i < images->total; i++ )
+        {
+            image = (CvEvalImage*) cvGetSeqElem( images, i );
+
+            /* image codecs are not guaranteed to be thread safe */
+            #ifdef _OPENMP
+            #pragma omp critical (c_eval_load)
+            #endif /* _OPENMP */
+            img = cvLoadImage( image->filename, 0 );
+            if( img == NULL )
+            {
+
+#if CV_VERBOSE
+                fprintf( stderr, "Unable to open image: %s\n", image->filename );
+#endif /* CV_VERBOSE */
+
+                continue;
+            }
+
+            cvClearMemStorage( worker.storage );
+            candidates = cvCreateSeq( 0, sizeof( *candidates ), sizeof( CvEvalCandidate ),
+                                      worker.storage );
+            icvScanImage( cascade, winsize, img, scalefactor, &worker, candidates );
+            cvSeqSort( candidates, icvCmpCandidates, NULL );
+            icvAccumulateROC( (CvEvalCandidate*) cvCvtSeqToArray( candidates,
+                    cvMemStorageAlloc( worker.storage,
+                        sizeof( CvEvalCandidate ) * MAX( candidates->total, 1 ) ) ),
+                candidates->total, image, minneighbors, maxsizediff, maxposdiff,
+                numpoints, roc, order, &worker );
+            worker.processed++;
+
+            cvReleaseImage( &img );
+        }
+
+        #ifdef _OPENMP
+        #pragma omp critical (c_eval_roc)
+        #endif /* _OPENMP */
+        {
+            for( k = 0; k < numpoints; k++ )
+            {
+                roc[k].hits += worker.hits[k];
+                roc[k].falsealarms += worker.falsealarms[k];
+            }
+            processed += worker.processed;
+        }
+
+        cvFree( &worker.hits );
+        cvReleaseMemStorage( &worker.storage );
+        cvReleaseMat( &worker.sqsum );
+        cvReleaseMat( &worker.tilted );
+        cvReleaseMat( &worker.sum );
+    } /* omp parallel */
+
+    for( k = 0; k < numpoints; k++ )
+    {
+        roc[k].misses = objects - roc[k].hits;
+    }
+
+    __END__;
+
+    cvFree( &order );
+    if( storage ) cvReleaseMemStorage( &storage );
+    if( cascade ) cascade->release( &cascade );
+
+    return processed;
+}
+
+
+/* End of file. */
@@ -47,6 +47,8 @@
 
 #include <_cvhaartraining.h>
 
+#include <float.h>
+
 
 CvIntHaarClassifier* icvCreateCARTHaarClassifier( int count )
 {
@@ -128,18 +130,61 @@ float icvEvalCARTHaarClassifier( CvIntHaarClassifier* classifier,
 }
 
 
+CvIntHaarClassifier* icvCreateLUTHaarClassifier( int count )
+{
+    CvLUTHaarClassifier* lut;
+    size_t datasize;
+
+    datasize = sizeof( *lut ) + sizeof( float ) * count;
+
+    lut = (CvLUTHaarClassifier*) cvAlloc( datasize );
+    memset( lut, 0, datasize );
+
+    lut->val = (float*) (lut + 1);
+    lut->count = count;
+    lut->eval = icvEvalLUTHaarClassifier;
+    lut->save = icvSaveLUTHaarClassifier;
+    lut->release = icvReleaseHaarClassifier;
+
+    return (CvIntHaarClassifier*) lut;
+}
+
+
+float icvEvalLUTHaarClassifier( CvIntHaarClassifier* classifier,
+                                sum_type* sum, sum_type* tilted, float normfactor )
+{
+    float val;
+
+    val = cvEvalFastHaarFeature( &(((CvLUTHaarClassifier*) classifier)->fastfeature),
+                                 sum, tilted );
+    val = ( normfactor == 0.0F ) ? 0.0F : (val / normfactor);
+
+    return ((CvLUTHaarClassifier*) classifier)->val[icvGetLUTBin( val,
+        ((CvLUTHaarClassifier*) classifier)->minval,
+        ((CvLUTHaarClassifier*) classifier)->binscale,
+        ((CvLUTHaarClassifier*) classifier)->count )];
+}
+
+
 CvIntHaarClassifier* icvCreateStageHaarClassifier( int count, float threshold )
 {
     CvStageHaarClassifier* stage;
     size_t datasize;
+    int i;
 
-    datasize = sizeof( *stage ) + sizeof( CvIntHaarClassifier* ) * count;
+    datasize = sizeof( *stage ) +
+        ( sizeof( CvIntHaarClassifier* ) + sizeof( float ) ) * count;
     stage = (CvStageHaarClassifier*) cvAlloc( datasize );
     memset( stage, 0, datasize );
 
     stage->count = count;
     stage->threshold = threshold;
     stage->classifier = (CvIntHaarClassifier**) (stage + 1);
+    stage->rejection = (float*) (stage->classifier + count);
+    for( i = 0; i < count; i++ )
+    {
+        stage->rejection[i] = -FLT_MAX;
+    }
 
     stage->eval = icvEvalStageHaarClassifier;
     stage->save = icvSaveStageHaarClassifier;
@@ -167,6 +212,7 @@ void icvReleaseStageHaarClassifier( CvIntHaarClassifier** classifier )
 }
 
 
+/* returns -FLT_MAX if the window is rejected by the early rejection trace */
 float icvEvalStageHaarClassifier( CvIntHaarClassifier* classifier,
                                   sum_type* sum, sum_type* tilted, float normfactor )
 {
@@ -180,6 +226,10 @@ float icvEvalStageHaarClassifier( CvIntHaarClassifier* classifier,
             ((CvStageHaarClassifier*) classifier)->classifier[i]->eval(
                 ((CvStageHaarClassifier*) classifier)->classifier[i],
                 sum, tilted, normfactor );
+        if( stage_sum < ((CvStageHaarClassifier*) classifier)->rejection[i] )
+        {
+            return -FLT_MAX;
+        }
     }
 
     return stage_sum;
@@ -335,6 +385,113 @@ void icvSaveCARTHaarClassifier( CvIntHaarClassifier* classifier, FILE* file )
 }    
 
 
+void icvSaveLUTHaarClassifier( CvIntHaarClassifier* classifier, FILE* file )
+{
+    int i;
+    int count;
+
+    /* negative count distinguishes lookup table from CART in the stage file */
+    count = ((CvLUTHaarClassifier*) classifier)->count;
+    fprintf( file, "%d\n", -count );
+    icvSaveHaarFeature( &(((CvLUTHaarClassifier*) classifier)->feature), file );
+    fprintf( file, "%e %e\n",
+        ((CvLUTHaarClassifier*) classifier)->minval,
+        ((CvLUTHaarClassifier*) classifier)->binscale );
+    for( i = 0; i < count; i++ )
+    {
+        fprintf( file, "%e ", ((CvLUTHaarClassifier*) classifier)->val[i] );
+    }
+    fprintf( file, "\n" );
+}
+
+
+/* splits bins [lo, hi[ in half, returns the node index or minus the leaf (bin) index */
+static
+int icvSplitLUTBins( CvLUTHaarClassifier* lut, int lo, int hi,
+                     float* threshold, int* left, int* right, int* node )
+{
+    int idx;
+    int mid;
+
+    if( hi - lo <= 1 )
+    {
+        return -lo;
+    }
+    idx = (*node)++;
+    mid = (lo + hi) / 2;
+    threshold[idx] = lut->minval + mid / lut->binscale;
+    left[idx] = icvSplitLUTBins( lut, lo, mid, threshold, left, right, node );
+    right[idx] = icvSplitLUTBins( lut, mid, hi, threshold, left, right, node );
+
+    return idx;
+}
+
+
+void icvSaveLUTHaarClassifierAsCART( CvIntHaarClassifier* classifier, FILE* file )
+{
+    CvLUTHaarClassifier* lut;
+    float* threshold;
+    int* left;
+    int* right;
+    int i;
+    int count;
+    int node;
+
+    lut = (CvLUTHaarClassifier*) classifier;
+    if( lut->count < 2 || lut->binscale == 0.0F )
+    {
+        /* every value falls into the first bin */
+        fprintf( file, "%d\n", 1 );
+        icvSaveHaarFeature( &(lut->feature), file );
+        fprintf( file, "%e %d %d\n", lut->minval, 0, -1 );
+        fprintf( file, "%e %e \n", lut->val[0], lut->val[0] );
+
+        return;
+    }
+
+    /* <count> bins are the leaves of <count> - 1 splits */
+    count = lut->count - 1;
+    threshold = (float*) cvAlloc( (sizeof( *threshold ) + 2 * sizeof( *left )) * count );
+    left = (int*) (threshold + count);
+    right = left + count;
+    node = 0;
+    icvSplitLUTBins( lut, 0, lut->count, threshold, left, right, &node );
+
+    fprintf( file, "%d\n", count );
+    for( i = 0; i < count; i++ )
+    {
+        icvSaveHaarFeature( &(lut->feature), file );
+        fprintf( file, "%e %d %d\n", threshold[i], left[i], right[i] );
+    }
+    for( i = 0; i <= count; i++ )
+    {
+        fprintf( file, "%e ", lut->val[i] );
+    }
+    fprintf( file, "\n" );
+
+    cvFree( &threshold );
+}
+
+
+static
+CvIntHaarClassifier* icvLoadLUTHaarClassifier( FILE* file, int count, int step )
+{
+    CvLUTHaarClassifier* ptr;
+    int i;
+
+    ptr = (CvLUTHaarClassifier*) icvCreateLUTHaarClassifier( count );
+    icvLoadHaarFeature( &(ptr->feature), file );
+    fscanf( file, "%f %f", &(ptr->minval), &(ptr->binscale) );
+    for( i = 0; i < count; i++ )
+    {
+        fscanf( file, "%f", &(ptr->val[i]) );
+    }
+    icvConvertToFastHaarFeature( &(ptr->feature), &(ptr->fastfeature), 1, step );
+
+    return (CvIntHaarClassifier*) ptr;
+}
+
+
 CvIntHaarClassifier* icvLoadCARTHaarClassifier( FILE* file, int step )
 {
     CvCARTHaarClassifier* ptr;
@@ -342,7 +499,12 @@ CvIntHaarClassifier* icvLoadCARTHaarClassifier( FILE* file, int step )
     int count;
 
     ptr = NULL;
+    count = 0;
     fscanf( file, "%d", &count );
+    if( count < 0 )
+    {
+        return icvLoadLUTHaarClassifier( file, -count, step );
+    }
     if( count > 0 )
     {
         ptr = (CvCARTHaarClassifier*) icvCreateCARTHaarClassifier( count );
@@ -387,6 +549,52 @@ void icvSaveStageHaarClassifier( CvIntHaarClassifier* classifier, FILE* file )
 
 
 
+void icvSaveStageRejectionTrace( CvIntHaarClassifier* classifier, FILE* file )
+{
+    int count;
+    int i;
+
+    count = ((CvStageHaarClassifier*) classifier)->count;
+    fprintf( file, "%d\n", count );
+    for( i = 0; i < count; i++ )
+    {
+        fprintf( file, "%e ", ((CvStageHaarClassifier*) classifier)->rejection[i] );
+    }
+    fprintf( file, "\n" );
+}
+
+
+int icvLoadStageRejectionTrace( CvIntHaarClassifier* classifier, FILE* file )
+{
+    int count;
+    int i;
+    float* rejection;
+
+    count = 0;
+    if( file == NULL || fscanf( file, "%d", &count ) != 1 ||
+        count != ((CvStageHaarClassifier*) classifier)->count )
+    {
+        return 0;
+    }
+
+    rejection = ((CvStageHaarClassifier*) classifier)->rejection;
+    for( i = 0; i < count; i++ )
+    {
+        if( fscanf( file, "%f", &(rejection[i]) ) != 1 )
+        {
+            for( i = 0; i < count; i++ )
+            {
+                rejection[i] = -FLT_MAX;
+            }
+
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
 CvIntHaarClassifier* icvLoadCARTStageHaarClassifierF( FILE* file, int step )
 {
     CvStageHaarClassifier* ptr = NULL;
@@ -452,6 +660,64 @@ CvIntHaarClassifier* icvLoadCARTStageHaarClassifier( const char* filename, int s
     return ptr;
 }
 
+
+int icvConvertLUTCascadeToCART( const char* dirname, const char* cartname, int step )
+{
+    CvStageHaarClassifier* stage;
+    char stage_name[PATH_MAX];
+    char cart_name[PATH_MAX];
+    char* suffix;
+    char* cart_suffix;
+    FILE* file;
+    int i, j;
+    int result, parent, next;
+
+    sprintf( stage_name, "%s/", dirname );
+    suffix = stage_name + strlen( stage_name );
+    sprintf( cart_name, "%s/", cartname );
+    cart_suffix = cart_name + strlen( cart_name );
+
+    for( i = 0; ; i++ )
+    {
+        sprintf( suffix, "%d/%s", i, CV_STAGE_CART_FILE_NAME );
+        file = fopen( stage_name, "r" );
+        if( !file ) break;
+        stage = (CvStageHaarClassifier*) icvLoadCARTStageHaarClassifierF( file, step );
+        result = ( stage ) ? fscanf( file, "%d%d", &parent, &next ) : 0;
+        fclose( file );
+        if( !stage ) break;
+
+        for( j = 0; j < stage->count; j++ )
+        {
+            if( stage->classifier[j]->save == icvSaveLUTHaarClassifier )
+            {
+                stage->classifier[j]->save = icvSaveLUTHaarClassifierAsCART;
+            }
+        }
+
+        sprintf( cart_suffix, "%d/%s", i, CV_STAGE_CART_FILE_NAME );
+        file = NULL;
+        if( icvMkDir( cart_name ) && (file = fopen( cart_name, "w" )) )
+        {
+            stage->save( (CvIntHaarClassifier*) stage, file );
+            /* tree cascade links */
+            if( result == 2 )
+            {
+                fprintf( file, "\n%d\n%d\n", parent, next );
+            }
+        }
+        else
+        {
+            printf( "Failed to save classifier into %s\n", cart_name );
+        }
+        if( file ) fclose( file );
+        stage->release( (CvIntHaarClassifier**) &stage );
+        if( !file ) break;
+    }
+
+    return i;
+}
+
 /* tree cascade classifier */
 
 /* evaluates a tree cascade classifier */
@@ -482,6 +748,55 @@ float icvEvalTreeCascadeClassifier( CvIntHaarClassifier* classifier,
     return 1.0F;
 }
 
+float icvEvalTreeCascadeMargin( CvIntHaarClassifier* classifier, sum_type* sum,
+                                sum_type* tilted, float normfactor )
+{
+    CvTreeCascadeNode* ptr;
+    CvStageHaarClassifier* stage;
+    float margin;
+    float stage_sum;
+    int passed;
+    int i;
+
+    margin = -FLT_MAX;
+    ptr = ((CvTreeCascadeClassifier*) classifier)->root;
+
+    while( ptr )
+    {
+        stage = ptr->stage;
+        if( ptr->child == NULL )
+        {
+            /* leaf, evaluate all weak classifiers and try the alternatives */
+            stage_sum = 0.0F;
+            for( i = 0; i < stage->count; i++ )
+            {
+                stage_sum += stage->classifier[i]->eval( stage->classifier[i],
+                                                         sum, tilted, normfactor );
+            }
+            margin = MAX( margin, stage_sum - stage->threshold );
+            passed = 0;
+        }
+        else
+        {
+            passed = ( stage->eval( (CvIntHaarClassifier*) stage, sum, tilted, normfactor )
+                       >= stage->threshold - CV_THRESHOLD_EPS );
+        }
+
+        if( passed )
+        {
+            ptr = ptr->child;
+        }
+        else
+        {
+            while( ptr && ptr->next == NULL ) ptr = ptr->parent;
+            if( ptr == NULL ) break;
+            ptr = ptr->next;
+        }
+    }
+
+    return margin;
+}
+
 /* sets path int the tree form the root to the leaf node */
 
 void icvSetLeafNode( CvTreeCascadeClassifier* tcc, CvTreeCascadeNode* leaf )
@@ -695,6 +1010,7 @@ CvIntHaarClassifier* icvLoadTreeCascadeClassifier( const char* filename, int ste
     int i, num;
     FILE* f;
     int result, parent, next;
+    int linear;
     int stub;
 
     if( !splits ) splits = &stub;
@@ -726,6 +1042,7 @@ CvIntHaarClassifier* icvLoadTreeCascadeClassifier( const char* filename, int ste
     data_size = sizeof( *nodes ) * num;
     CV_CALL( nodes = (CvTreeCascadeNode**) cvAlloc( data_size ) );
 
+    linear = 0;
     for( i = 0; i < num; i++ )
     {
         sprintf( suffix, "%d/%s", i, CV_STAGE_CART_FILE_NAME );
@@ -736,12 +1053,27 @@ CvIntHaarClassifier* icvLoadTreeCascadeClassifier( const char* filename, int ste
         result = ( f && stage ) ? fscanf( f, "%d%d", &parent, &next ) : 0;
         if( f ) fclose( f );
         
+        /* stages saved by cvCreateCascadeClassifier have no tree links,
+           chain them linearly */
+        if( i == 0 && stage && result != 2 ) linear = 1;
+        if( linear && stage )
+        {
+            parent = i - 1;
+            next = -1;
+            result = 2;
+        }
         if( result != 2 )
         {
+            if( stage ) stage->release( (CvIntHaarClassifier**) &stage );
             num = i;
             break;
         }
 
+        sprintf( suffix, "%d/%s", i, CV_STAGE_TRACE_FILE_NAME );
+        f = fopen( stage_name, "r" );
+        icvLoadStageRejectionTrace( (CvIntHaarClassifier*) stage, f );
+        if( f ) fclose( f );
+
         printf( "Stage %d loaded\n", i );
 
         if( parent >= i || (next != -1 && next != i + 1) )
@@ -766,6 +1098,11 @@ CvIntHaarClassifier* icvLoadTreeCascadeClassifier( const char* filename, int ste
             nodes[i]->parent->child = nodes[i];
         }
     }
+    if( num < 1 )
+    {
+        cvFree( &ptr );
+        CV_ERROR( CV_StsError, "Unable to load the first stage" );
+    }
     ptr->root = nodes[0];
     ptr->next_idx = num;
 
@@ -51,6 +51,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <float.h>
 #include <highgui.h>
 #include <limits.h>
 
@@ -798,6 +799,379 @@ void icvSplitIndicesCallback( int compidx, float threshold,
     }
 }
 
+/*
+ * icvCalcStageRejectionTrace
+ *
+ * Calculate early rejection trace of the stage classifier
+ * The trace value of i-th weak classifier is the minimum sum of the first i+1 weak
+ * classifiers over the positive samples accepted by the stage. Thus early rejection
+ * does not change the hit rate of the stage on the training samples.
+ * stage     - trained stage classifier
+ * data      - haar training data the stage was trained on
+ * sampleIdx - indices of the samples used in the stage training
+ */
+static
+void icvCalcStageRejectionTrace( CvStageHaarClassifier* stage,
+                                 CvHaarTrainingData* data, CvMat* sampleIdx )
+{
+    float* partial;
+    float sum_stage;
+    int numsamples;
+    int numaccepted;
+    int i, j;
+    int idx;
+
+#ifdef CV_VERBOSE
+    int v_numneg = 0;
+    int v_numeval = 0;
+#endif /* CV_VERBOSE */
+
+    numsamples = (sampleIdx) ? MAX( sampleIdx->rows, sampleIdx->cols ) : data->sum.rows;
+    partial = (float*) cvAlloc( sizeof( float ) * stage->count );
+
+    for( j = 0; j < stage->count; j++ )
+    {
+        stage->rejection[j] = FLT_MAX;
+    }
+    numaccepted = 0;
+    for( i = 0; i < numsamples; i++ )
+    {
+        idx = icvGetIdxAt( sampleIdx, i );
+
+        if( data->cls.data.fl[idx] == 1.0F )
+        {
+            sum_stage = 0.0F;
+            for( j = 0; j < stage->count; j++ )
+            {
+                sum_stage += stage->classifier[j]->eval( stage->classifier[j],
+                    (sum_type*) (data->sum.data.ptr + idx * data->sum.step),
+                    (sum_type*) (data->tilted.data.ptr + idx * data->tilted.step),
+                    data->normfactor.data.fl[idx] );
+                partial[j] = sum_stage;
+            }
+            if( sum_stage >= (stage->threshold - CV_THRESHOLD_EPS) )
+            {
+                numaccepted++;
+                for( j = 0; j < stage->count; j++ )
+                {
+                    stage->rejection[j] = MIN( stage->rejection[j], partial[j] );
+                }
+            }
+        }
+    }
+    for( j = 0; j < stage->count; j++ )
+    {
+        stage->rejection[j] = ( numaccepted > 0 )
+            ? (stage->rejection[j] - CV_THRESHOLD_EPS) : -FLT_MAX;
+    }
+
+#ifdef CV_VERBOSE
+    for( i = 0; i < numsamples; i++ )
+    {
+        idx = icvGetIdxAt( sampleIdx, i );
+
+        if( data->cls.data.fl[idx] == 0.0F )
+        {
+            v_numneg++;
+            sum_stage = 0.0F;
+            for( j = 0; j < stage->count; j++ )
+            {
+                v_numeval++;
+                sum_stage += stage->classifier[j]->eval( stage->classifier[j],
+                    (sum_type*) (data->sum.data.ptr + idx * data->sum.step),
+                    (sum_type*) (data->tilted.data.ptr + idx * data->tilted.step),
+                    data->normfactor.data.fl[idx] );
+                if( sum_stage < stage->rejection[j] ) break;
+            }
+        }
+    }
+    printf( "WEAK CLASSIFIERS EVALUATED PER NEGATIVE: %.2f of %d\n",
+        (v_numneg > 0) ? ((float) v_numeval) / v_numneg : 0.0F, stage->count );
+    fflush( stdout );
+#endif /* CV_VERBOSE */
+
+    cvFree( &partial );
+}
+
+/*
+ * icvMirrorHaarFeature
+ *
+ * Mirror haar feature about the vertical axis of the window
+ */
+static
+void icvMirrorHaarFeature( CvTHaarFeature* feature, CvSize winsize )
+{
+    int j;
+    int tmp = 0;
+
+    if( feature->desc[0] == 'h' )
+    {
+        for( j = 0; j < CV_HAAR_FEATURE_MAX && feature->rect[j].weight != 0.0F; j++ )
+        {
+            feature->rect[j].r.x = winsize.width - feature->rect[j].r.x -
+                feature->rect[j].r.width;
+        }
+    }
+    else
+    {
+        /* (x,y) -> (24-x,y) */
+        /* w -> h; h -> w    */
+        for( j = 0; j < CV_HAAR_FEATURE_MAX && feature->rect[j].weight != 0.0F; j++ )
+        {
+            feature->rect[j].r.x = winsize.width - feature->rect[j].r.x;
+            CV_SWAP( feature->rect[j].r.width, feature->rect[j].r.height, tmp );
+        }
+    }
+}
+
+/*
+ * icvFitLUTHaarClassifier
+ *
+ * Set value range and bin confidences of the lookup table classifier <lut>
+ * for its haar feature. The value range is taken over all samples in <data>,
+ * the confidences are weighted mean responses of the <idx> samples in each bin.
+ * boosttype - CV_RABCLASS: confidences are object probabilities
+ *             otherwise:   confidences are mean responses
+ */
+static
+void icvFitLUTHaarClassifier( CvLUTHaarClassifier* lut, CvHaarTrainingData* data,
+                              CvMat* idx, CvMat* weakTrainVals, CvBoostType boosttype )
+{
+    float* vals;
+    double* sumw;
+    double* sumwy;
+    float minval, maxval;
+    float normfactor;
+    float w;
+    int numidx;
+    int i;
+    int index;
+    int bin;
+
+    vals = (float*) cvAlloc( sizeof( float ) * data->sum.rows );
+    sumw = (double*) cvAlloc( sizeof( double ) * 2 * lut->count );
+    sumwy = sumw + lut->count;
+
+    minval = FLT_MAX;
+    maxval = -FLT_MAX;
+    for( i = 0; i < data->sum.rows; i++ )
+    {
+        vals[i] = cvEvalFastHaarFeature( &lut->fastfeature,
+            (sum_type*) (data->sum.data.ptr + i * data->sum.step),
+            (sum_type*) (data->tilted.data.ptr + i * data->tilted.step) );
+        normfactor = data->normfactor.data.fl[i];
+        vals[i] = ( normfactor == 0.0F ) ? 0.0F : (vals[i] / normfactor);
+        minval = MIN( minval, vals[i] );
+        maxval = MAX( maxval, vals[i] );
+    }
+    lut->minval = minval;
+    lut->binscale = ( maxval > minval ) ? lut->count / (maxval - minval) : 0.0F;
+
+    for( bin = 0; bin < lut->count; bin++ )
+    {
+        sumw[bin] = sumwy[bin] = 0.0;
+    }
+    numidx = (idx) ? MAX( idx->rows, idx->cols ) : data->sum.rows;
+    for( i = 0; i < numidx; i++ )
+    {
+        index = icvGetIdxAt( idx, i );
+        bin = icvGetLUTBin( vals[index], lut->minval, lut->binscale, lut->count );
+        w = data->weights.data.fl[index];
+        sumw[bin] += w;
+        sumwy[bin] += w * weakTrainVals->data.fl[index];
+    }
+    for( bin = 0; bin < lut->count; bin++ )
+    {
+        lut->val[bin] = ( sumw[bin] > 0.0 ) ? (float) (sumwy[bin] / sumw[bin]) : 0.0F;
+        if( boosttype == CV_RABCLASS )
+        {
+            lut->val[bin] = 0.5F * (1.0F + lut->val[bin]);
+        }
+    }
+
+    cvFree( &sumw );
+    cvFree( &vals );
+}
+
+/*
+ * icvCreateLUTHaarClassifierFromData
+ *
+ * Create lookup table weak classifier on the haar feature whose bins fit
+ * <weakTrainVals> with the least weighted square error
+ * data          - haar training data. Precalculated feature values and their
+ *   sorted indices are used if available
+ * idx           - indices of samples used in training. If NULL all samples are used
+ * haarFeatures  - candidate haar features
+ * weakTrainVals - responses
+ * numbins       - number of bins
+ * boosttype     - type of applied boosting algorithm
+ */
+static
+CvIntHaarClassifier* icvCreateLUTHaarClassifierFromData( CvHaarTrainingData* data,
+                                                         CvMat* idx,
+                                                         CvIntHaarFeatures* haarFeatures,
+                                                         CvMat* weakTrainVals,
+                                                         int numbins,
+                                                         CvBoostType boosttype )
+{
+    CvLUTHaarClassifier* lut;
+    CvUserdata userdata;
+    float* errors;
+    int n, m;
+    int numidx;
+    int numcached;
+    int first;
+    int best;
+    int i;
+
+    n = haarFeatures->count;
+    m = data->sum.rows;
+    numidx = (idx) ? MAX( idx->rows, idx->cols ) : m;
+    numcached = 0;
+    if( data->valcache != NULL )
+    {
+#ifdef CV_COL_ARRANGEMENT
+        numcached = data->valcache->rows;
+#else
+        numcached = data->valcache->cols;
+#endif
+    }
+
+    userdata = cvUserdata( data, haarFeatures );
+    errors = (float*) cvAlloc( sizeof( float ) * n );
+
+    #ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic)
+    #endif /* _OPENMP */
+    for( first = 0; first < n; first += CV_STUMP_TRAIN_PORTION )
+    {
+        CvMat* portiondata = NULL;
+        uchar* valdata;
+        size_t fstep; /* step between features */
+        size_t sstep; /* step between samples */
+        double* sumw;
+        double* sumwy;
+        double sumwyy;
+        double fit;
+        float* fval;
+        float minval, maxval;
+        float binscale;
+        float w, y;
+        int portion;
+        int j, k;
+        int index;
+        int bin;
+
+        portion = MIN( CV_STUMP_TRAIN_PORTION, n - first );
+        if( first + portion <= numcached )
+        {
+            /* reuse precalculated feature values */
+            valdata = data->valcache->data.ptr;
+#ifdef CV_COL_ARRANGEMENT
+            valdata += first * ((size_t) data->valcache->step);
+#else
+            valdata += first * sizeof( float );
+#endif
+        }
+        else
+        {
+#ifdef CV_COL_ARRANGEMENT
+            portiondata = cvCreateMat( portion, m, CV_32FC1 );
+#else
+            portiondata = cvCreateMat( m, portion, CV_32FC1 );
+#endif
+            icvGetTrainingDataCallback( portiondata, NULL, NULL, first, portion,
+                                        &userdata );
+            valdata = portiondata->data.ptr;
+        }
+#ifdef CV_COL_ARRANGEMENT
+        fstep = ( portiondata ) ? portiondata->step : data->valcache->step;
+        sstep = sizeof( float );
+#else
+        fstep = sizeof( float );
+        sstep = ( portiondata ) ? portiondata->step : data->valcache->step;
+#endif
+
+        sumw = (double*) cvAlloc( sizeof( double ) * 2 * numbins );
+        sumwy = sumw + numbins;
+        for( j = 0; j < portion; j++ )
+        {
+            if( portiondata == NULL )
+            {
+                idx_type* sorted;
+
+                /* the range is given by the first and the last sorted values */
+                sorted = (idx_type*) (data->idxcache->data.ptr +
+                    (first + j) * ((size_t) data->idxcache->step));
+                minval = *((float*) (valdata + j * fstep + sorted[0] * sstep));
+                maxval = *((float*) (valdata + j * fstep + sorted[m - 1] * sstep));
+            }
+            else
+            {
+                minval = FLT_MAX;
+                maxval = -FLT_MAX;
+                for( k = 0; k < m; k++ )
+                {
+                    fval = (float*) (valdata + j * fstep + k * sstep);
+                    minval = MIN( minval, *fval );
+                    maxval = MAX( maxval, *fval );
+                }
+            }
+            binscale = ( maxval > minval ) ? numbins / (maxval - minval) : 0.0F;
+
+            for( bin = 0; bin < numbins; bin++ )
+            {
+                sumw[bin] = sumwy[bin] = 0.0;
+            }
+            sumwyy = 0.0;
+            for( k = 0; k < numidx; k++ )
+            {
+                index = icvGetIdxAt( idx, k );
+                fval = (float*) (valdata + j * fstep + index * sstep);
+                bin = icvGetLUTBin( *fval, minval, binscale, numbins );
+                w = data->weights.data.fl[index];
+                y = weakTrainVals->data.fl[index];
+                sumw[bin] += w;
+                sumwy[bin] += w * y;
+                sumwyy += w * y * y;
+            }
+            fit = 0.0;
+            for( bin = 0; bin < numbins; bin++ )
+            {
+                if( sumw[bin] > 0.0 )
+                {
+                    fit += sumwy[bin] * sumwy[bin] / sumw[bin];
+                }
+            }
+            errors[first + j] = (float) (sumwyy - fit);
+        }
+
+        cvFree( &sumw );
+        if( portiondata != NULL )
+        {
+            cvReleaseMat( &portiondata );
+        }
+    }
+
+    best = 0;
+    for( i = 1; i < n; i++ )
+    {
+        if( errors[i] < errors[best] )
+        {
+            best = i;
+        }
+    }
+    cvFree( &errors );
+
+    lut = (CvLUTHaarClassifier*) icvCreateLUTHaarClassifier( numbins );
+    lut->compidx = best;
+    lut->feature = haarFeatures->feature[best];
+    lut->fastfeature = haarFeatures->fastfeature[best];
+    icvFitLUTHaarClassifier( lut, data, idx, weakTrainVals, boosttype );
+
+    return (CvIntHaarClassifier*) lut;
+}
+
 /*
  * icvCreateCARTStageClassifier
  *
@@ -810,6 +1184,8 @@ void icvSplitIndicesCallback( int compidx, float threshold,
  *   feature need (number_of_samples*(sizeof( float ) + sizeof( short ))) bytes of memory
  * weightfraction   - weight trimming parameter
  * numsplits        - number of binary splits in each tree
+ * numbins          - if not 0 lookup tables with <numbins> bins are used as weak
+ *   classifiers instead of trees. Only for Real and Gentle AdaBoost
  * boosttype        - type of applied boosting algorithm
  * stumperror       - type of used error if Discrete AdaBoost algorithm is applied
  * maxsplits        - maximum total number of splits in all weak classifiers.
@@ -824,6 +1200,7 @@ CvIntHaarClassifier* icvCreateCARTStageClassifier( CvHaarTrainingData* data,
                                                    int   symmetric,
                                                    float weightfraction,
                                                    int numsplits,
+                                                   int numbins,
                                                    CvBoostType boosttype,
                                                    CvStumpError stumperror,
                                                    int maxsplits )
@@ -867,6 +1244,10 @@ CvIntHaarClassifier* icvCreateCARTStageClassifier( CvHaarTrainingData* data,
     int numtrimmed;
     
     CvCARTHaarClassifier* classifier;
+    CvLUTHaarClassifier* lut;
+    CvIntHaarClassifier* weak;
+    float* weakval;
+    int numweakval;
     CvSeq* seq = NULL;
     CvMemStorage* storage = NULL;
     CvMat* weakTrainVals;
@@ -884,6 +1265,11 @@ CvIntHaarClassifier* icvCreateCARTStageClassifier( CvHaarTrainingData* data,
     m = data->sum.rows;
     numsamples = (sampleIdx) ? MAX( sampleIdx->rows, sampleIdx->cols ) : m;
 
+    if( boosttype != CV_RABCLASS && boosttype != CV_GABCLASS )
+    {
+        numbins = 0;
+    }
+
     userdata = cvUserdata( data, haarFeatures );
 
     stumpTrainParams.type = ( boosttype == CV_DABCLASS )
@@ -929,20 +1315,50 @@ CvIntHaarClassifier* icvCreateCARTStageClassifier( CvHaarTrainingData* data,
 
 #endif /* CV_VERBOSE */
 
-        cart = (CvCARTClassifier*) cvCreateCARTClassifier( data->valcache,
-                        flags,
-                        weakTrainVals, 0, 0, 0, trimmedIdx,
-                        &(data->weights),
-                        (CvClassifierTrainParams*) &trainParams );
+        if( numbins > 0 )
+        {
+            lut = (CvLUTHaarClassifier*) icvCreateLUTHaarClassifierFromData( data,
+                trimmedIdx, haarFeatures, weakTrainVals, numbins, boosttype );
+            weak = (CvIntHaarClassifier*) lut;
+            weakval = lut->val;
+            numweakval = lut->count;
+
+            num_splits++;
+
+            if( symmetric && (seq->total % 2) )
+            {
+                /* flip haar feature and refit the bins */
+                icvMirrorHaarFeature( &lut->feature, data->winsize );
+                icvConvertToFastHaarFeature( &lut->feature, &lut->fastfeature,
+                                             1, data->winsize.width + 1 );
+                icvFitLUTHaarClassifier( lut, data, trimmedIdx, weakTrainVals, boosttype );
+
+#ifdef CV_VERBOSE
+                v_flipped = 1;
+#endif /* CV_VERBOSE */
+
+            }
+        }
+        else
+        {
+            cart = (CvCARTClassifier*) cvCreateCARTClassifier( data->valcache,
+                            flags,
+                            weakTrainVals, 0, 0, 0, trimmedIdx,
+                            &(data->weights),
+                            (CvClassifierTrainParams*) &trainParams );
 
-        classifier = (CvCARTHaarClassifier*) icvCreateCARTHaarClassifier( numsplits );
-        icvInitCARTHaarClassifier( classifier, cart, haarFeatures );
+            classifier = (CvCARTHaarClassifier*) icvCreateCARTHaarClassifier( numsplits );
+            icvInitCARTHaarClassifier( classifier, cart, haarFeatures );
+            weak = (CvIntHaarClassifier*) classifier;
+            weakval = classifier->val;
+            numweakval = classifier->count + 1;
 
-        num_splits += classifier->count;
+            num_splits += classifier->count;
 
-        cart->release( (CvClassifier**) &cart );
+            cart->release( (CvClassifier**) &cart );
+        }
         
-        if( symmetric && (seq->total % 2) )
+        if( numbins == 0 && symmetric && (seq->total % 2) )
         {
             float normfactor = 0.0F;
             CvStumpClassifier* stump;
@@ -950,31 +1366,7 @@ CvIntHaarClassifier* icvCreateCARTStageClassifier( CvHaarTrainingData* data,
             /* flip haar features */
             for( i = 0; i < classifier->count; i++ )
             {
-                if( classifier->feature[i].desc[0] == 'h' )
-                {
-                    for( j = 0; j < CV_HAAR_FEATURE_MAX &&
-                                    classifier->feature[i].rect[j].weight != 0.0F; j++ )
-                    {
-                        classifier->feature[i].rect[j].r.x = data->winsize.width - 
-                            classifier->feature[i].rect[j].r.x -
-                            classifier->feature[i].rect[j].r.width;                
-                    }
-                }
-                else
-                {
-                    int tmp = 0;
-
-                    /* (x,y) -> (24-x,y) */
-                    /* w -> h; h -> w    */
-                    for( j = 0; j < CV_HAAR_FEATURE_MAX &&
-                                    classifier->feature[i].rect[j].weight != 0.0F; j++ )
-                    {
-                        classifier->feature[i].rect[j].r.x = data->winsize.width - 
-                            classifier->feature[i].rect[j].r.x;
-                        CV_SWAP( classifier->feature[i].rect[j].r.width,
-                                 classifier->feature[i].rect[j].r.height, tmp );
-                    }
-                }
+                icvMirrorHaarFeature( &classifier->feature[i], data->winsize );
             }
             icvConvertToFastHaarFeature( classifier->feature,
                                          classifier->fastfeature,
@@ -1039,7 +1431,7 @@ CvIntHaarClassifier* icvCreateCARTStageClassifier( CvHaarTrainingData* data,
         {
             idx = icvGetIdxAt( sampleIdx, i );
 
-            eval.data.fl[idx] = classifier->eval( (CvIntHaarClassifier*) classifier,
+            eval.data.fl[idx] = weak->eval( weak,
                 (sum_type*) (data->sum.data.ptr + idx * data->sum.step),
                 (sum_type*) (data->tilted.data.ptr + idx * data->tilted.step),
                 data->normfactor.data.fl[idx] );
@@ -1049,16 +1441,16 @@ CvIntHaarClassifier* icvCreateCARTStageClassifier( CvHaarTrainingData* data,
                                            &data->weights, trainer );
         sumalpha += alpha;
         
-        for( i = 0; i <= classifier->count; i++ )
+        for( i = 0; i < numweakval; i++ )
         {
             if( boosttype == CV_RABCLASS ) 
             {
-                classifier->val[i] = cvLogRatio( classifier->val[i] );
+                weakval[i] = cvLogRatio( weakval[i] );
             }
-            classifier->val[i] *= alpha;
+            weakval[i] *= alpha;
         }
 
-        cvSeqPush( seq, (void*) &classifier );
+        cvSeqPush( seq, (void*) &weak );
 
         numpos = 0;
         for( i = 0; i < numsamples; i++ )
@@ -1170,6 +1562,7 @@ CvIntHaarClassifier* icvCreateCARTStageClassifier( CvHaarTrainingData* data,
         stage = (CvStageHaarClassifier*) icvCreateStageHaarClassifier( seq->total,
                                                                        threshold );
         cvCvtSeqToArray( seq, (CvArr*) stage->classifier );
+        icvCalcStageRejectionTrace( stage, data, sampleIdx );
     }
     
     /* CLEANUP */
@@ -1807,6 +2200,109 @@ int icvGetHaarTraininDataFromVecCallback( CvMat* img, void* userdata )
     return 1;
 }
 
+/*
+ * icvGetHaarTrainingDataFromVecMap
+ *
+ * Fill <data> with samples from memory mapped .vec file, passed <cascade>
+ * Samples are taken in the same order as icvGetHaarTrainingData takes them but
+ * candidates are processed by blocks of the number of still missing samples.
+ * Each candidate of the block is evaluated in its own slot directly from the map,
+ * in parallel, and passed candidates are moved down to fill the gaps.
+ */
+static
+int icvGetHaarTrainingDataFromVecMap( CvHaarTrainingData* data, int first, int count,
+                                      CvIntHaarClassifier* cascade, CvVecMap* map,
+                                      int* consumed )
+{
+    int i = 0;
+    int j = 0;
+    int block = 0;
+    int next = 0;
+    int getcount = 0;
+    uchar* passed = NULL;
+
+    /* private variables */
+    CvMat img;
+    CvMat sum;
+    CvMat tilted;
+    CvMat sqsum;
+
+    sum_type* sumdata;
+    sum_type* tilteddata;
+    float*    normfactor;
+    /* end private variables */
+
+    assert( data != NULL );
+    assert( first + count <= data->maxnum );
+    assert( cascade != NULL );
+    assert( map != NULL );
+
+    passed = (uchar*) cvAlloc( sizeof( *passed ) * MAX( count, 1 ) );
+    while( getcount < count && next < map->count )
+    {
+        block = MIN( count - getcount, map->count - next );
+
+        #ifdef _OPENMP
+        #pragma omp parallel private(img, sum, tilted, sqsum, sumdata, tilteddata, \
+                                     normfactor, i, j)
+        #endif /* _OPENMP */
+        {
+            sum = cvMat( data->winsize.height + 1, data->winsize.width + 1,
+                         CV_SUM_MAT_TYPE, NULL );
+            tilted = cvMat( data->winsize.height + 1, data->winsize.width + 1,
+                            CV_SUM_MAT_TYPE, NULL );
+            sqsum = cvMat( data->winsize.height + 1, data->winsize.width + 1,
+                           CV_SQSUM_MAT_TYPE,
+                           cvAlloc( sizeof( sqsum_type ) * (data->winsize.height + 1)
+                                                         * (data->winsize.width + 1) ) );
+
+            #ifdef _OPENMP
+            #pragma omp for schedule(static, 1)
+            #endif /* _OPENMP */
+            for( j = 0; j < block; j++ )
+            {
+                i = first + getcount + j;
+                img = cvMat( data->winsize.height, data->winsize.width, CV_8UC1,
+                             icvGetVecMapSample( map, next + j ) );
+                sumdata = (sum_type*) (data->sum.data.ptr + i * data->sum.step);
+                tilteddata = (sum_type*) (data->tilted.data.ptr + i * data->tilted.step);
+                normfactor = data->normfactor.data.fl + i;
+                sum.data.ptr = (uchar*) sumdata;
+                tilted.data.ptr = (uchar*) tilteddata;
+                icvGetAuxImages( &img, &sum, &tilted, &sqsum, normfactor );
+                passed[j] = (uchar)
+                    ( cascade->eval( cascade, sumdata, tilteddata, *normfactor ) != 0.0F );
+            }
+
+            cvFree( &(sqsum.data.ptr) );
+        } /* omp parallel */
+
+        /* compact passed samples preserving their order */
+        for( j = 0, i = first + getcount; j < block; j++ )
+        {
+            if( !passed[j] ) continue;
+            if( i != first + getcount + j )
+            {
+                memcpy( data->sum.data.ptr + i * data->sum.step,
+                        data->sum.data.ptr + (first + getcount + j) * data->sum.step,
+                        data->sum.step );
+                memcpy( data->tilted.data.ptr + i * data->tilted.step,
+                        data->tilted.data.ptr + (first + getcount + j) * data->tilted.step,
+                        data->tilted.step );
+                data->normfactor.data.fl[i] = data->normfactor.data.fl[first + getcount + j];
+            }
+            i++;
+        }
+        getcount = i - first;
+        next += block;
+    }
+    if( consumed != NULL ) (*consumed) = next;
+
+    cvFree( &passed );
+
+    return getcount;
+}
+
 /*
  * icvGetHaarTrainingDataFromVec
  * Get training data from .vec file
@@ -1824,8 +2320,23 @@ int icvGetHaarTrainingDataFromVec( CvHaarTrainingData* data, int first, int coun
     __BEGIN__;
 
     CvVecFile file;
+    CvVecMap* map = NULL;
     short tmp = 0;    
     
+    if( filename ) map = icvOpenVecMap( filename );
+    if( map != NULL )
+    {
+        if( map->width != data->winsize.width || map->height != data->winsize.height )
+        {
+            icvReleaseVecMap( &map );
+            CV_ERROR( CV_StsError, "Vec file sample size mismatch" );
+        }
+        getcount = icvGetHaarTrainingDataFromVecMap( data, first, count, cascade,
+                                                     map, consumed );
+        icvReleaseVecMap( &map );
+        EXIT;
+    }
+
     file.input = NULL;
     if( filename ) file.input = fopen( filename, "rb" );
 
@@ -1858,6 +2369,48 @@ int icvGetHaarTrainingDataFromVec( CvHaarTrainingData* data, int first, int coun
 }
 
 
+/*
+ * icvSaveXMLCascade
+ *
+ * Saves the cascade in the directory <dirname> into <dirname>.xml.
+ * The xml format has no lookup table weak classifiers, so if numbins != 0 the
+ * stages are first copied into <dirname>_cart with each lookup table written as
+ * the equivalent tree (see icvSaveLUTHaarClassifierAsCART) and the copy is saved
+ */
+static
+void icvSaveXMLCascade( const char* dirname, int winwidth, int winheight, int numbins )
+{
+    char xml_path[PATH_MAX];
+    char cart_path[PATH_MAX];
+    int len = strlen( dirname );
+    CvHaarClassifierCascade* cascade = 0;
+
+    strcpy( xml_path, dirname );
+    if( xml_path[len-1] == '\\' || xml_path[len-1] == '/' )
+        len--;
+    strcpy( xml_path + len, ".xml" );
+    if( numbins != 0 )
+    {
+        strncpy( cart_path, dirname, len );
+        strcpy( cart_path + len, "_cart" );
+        printf( "Writing lookup table stages as trees into %s\n", cart_path );
+        if( icvConvertLUTCascadeToCART( dirname, cart_path, winwidth + 1 ) < 1 )
+        {
+            printf( "Failed to convert lookup table stages into %s, %s is not saved\n",
+                    cart_path, xml_path );
+            return;
+        }
+        dirname = cart_path;
+    }
+    cascade = cvLoadHaarClassifierCascade( dirname, cvSize(winwidth,winheight) );
+    if( cascade )
+        cvSave( xml_path, cascade );
+    else
+        printf( "Failed to load %s, %s is not saved\n", dirname, xml_path );
+    cvReleaseHaarClassifierCascade( &cascade );
+}
+
+
 void cvCreateCascadeClassifier( const char* dirname,
                                 const char* vecfilename,
                                 const char* bgfilename, 
@@ -1869,7 +2422,8 @@ void cvCreateCascadeClassifier( const char* dirname,
                                 int mode, int symmetric,
                                 int equalweights,
                                 int winwidth, int winheight,
-                                int boosttype, int stumperror )
+                                int boosttype, int stumperror,
+                                int numbins )
 {
     CvCascadeHaarClassifier* cascade = NULL;
     CvHaarTrainingData* data = NULL;
@@ -1927,6 +2481,10 @@ void cvCreateCascadeClassifier( const char* dirname,
             }
             if( cascade->classifier[i] != NULL )
             {
+                sprintf( stagename, "%s%d/%s", dirname, i, CV_STAGE_TRACE_FILE_NAME );
+                file = fopen( stagename, "r" );
+                icvLoadStageRejectionTrace( cascade->classifier[i], file );
+                if( file ) fclose( file );
 
 #ifdef CV_VERBOSE
                 printf( "STAGE: %d LOADED.\n", i );
@@ -2012,7 +2570,7 @@ void cvCreateCascadeClassifier( const char* dirname,
 
             cascade->classifier[i] = icvCreateCARTStageClassifier(  data, NULL,
                 haar_features, minhitrate, maxfalsealarm, symmetric, weightfraction,
-                numsplits, (CvBoostType) boosttype, (CvStumpError) stumperror, 0 );
+                numsplits, numbins, (CvBoostType) boosttype, (CvStumpError) stumperror, 0 );
 
 #ifdef CV_VERBOSE
             printf( "STAGE TRAINING TIME: %.2f\n", (proctime + TIME( 0 )) );
@@ -2034,23 +2592,21 @@ void cvCreateCascadeClassifier( const char* dirname,
 
             }
 
+            sprintf( stagename, "%s%d/%s", dirname, i, CV_STAGE_TRACE_FILE_NAME );
+            file = fopen( stagename, "w" );
+            if( file != NULL )
+            {
+                icvSaveStageRejectionTrace( cascade->classifier[i], file );
+                fclose( file );
+            }
+
         }
         icvReleaseIntHaarFeatures( &haar_features );
         icvReleaseHaarTrainingData( &data );
 
         if( i == nstages )
         {
-            char xml_path[1024];
-            int len = strlen(dirname);
-            CvHaarClassifierCascade* cascade = 0;
-            strcpy( xml_path, dirname );
-            if( xml_path[len-1] == '\\' || xml_path[len-1] == '/' )
-                len--;
-            strcpy( xml_path + len, ".xml" );
-            cascade = cvLoadHaarClassifierCascade( dirname, cvSize(winwidth,winheight) );
-            if( cascade )
-                cvSave( xml_path, cascade );
-            cvReleaseHaarClassifierCascade( &cascade );
+            icvSaveXMLCascade( dirname, winwidth, winheight, numbins );
         }
     }
     else
@@ -2075,7 +2631,14 @@ int icvNumSplits( CvStageHaarClassifier* stage )
     num = 0;
     for( i = 0; i < stage->count; i++ )
     {
-        num += ((CvCARTHaarClassifier*) stage->classifier[i])->count;
+        if( stage->classifier[i]->eval == icvEvalLUTHaarClassifier )
+        {
+            num++;
+        }
+        else
+        {
+            num += ((CvCARTHaarClassifier*) stage->classifier[i])->count;
+        }
     }
 
     return num;
@@ -2136,6 +2699,13 @@ CvMat* icvGetUsedValues( CvHaarTrainingData* training_data,
     {
         CvCARTHaarClassifier* cart;
 
+        if( stage->classifier[i]->eval == icvEvalLUTHaarClassifier )
+        {
+            feature_idx->data.i[total++] =
+                ((CvLUTHaarClassifier*) stage->classifier[i])->compidx;
+            continue;
+        }
+
         cart = (CvCARTHaarClassifier*) stage->classifier[i];
         for( j = 0; j < cart->count; j++ )
         {
@@ -2213,7 +2783,8 @@ void cvCreateTreeCascadeClassifier( const char* dirname,
                                     int equalweights,
                                     int winwidth, int winheight,
                                     int boosttype, int stumperror,
-                                    int maxtreesplits, int minpos )
+                                    int maxtreesplits, int minpos,
+                                    int numbins )
 {
     CvTreeCascadeClassifier* tcc = NULL;
     CvIntHaarFeatures* haar_features = NULL;
@@ -2377,7 +2948,7 @@ void cvCreateTreeCascadeClassifier( const char* dirname,
                         (CvStageHaarClassifier*) icvCreateCARTStageClassifier(
                             training_data, NULL, haar_features,
                             minhitrate, maxfalsealarm, symmetric,
-                            weightfraction, numsplits, (CvBoostType) boosttype,
+                            weightfraction, numsplits, numbins, (CvBoostType) boosttype,
                             (CvStumpError) stumperror, 0 );
                     printf( "Stage training time: %.2f\n", (proctime + TIME( 0 )) );
 
@@ -2493,8 +3064,9 @@ void cvCreateTreeCascadeClassifier( const char* dirname,
                             new_node->stage = (CvStageHaarClassifier*)
                                 icvCreateCARTStageClassifier( training_data, idx, haar_features,
                                     minhitrate, maxfalsealarm, symmetric,
-                                    weightfraction, numsplits, (CvBoostType) boosttype,
-                                    (CvStumpError) stumperror, best_num - cur_num );
+                                    weightfraction, numsplits, numbins,
+                                    (CvBoostType) boosttype, (CvStumpError) stumperror,
+                                    best_num - cur_num );
                             printf( "Stage training time: %.2f\n", (proctime + TIME( 0 )) );
 
                             if( !(new_node->stage) )
@@ -2612,6 +3184,15 @@ void cvCreateTreeCascadeClassifier( const char* dirname,
                         printf( "Failed to save classifier into %s\n", stage_name );
                     }
                     if( file ) fclose( file );
+
+                    sprintf( suffix, "%d/%s", cur_node->idx, CV_STAGE_TRACE_FILE_NAME );
+                    file = fopen( stage_name, "w" );
+                    if( file )
+                    {
+                        icvSaveStageRejectionTrace( (CvIntHaarClassifier*) cur_node->stage,
+                                                    file );
+                        fclose( file );
+                    }
                 }
 
                 if( parent ) sprintf( buf, "%d", parent->idx );
@@ -2633,19 +3214,7 @@ void cvCreateTreeCascadeClassifier( const char* dirname,
         } while( leaves );
 
         /* save the cascade to xml file */
-        {
-            char xml_path[1024];
-            int len = strlen(dirname);
-            CvHaarClassifierCascade* cascade = 0;
-            strcpy( xml_path, dirname );
-            if( xml_path[len-1] == '\\' || xml_path[len-1] == '/' )
-                len--;
-            strcpy( xml_path + len, ".xml" );
-            cascade = cvLoadHaarClassifierCascade( dirname, cvSize(winwidth,winheight) );
-            if( cascade )
-                cvSave( xml_path, cascade );
-            cvReleaseHaarClassifierCascade( &cascade );
-        }
+        icvSaveXMLCascade( dirname, winwidth, winheight, numbins );
 
     } /* if( nstages > 0 ) */
 
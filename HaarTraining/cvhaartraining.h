@@ -125,6 +125,32 @@ int cvCreateTrainingSamplesFromInfo( const char* infoname, const char* vecfilena
  */
 void cvShowVecSamples( const char* filename, int winwidth, int winheight, double scale );
 
+/*
+ * cvConvertVecToVec2
+ *
+ * Converts .vec file into the compact .vec file of version 2
+ * (8-bit pixels, aligned records, offset index) which can be memory mapped
+ * srcname   - .vec file name
+ * dstname   - name of the created version 2 .vec file
+ * winwidth  - sample width
+ * winheight - sample height
+ *
+ * Return number of converted samples
+ */
+int cvConvertVecToVec2( const char* srcname, const char* dstname,
+                        int winwidth, int winheight );
+
+/*
+ * cvConvertVec2ToVec
+ *
+ * Converts .vec file of version 2 back into the original .vec file format
+ * srcname - version 2 .vec file name
+ * dstname - name of the created .vec file
+ *
+ * Return number of converted samples
+ */
+int cvConvertVec2ToVec( const char* srcname, const char* dstname );
+
 
 /*
  * cvCreateCascadeClassifier
@@ -160,6 +186,15 @@ void cvShowVecSamples( const char* filename, int winwidth, int winheight, double
  *   0 - misclassification error
  *   1 - gini error
  *   2 - entropy error
+ * numbins          - if not 0 and boosttype is Real or Gentle AdaBoost, lookup tables
+ *   of <numbins> bins over the normalized haar feature value are used as weak
+ *   classifiers instead of trees of <numsplits> splits. For the OpenCV xml format,
+ *   which has no lookup tables, the stages are copied into <dirname>_cart with
+ *   each lookup table written as the equivalent tree of splits at the bin
+ *   boundaries, and <dirname>.xml is saved from the copy. The tree evaluates the
+ *   same haar feature once per split on its path, i.e. about log2(<numbins>)
+ *   times per weak classifier instead of once, so the xml cascade detects the
+ *   same objects but each lookup table weak classifier costs more
  */
 void cvCreateCascadeClassifier( const char* dirname,
                                 const char* vecfilename,
@@ -172,7 +207,8 @@ void cvCreateCascadeClassifier( const char* dirname,
                                 int mode = 0, int symmetric = 1,
                                 int equalweights = 1,
                                 int winwidth = 24, int winheight = 24,
-                                int boosttype = 3, int stumperror = 0 );
+                                int boosttype = 3, int stumperror = 0,
+                                int numbins = 0 );
 
 void cvCreateTreeCascadeClassifier( const char* dirname,
                                     const char* vecfilename,
@@ -186,6 +222,50 @@ void cvCreateTreeCascadeClassifier( const char* dirname,
                                     int equalweights,
                                     int winwidth, int winheight,
                                     int boosttype, int stumperror,
-                                    int maxtreesplits, int minpos );
+                                    int maxtreesplits, int minpos,
+                                    int numbins = 0 );
+
+/* one point of the receiver operating characteristic */
+typedef struct CvCascadeEvalPoint
+{
+    float threshold;   /* shift of the last stage threshold (input) */
+    int   hits;        /* number of detected objects */
+    int   misses;      /* number of missed objects */
+    int   falsealarms; /* number of detections which do not match any object */
+} CvCascadeEvalPoint;
+
+/*
+ * cvEvaluateCascadeClassifier
+ *
+ * Evaluate cascade classifier on a set of marked up images
+ * The cascade is loaded once and the images are processed in parallel (OpenMP),
+ * each thread with its own integral image buffers. Windows which reach the last
+ * stage are recorded with their last stage sums, so all the points of ROC are
+ * obtained from a single detection pass.
+ * dirname      - directory name of the cascade created by cvCreateTreeCascadeClassifier,
+ *   or by cvCreateCascadeClassifier whose stages (without tree links) are chained
+ *   linearly
+ * infoname     - file in which marked up image descriptions are stored
+ *   (the format of cvCreateTrainingSamplesFromInfo)
+ * winwidth     - sample width
+ * winheight    - sample height
+ * scalefactor  - scale step of the searched window sizes, must be greater than 1
+ * minneighbors - min number of grouped windows which make a detection. As in
+ *   cvHaarDetectObjects, a detection which lies inside another one with more
+ *   neighbors is removed, 0 - windows are neither grouped nor removed
+ * maxsizediff  - max ratio of sizes of matched detection and object
+ * maxposdiff   - max distance between centers of matched detection and object
+ *   relative to the object size
+ * numpoints    - number of ROC points
+ * roc          - ROC points. <threshold> of each point must be set by the caller,
+ *   0 corresponds to the trained cascade
+ *
+ * Return number of processed images
+ */
+int cvEvaluateCascadeClassifier( const char* dirname, const char* infoname,
+                                 int winwidth, int winheight,
+                                 double scalefactor, int minneighbors,
+                                 double maxsizediff, double maxposdiff,
+                                 int numpoints, CvCascadeEvalPoint* roc );
 
 #endif /* _CVHAARTRAINING_H_ */
@@ -56,6 +56,16 @@
 
 #include <cv.h>
 #include <highgui.h>
+#include <float.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif /* _WIN32 */
 
 /* Calculates coefficients of perspective transformation
  * which maps <quad> into rectangle ((0,0), (w,0), (w,h), (h,0)):
@@ -129,6 +139,158 @@ void cvGetPerspectiveTransform( CvSize src_size, double quad[4][2],
     __END__;
 }
 
+#ifndef __IPL_H__
+
+/* number of fractional bits of fixed-point source coordinates */
+#define ICV_WARP_BITS  10
+#define ICV_WARP_SCALE (1 << ICV_WARP_BITS)
+#define ICV_WARP_MASK  (ICV_WARP_SCALE - 1)
+
+/* intersects [*xmin, *xmax] with the set of x where a + b * x >= 0 */
+static
+void icvClipLinear( double a, double b, double* xmin, double* xmax )
+{
+    if( b > 0 )
+    {
+        *xmin = MAX( *xmin, -a / b );
+    }
+    else if( b < 0 )
+    {
+        *xmax = MIN( *xmax, -a / b );
+    }
+    else if( a < 0 )
+    {
+        *xmax = *xmin - 1;
+    }
+}
+
+/* Bilinear interpolation at the fixed-point source point (sx, sy).
+   Inner expressions stay within 2^28 for 8-bit pixels */
+#define ICV_WARP_BILINEAR( i00, i10, i01, i11, fx, fy )                           \
+    ((((((i00) << ICV_WARP_BITS) + ((i10) - (i00)) * (fx)) << ICV_WARP_BITS) +    \
+      ((((i01) << ICV_WARP_BITS) + ((i11) - (i01)) * (fx)) -                      \
+       (((i00) << ICV_WARP_BITS) + ((i10) - (i00)) * (fx))) * (fy))               \
+     >> (2 * ICV_WARP_BITS))
+
+/* Interpolates source point (X/W, Y/W) checking bounds of each neighbor.
+   Neighbors out of the source are replaced by <fill_value> */
+static
+uchar icvWarpPixel( const uchar* src, int src_step, CvSize src_size,
+                    double X, double Y, double W, int fill_value )
+{
+    double src_x = X / W;
+    double src_y = Y / W;
+    int sx, sy, ix, iy, fx, fy;
+    int i00, i10, i01, i11;
+
+    /* also rejects infinities and NaNs */
+    if( !(src_x > -2 && src_x < src_size.width + 1 &&
+          src_y > -2 && src_y < src_size.height + 1) )
+    {
+        return (uchar) fill_value;
+    }
+
+    sx = cvRound( src_x * ICV_WARP_SCALE );
+    sy = cvRound( src_y * ICV_WARP_SCALE );
+    ix = sx >> ICV_WARP_BITS;
+    iy = sy >> ICV_WARP_BITS;
+    fx = sx & ICV_WARP_MASK;
+    fy = sy & ICV_WARP_MASK;
+
+#define ICV_WARP_SRC( px, py )                                                    \
+    ( ((unsigned) (px) < (unsigned) src_size.width &&                             \
+       (unsigned) (py) < (unsigned) src_size.height)                              \
+      ? src[(py) * src_step + (px)] : fill_value )
+
+    i00 = ICV_WARP_SRC( ix, iy );
+    i10 = ICV_WARP_SRC( ix + 1, iy );
+    i01 = ICV_WARP_SRC( ix, iy + 1 );
+    i11 = ICV_WARP_SRC( ix + 1, iy + 1 );
+
+#undef ICV_WARP_SRC
+
+    return (uchar) ICV_WARP_BILINEAR( i00, i10, i01, i11, fx, fy );
+}
+
+/* Warps pixels ix_min..ix_max of the destination row <y>.
+   Homogeneous source coordinates are stepped incrementally along the row.
+   The span of pixels whose 2x2 source neighborhood lies inside the source is
+   computed once for the row and it is interpolated without bound checks */
+static
+void icvWarpPerspectiveRow( const uchar* src, int src_step, CvSize src_size,
+                            double c[3][3], int y, int ix_min, int ix_max,
+                            uchar* dst, int fill_value )
+{
+    double X0 = c[0][1] * y + c[0][2];
+    double Y0 = c[1][1] * y + c[1][2];
+    double W0 = c[2][1] * y + c[2][2];
+    double X, Y, W;
+    double sign, lo, hi_x, hi_y;
+    double xa = ix_min;
+    double xb = ix_max;
+    int fast_min = ix_max + 1;
+    int fast_max = ix_max;
+    int x;
+
+    /* the denominator keeps its sign over the destination quadrangle */
+    sign = ( W0 + c[2][0] * 0.5 * (ix_min + ix_max) >= 0 ) ? 1.0 : -1.0;
+
+    /* safe source span with a margin for rounding to the fixed-point */
+    lo   = 1.0 / ICV_WARP_SCALE;
+    hi_x = src_size.width  - 1 - 2.0 / ICV_WARP_SCALE;
+    hi_y = src_size.height - 1 - 2.0 / ICV_WARP_SCALE;
+
+    /* sign * W > 0, lo <= X / W <= hi_x, lo <= Y / W <= hi_y */
+    icvClipLinear( sign * W0 - DBL_EPSILON, sign * c[2][0], &xa, &xb );
+    icvClipLinear( sign * (X0 - lo * W0), sign * (c[0][0] - lo * c[2][0]), &xa, &xb );
+    icvClipLinear( sign * (hi_x * W0 - X0), sign * (hi_x * c[2][0] - c[0][0]), &xa, &xb );
+    icvClipLinear( sign * (Y0 - lo * W0), sign * (c[1][0] - lo * c[2][0]), &xa, &xb );
+    icvClipLinear( sign * (hi_y * W0 - Y0), sign * (hi_y * c[2][0] - c[1][0]), &xa, &xb );
+    if( xa <= xb )
+    {
+        fast_min = cvCeil( xa );
+        fast_max = cvFloor( xb );
+    }
+    if( fast_min > fast_max )
+    {
+        fast_min = ix_max + 1;
+        fast_max = ix_max;
+    }
+
+    for( x = ix_min; x < fast_min; x++ )
+    {
+        dst[x] = icvWarpPixel( src, src_step, src_size, X0 + c[0][0] * x,
+            Y0 + c[1][0] * x, W0 + c[2][0] * x, fill_value );
+    }
+
+    X = X0 + c[0][0] * fast_min;
+    Y = Y0 + c[1][0] * fast_min;
+    W = W0 + c[2][0] * fast_min;
+    for( x = fast_min; x <= fast_max; x++ )
+    {
+        double r = ICV_WARP_SCALE / W;
+        int sx = cvRound( X * r );
+        int sy = cvRound( Y * r );
+        int fx = sx & ICV_WARP_MASK;
+        int fy = sy & ICV_WARP_MASK;
+        const uchar* s = src + (sy >> ICV_WARP_BITS) * src_step + (sx >> ICV_WARP_BITS);
+
+        dst[x] = (uchar) ICV_WARP_BILINEAR( s[0], s[1], s[src_step], s[src_step + 1],
+                                            fx, fy );
+        X += c[0][0];
+        Y += c[1][0];
+        W += c[2][0];
+    }
+
+    for( x = fast_max + 1; x <= ix_max; x++ )
+    {
+        dst[x] = icvWarpPixel( src, src_step, src_size, X0 + c[0][0] * x,
+            Y0 + c[1][0] * x, W0 + c[2][0] * x, fill_value );
+    }
+}
+
+#endif /* #ifndef __IPL_H__ */
+
 /* Warps source into destination by a perspective transform */
 void cvWarpPerspective( CvArr* src, CvArr* dst, double quad[4][2] )
 {
@@ -290,7 +452,7 @@ void cvWarpPerspective( CvArr* src, CvArr* dst, double quad[4][2] )
 
     for(;;)
     {
-        int x, y;
+        int y;
 
         y_max = MIN( q[next_left][1], q[next_right][1] );
 
@@ -306,52 +468,10 @@ void cvWarpPerspective( CvArr* src, CvArr* dst, double quad[4][2] )
             int ix_min = MAX( cvRound( x_min ), 0 );
             int ix_max = MIN( cvRound( x_max ), dst_size.width - 1 );
 
-            for( x = ix_min; x <= ix_max; ++x )
+            if( ix_min <= ix_max )
             {
-                /* calculate coordinates of the corresponding source array point */
-                double div = (c[2][0] * x + c[2][1] * y + c[2][2]);
-                double src_x = (c[0][0] * x + c[0][1] * y + c[0][2]) / div;
-                double src_y = (c[1][0] * x + c[1][1] * y + c[1][2]) / div;
-
-                int isrc_x = cvFloor( src_x );
-                int isrc_y = cvFloor( src_y );
-                double delta_x = src_x - isrc_x;
-                double delta_y = src_y - isrc_y;
-
-                uchar* s = src_data + isrc_y * src_step + isrc_x;
-
-                int i00, i10, i01, i11;
-                i00 = i10 = i01 = i11 = (int) fill_value;
-
-                double i = fill_value;
-
-                /* linear interpolation using 2x2 neighborhood */
-                if( isrc_x >= 0 && isrc_x <= src_size.width &&
-                    isrc_y >= 0 && isrc_y <= src_size.height )
-                {
-                    i00 = s[0];
-                }
-                if( isrc_x >= -1 && isrc_x < src_size.width &&
-                    isrc_y >= 0 && isrc_y <= src_size.height )
-                {
-                    i10 = s[1];
-                }
-                if( isrc_x >= 0 && isrc_x <= src_size.width &&
-                    isrc_y >= -1 && isrc_y < src_size.height )
-                {
-                    i01 = s[src_step];
-                }
-                if( isrc_x >= -1 && isrc_x < src_size.width &&
-                    isrc_y >= -1 && isrc_y < src_size.height )
-                {
-                    i11 = s[src_step+1];
-                }
-
-                double i0 = i00 + (i10 - i00)*delta_x;
-                double i1 = i01 + (i11 - i01)*delta_x;
-                i = i0 + (i1 - i0)*delta_y;
-
-                ((uchar*)(dst_data + y * dst_step))[x] = (uchar) i;
+                icvWarpPerspectiveRow( src_data, src_step, src_size, c, y, ix_min, ix_max,
+                                       dst_data + y * dst_step, fill_value );
             }
             x_min += k_left;
             x_max += k_right;
@@ -725,6 +845,161 @@ void icvWriteVecSample( FILE* file, CvArr* sample )
     }
 }
 
+void icvWriteVec2Header( FILE* file, int width, int height )
+{
+    CvVec2Header header;
+
+    /* count and index offset are written by icvEndVec2File */
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, CV_VEC2_MAGIC, sizeof( header.magic ) );
+    header.width = width;
+    header.height = height;
+    header.recsize = cvAlign( width * height, CV_VEC2_ALIGN );
+    fwrite( &header, sizeof( header ), 1, file );
+}
+
+void icvWriteVec2Sample( FILE* file, CvArr* sample )
+{
+    CvMat* mat, stub;
+    int r;
+    int padding;
+    uchar zeros[CV_VEC2_ALIGN];
+
+    mat = cvGetMat( sample, &stub );
+    assert( CV_MAT_TYPE( mat->type ) == CV_8UC1 );
+    for( r = 0; r < mat->rows; r++ )
+    {
+        fwrite( mat->data.ptr + r * mat->step, sizeof( uchar ), mat->cols, file );
+    }
+    padding = cvAlign( mat->rows * mat->cols, CV_VEC2_ALIGN ) - mat->rows * mat->cols;
+    if( padding > 0 )
+    {
+        memset( zeros, 0, sizeof( zeros ) );
+        fwrite( zeros, sizeof( uchar ), padding, file );
+    }
+}
+
+void icvEndVec2File( FILE* file, int count, int width, int height )
+{
+    CvVec2Header header;
+    int64 offset;
+    int i;
+
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, CV_VEC2_MAGIC, sizeof( header.magic ) );
+    header.count = count;
+    header.width = width;
+    header.height = height;
+    header.recsize = cvAlign( width * height, CV_VEC2_ALIGN );
+    header.indexofs = (int64) sizeof( header ) + (int64) count * header.recsize;
+
+    fseek( file, (long) header.indexofs, SEEK_SET );
+    for( i = 0; i < count; i++ )
+    {
+        offset = (int64) sizeof( header ) + (int64) i * header.recsize;
+        fwrite( &offset, sizeof( offset ), 1, file );
+    }
+    fseek( file, 0, SEEK_SET );
+    fwrite( &header, sizeof( header ), 1, file );
+    fseek( file, 0, SEEK_END );
+}
+
+static
+void icvUnmapFile( void* base, size_t size )
+{
+#ifdef _WIN32
+    UnmapViewOfFile( base );
+#else
+    munmap( base, size );
+#endif /* _WIN32 */
+}
+
+CvVecMap* icvOpenVecMap( const char* filename )
+{
+    CvVecMap* map = NULL;
+    CvVec2Header* header;
+    uchar* base = NULL;
+    size_t size = 0;
+    int valid;
+    int i;
+
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+
+    file = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                        FILE_ATTRIBUTE_NORMAL, NULL );
+    if( file == INVALID_HANDLE_VALUE ) return NULL;
+    size = (size_t) GetFileSize( file, NULL );
+    mapping = ( size >= sizeof( *header ) )
+        ? CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL ) : NULL;
+    CloseHandle( file );
+    if( mapping == NULL ) return NULL;
+    /* the view keeps the mapping object alive */
+    base = (uchar*) MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+    CloseHandle( mapping );
+    if( base == NULL ) return NULL;
+#else
+    int fd;
+    struct stat st;
+    void* ptr;
+
+    fd = open( filename, O_RDONLY );
+    if( fd < 0 ) return NULL;
+    if( fstat( fd, &st ) != 0 || (size_t) st.st_size < sizeof( *header ) )
+    {
+        close( fd );
+        return NULL;
+    }
+    size = (size_t) st.st_size;
+    ptr = mmap( NULL, size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( ptr == MAP_FAILED ) return NULL;
+    base = (uchar*) ptr;
+#endif /* _WIN32 */
+
+    header = (CvVec2Header*) base;
+    valid = ( memcmp( header->magic, CV_VEC2_MAGIC, sizeof( header->magic ) ) == 0 &&
+              header->count >= 0 && header->width > 0 && header->height > 0 &&
+              header->recsize >= header->width * header->height &&
+              header->indexofs >= (int64) sizeof( *header ) &&
+              header->indexofs % (int64) sizeof( int64 ) == 0 &&
+              header->indexofs + (int64) header->count * (int64) sizeof( int64 )
+                  <= (int64) size );
+    for( i = 0; valid && i < header->count; i++ )
+    {
+        int64 offset = ((int64*) (base + header->indexofs))[i];
+
+        valid = ( offset >= (int64) sizeof( *header ) &&
+                  offset + header->width * header->height <= (int64) size );
+    }
+    if( !valid )
+    {
+        icvUnmapFile( base, size );
+
+        return NULL;
+    }
+
+    map = (CvVecMap*) cvAlloc( sizeof( *map ) );
+    map->count  = header->count;
+    map->width  = header->width;
+    map->height = header->height;
+    map->base   = base;
+    map->size   = size;
+    map->index  = (int64*) (base + header->indexofs);
+
+    return map;
+}
+
+void icvReleaseVecMap( CvVecMap** map )
+{
+    if( map && *map )
+    {
+        icvUnmapFile( (*map)->base, (*map)->size );
+        cvFree( map );
+    }
+}
+
 
 int cvCreateTrainingSamplesFromInfo( const char* infoname, const char* vecfilename,
                                      int num,
@@ -875,10 +1150,38 @@ void cvShowVecSamples( const char* filename, int winwidth, int winheight,
                        double scale )
 {
     CvVecFile file;
+    CvVecMap* map;
     short tmp; 
     int i;
     CvMat* sample;
     
+    /* version 2 file knows its sample size, samples are shown directly from the map */
+    map = icvOpenVecMap( filename );
+    if( map != NULL )
+    {
+        if( scale > 0 )
+        {
+            CvMat mapped;
+            CvMat* scaled_sample = 0;
+
+            scaled_sample = cvCreateMat( MAX( 1, cvCeil( scale * map->height ) ),
+                                         MAX( 1, cvCeil( scale * map->width ) ), CV_8UC1 );
+            cvNamedWindow( "Sample", CV_WINDOW_AUTOSIZE );
+            for( i = 0; i < map->count; i++ )
+            {
+                mapped = cvMat( map->height, map->width, CV_8UC1,
+                                icvGetVecMapSample( map, i ) );
+                cvResize( &mapped, scaled_sample, CV_INTER_LINEAR );
+                cvShowImage( "Sample", scaled_sample );
+                if( cvWaitKey( 0 ) == 27 ) break;
+            }
+            cvReleaseMat( &scaled_sample );
+        }
+        icvReleaseVecMap( &map );
+
+        return;
+    }
+
     tmp = 0;
     file.input = fopen( filename, "rb" );
 
@@ -952,4 +1255,125 @@ void cvShowVecSamples( const char* filename, int winwidth, int winheight,
 }
 
 
+int cvConvertVecToVec2( const char* srcname, const char* dstname,
+                        int winwidth, int winheight )
+{
+    CvVecFile file;
+    FILE* output;
+    CvMat* sample;
+    short tmp;
+    int total;
+
+    assert( srcname != NULL );
+    assert( dstname != NULL );
+
+    total = 0;
+    file.input = fopen( srcname, "rb" );
+    if( file.input == NULL )
+    {
+
+#if CV_VERBOSE
+        fprintf( stderr, "Unable to open file: %s\n", srcname );
+#endif /* CV_VERBOSE */
+
+        return total;
+    }
+
+    tmp = 0;
+    fread( &file.count, sizeof( file.count ), 1, file.input );
+    fread( &file.vecsize, sizeof( file.vecsize ), 1, file.input );
+    fread( &tmp, sizeof( tmp ), 1, file.input );
+    fread( &tmp, sizeof( tmp ), 1, file.input );
+    if( feof( file.input ) || file.vecsize != winwidth * winheight )
+    {
+        fprintf( stderr, "Error: specified sample width=%d and height=%d "
+            "does not correspond to .vec file vector size=%d.\n",
+            winwidth, winheight, file.vecsize );
+        fclose( file.input );
+
+        return total;
+    }
+
+    output = fopen( dstname, "wb" );
+    if( output == NULL )
+    {
+
+#if CV_VERBOSE
+        fprintf( stderr, "Unable to open file: %s\n", dstname );
+#endif /* CV_VERBOSE */
+
+        fclose( file.input );
+
+        return total;
+    }
+
+    file.last = 0;
+    file.vector = (short*) cvAlloc( sizeof( *file.vector ) * file.vecsize );
+    sample = cvCreateMat( winheight, winwidth, CV_8UC1 );
+
+    icvWriteVec2Header( output, winwidth, winheight );
+    while( icvGetHaarTraininDataFromVecCallback( sample, &file ) )
+    {
+        icvWriteVec2Sample( output, sample );
+        total++;
+    }
+    icvEndVec2File( output, total, winwidth, winheight );
+
+    cvReleaseMat( &sample );
+    cvFree( &file.vector );
+    fclose( output );
+    fclose( file.input );
+
+    return total;
+}
+
+
+int cvConvertVec2ToVec( const char* srcname, const char* dstname )
+{
+    CvVecMap* map;
+    FILE* output;
+    CvMat mapped;
+    int i;
+
+    assert( srcname != NULL );
+    assert( dstname != NULL );
+
+    map = icvOpenVecMap( srcname );
+    if( map == NULL )
+    {
+
+#if CV_VERBOSE
+        fprintf( stderr, "Unable to map version 2 .vec file: %s\n", srcname );
+#endif /* CV_VERBOSE */
+
+        return 0;
+    }
+
+    output = fopen( dstname, "wb" );
+    if( output == NULL )
+    {
+
+#if CV_VERBOSE
+        fprintf( stderr, "Unable to open file: %s\n", dstname );
+#endif /* CV_VERBOSE */
+
+        icvReleaseVecMap( &map );
+
+        return 0;
+    }
+
+    icvWriteVecHeader( output, map->count, map->width, map->height );
+    for( i = 0; i < map->count; i++ )
+    {
+        mapped = cvMat( map->height, map->width, CV_8UC1, icvGetVecMapSample( map, i ) );
+        icvWriteVecSample( output, &mapped );
+    }
+    fclose( output );
+    i = map->count;
+    icvReleaseVecMap( &map );
+
+    return i;
+}
+
+
 /* End of file. */
@@ -0,0 +1,169 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                        Intel License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000, Intel Corporation, all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   * The name of Intel Corporation may not be used to endorse or promote products
+//     derived from this software without specific prior written permission.
+//
+// This software is provided by the copyright holders and contributors "as is" and
+// any express or implied warranties, including, but not limited to, the implied
+// warranties of merchantability and fitness for a particular purpose are disclaimed.
+// In no event shall the Intel Corporation or contributors be liable for any direct,
+// indirect, incidental, special, exemplary, or consequential damages
+// (including, but not limited to, procurement of substitute goods or services;
+// loss of use, data, or profits; or business interruption) however caused
+// and on any theory of liability, whether in contract, strict liability,
+// or tort (including negligence or otherwise) arising in any way out of
+// the use of this software, even if advised of the possibility of such damage.
+//
+//M*/
+
+/*
+ * performance.cpp
+ *
+ * Measure performance of classifier
+ */
+
+#include <cvhaartraining.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <cv.h>
+
+int main( int argc, char* argv[] )
+{
+    int i = 0;
+    char* classifierdir = NULL;
+    char* infoname = NULL;
+    int width = 24;
+    int height = 24;
+    double scale_factor = 1.2;
+    int min_neighbors = 3;
+    double maxSizeDiff = 1.5;
+    double maxPosDiff = 0.3;
+    int rocsize = 40;
+    double rocstep = 0.1;
+    int nos = 0;
+    CvCascadeEvalPoint* roc = NULL;
+
+    if( argc == 1 )
+    {
+        printf( "Usage: %s\n  -data <classifier_directory_name>\n"
+                "  -info <collection_file_name>\n"
+                "  [-maxSizeDiff <max_size_difference = %f>]\n"
+                "  [-maxPosDiff <max_position_difference = %f>]\n"
+                "  [-sf <scale_factor = %f>]\n"
+                "  [-mn <min_neighbors = %d>]\n"
+                "  [-w <sample_width = %d>]\n"
+                "  [-h <sample_height = %d>]\n"
+                "  [-rs <roc_size = %d>]\n"
+                "  [-rstep <roc_threshold_step = %f>]\n",
+                argv[0], maxSizeDiff, maxPosDiff, scale_factor, min_neighbors,
+                width, height, rocsize, rocstep );
+
+        return 0;
+    }
+
+    for( i = 1; i < argc; i++ )
+    {
+        if( !strcmp( argv[i], "-data" ) )
+        {
+            classifierdir = argv[++i];
+        }
+        else if( !strcmp( argv[i], "-info" ) )
+        {
+            infoname = argv[++i];
+        }
+        else if( !strcmp( argv[i], "-maxSizeDiff" ) )
+        {
+            maxSizeDiff = (double) atof( argv[++i] );
+        }
+        else if( !strcmp( argv[i], "-maxPosDiff" ) )
+        {
+            maxPosDiff = (double) atof( argv[++i] );
+        }
+        else if( !strcmp( argv[i], "-sf" ) )
+        {
+            scale_factor = atof( argv[++i] );
+        }
+        else if( !strcmp( argv[i], "-mn" ) )
+        {
+            min_neighbors = atoi( argv[++i] );
+        }
+        else if( !strcmp( argv[i], "-w" ) )
+        {
+            width = atoi( argv[++i] );
+        }
+        else if( !strcmp( argv[i], "-h" ) )
+        {
+            height = atoi( argv[++i] );
+        }
+        else if( !strcmp( argv[i], "-rs" ) )
+        {
+            rocsize = atoi( argv[++i] );
+        }
+        else if( !strcmp( argv[i], "-rstep" ) )
+        {
+            rocstep = atof( argv[++i] );
+        }
+    }
+
+    if( classifierdir == NULL || infoname == NULL || rocsize <= 0 )
+    {
+        fprintf( stderr, "Invalid arguments\n" );
+
+        return 1;
+    }
+
+    /* last stage threshold shifts from rocsize/2 steps up to the rest steps down */
+    roc = (CvCascadeEvalPoint*) cvAlloc( sizeof( *roc ) * rocsize );
+    for( i = 0; i < rocsize; i++ )
+    {
+        roc[i].threshold = (float) ((rocsize / 2 - i) * rocstep);
+    }
+
+    nos = cvEvaluateCascadeClassifier( classifierdir, infoname, width, height,
+                                       scale_factor, min_neighbors,
+                                       maxSizeDiff, maxPosDiff, rocsize, roc );
+
+    printf( "Processed images: %d\n", nos );
+    printf( "+===========+=========+=========+=========+=========+\n" );
+    printf( "| Threshold |   Hits  |  Missed |  False  | Hitrate |\n" );
+    printf( "+===========+=========+=========+=========+=========+\n" );
+    for( i = 0; i < rocsize; i++ )
+    {
+        int total = roc[i].hits + roc[i].misses;
+
+        printf( "|%10.4f |%8d |%8d |%8d |%8.4f |\n", roc[i].threshold,
+                roc[i].hits, roc[i].misses, roc[i].falsealarms,
+                (total > 0) ? ((double) roc[i].hits / total) : 0.0 );
+    }
+    printf( "+-----------+---------+---------+---------+---------+\n" );
+
+    cvFree( &roc );
+
+    return 0;
+}
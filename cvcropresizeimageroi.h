@@ -0,0 +1,186 @@
+/** @file */
+/* The MIT License
+*
+* Copyright (c) 2008, Naotoshi Seo <sonots(at)sonots.com>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#ifndef CV_CROPRESIZEIMAGEROI_INCLUDED
+#define CV_CROPRESIZEIMAGEROI_INCLUDED
+
+#include "cv.h"
+#include "cvaux.h"
+#include "cxcore.h"
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include "cvrect32f.h"
+
+/** Convert BGR into gray */
+#define CV_CROPRESIZE_GRAY      1
+/** Store pixels column by column (transposed), as matlab's reshape does */
+#define CV_CROPRESIZE_TRANSPOSE 2
+
+/** Maximum number of samples averaged per output pixel along an axis */
+#define CV_CROPRESIZE_MAX_TAPS  8
+
+//CVAPI(void)
+//cvCropResizeImageROI( const IplImage* img, CvArr* dst, CvRect32f rect32f,
+//                      CvSize size = cvSize(0,0), int flags = 0 );
+
+/**
+ * Crop image with rotated rectangle and resize it to the given size at once
+ *
+ * Replaces cvCropImageROI into a rect32f.width x rect32f.height image
+ * followed by cvResize( CV_INTER_AREA ) (and cvCvtColor, cvT). Each
+ * output pixel is computed directly as the average of bilinearly
+ * interpolated samples over its area in the rotated rectangle, so that
+ * no intermediate image is created. Samples outside of the image are 0
+ * as cvCropImageROI.
+ *
+ * The results agree up to rounding when the rectangle is integral and
+ * its size is a multiple of the output size. Otherwise they differ:
+ * cvCropImageROI rounds the rectangle (cvRectFromRect32f) and samples
+ * from the integer x, y, whereas this function samples from the
+ * unrounded rect32f.x, rect32f.y over the unrounded width and height,
+ * and averages at most CV_CROPRESIZE_MAX_TAPS samples per axis instead
+ * of the exact pixel areas.
+ *
+ * @param img          The target image. IPL_DEPTH_8U or IPL_DEPTH_32F
+ * @param dst          The cropped and resized image, 8U, 32F or 64F.
+ *                     size.height x size.width (size.width x size.height
+ *                     with CV_CROPRESIZE_TRANSPOSE) matrix, or
+ *                     any matrix or vector (e.g., a column of a matrix)
+ *                     with size.width * size.height elements which are
+ *                     filled in row-major order.
+ *                     Single channel with CV_CROPRESIZE_GRAY,
+ *                     img->nChannels channels otherwise.
+ * @param rect32f      The rectangle region (x,y,width,height) to crop and
+ *                     the rotation angle in degree where the rotation center is (x,y)
+ * @param size         The output size. The size of dst if cvSize(0,0)
+ * @param flags        CV_CROPRESIZE_GRAY to convert BGR into gray
+ *                     CV_CROPRESIZE_TRANSPOSE to store column by column
+ * @return CVAPI(void)
+ * @see cvCropImageROI
+ */
+CVAPI(void)
+cvCropResizeImageROI( const IplImage* img, CvArr* dst, CvRect32f rect32f,
+                      CvSize size CV_DEFAULT(cvSize(0,0)),
+                      int flags CV_DEFAULT(0) )
+{
+    CvMat dststub, *dstmat = (CvMat*)dst;
+    int coi = 0;
+    int cn = img->nChannels, ocn, depth, ddepth, esize;
+    int u, v, i, j, ch, k, kx, ky, x0, y0, x1, y1;
+    double c, s, sx, sy, xp, yp, fx, fy, val;
+    double acc[4], p00, p01, p10, p11;
+    const uchar *row0, *row1;
+    uchar* d;
+    CV_FUNCNAME( "cvCropResizeImageROI" );
+    __BEGIN__;
+    if( !CV_IS_MAT(dstmat) )
+    {
+        CV_CALL( dstmat = cvGetMat( dstmat, &dststub, &coi ) );
+        if (coi != 0) CV_ERROR_FROM_CODE(CV_BadCOI);
+    }
+    if( size.width == 0 || size.height == 0 )
+    {
+        size = ( flags & CV_CROPRESIZE_TRANSPOSE ) ?
+            cvSize( dstmat->rows, dstmat->cols ) : cvSize( dstmat->cols, dstmat->rows );
+    }
+    depth  = img->depth;
+    ddepth = CV_MAT_DEPTH( dstmat->type );
+    esize  = CV_ELEM_SIZE( dstmat->type );
+    ocn    = ( flags & CV_CROPRESIZE_GRAY ) ? 1 : cn;
+    CV_ASSERT( depth == IPL_DEPTH_8U || depth == IPL_DEPTH_32F );
+    CV_ASSERT( ddepth == CV_8U || ddepth == CV_32F || ddepth == CV_64F );
+    CV_ASSERT( dstmat->rows * dstmat->cols == size.width * size.height );
+    CV_ASSERT( CV_MAT_CN( dstmat->type ) == ocn );
+    CV_ASSERT( !( flags & CV_CROPRESIZE_GRAY ) || cn == 1 || cn == 3 );
+    CV_ASSERT( rect32f.width > 0 && rect32f.height > 0 );
+
+    c  = cos( -M_PI / 180 * rect32f.angle );
+    s  = sin( -M_PI / 180 * rect32f.angle );
+    sx = rect32f.width / size.width;   // output pixel size in crop coordinates
+    sy = rect32f.height / size.height;
+    kx = MIN( MAX( cvCeil( sx ), 1 ), CV_CROPRESIZE_MAX_TAPS );
+    ky = MIN( MAX( cvCeil( sy ), 1 ), CV_CROPRESIZE_MAX_TAPS );
+
+    for( v = 0; v < size.height; v++ )
+    {
+        for( u = 0; u < size.width; u++ )
+        {
+            acc[0] = acc[1] = acc[2] = acc[3] = 0;
+            for( j = 0; j < ky; j++ )
+            {
+                double y = ( v + ( j + 0.5 ) / ky ) * sy - 0.5;
+                for( i = 0; i < kx; i++ )
+                {
+                    double x = ( u + ( i + 0.5 ) / kx ) * sx - 0.5;
+                    xp = c * x - s * y + rect32f.x;
+                    yp = s * x + c * y + rect32f.y;
+                    if( xp <= -0.5 || xp >= img->width - 0.5 ||
+                        yp <= -0.5 || yp >= img->height - 0.5 ) continue;
+                    x0 = cvFloor( xp ); fx = xp - x0;
+                    y0 = cvFloor( yp ); fy = yp - y0;
+                    x1 = MIN( x0 + 1, img->width - 1 ); x0 = MAX( x0, 0 );
+                    y1 = MIN( y0 + 1, img->height - 1 ); y0 = MAX( y0, 0 );
+                    row0 = (const uchar*)img->imageData + y0 * img->widthStep;
+                    row1 = (const uchar*)img->imageData + y1 * img->widthStep;
+                    for( ch = 0; ch < cn; ch++ )
+                    {
+                        if( depth == IPL_DEPTH_8U )
+                        {
+                            p00 = row0[x0 * cn + ch]; p01 = row0[x1 * cn + ch];
+                            p10 = row1[x0 * cn + ch]; p11 = row1[x1 * cn + ch];
+                        }
+                        else
+                        {
+                            p00 = ((const float*)row0)[x0 * cn + ch];
+                            p01 = ((const float*)row0)[x1 * cn + ch];
+                            p10 = ((const float*)row1)[x0 * cn + ch];
+                            p11 = ((const float*)row1)[x1 * cn + ch];
+                        }
+                        acc[ch] += ( 1 - fy ) * ( p00 + fx * ( p01 - p00 ) ) +
+                                   fy * ( p10 + fx * ( p11 - p10 ) );
+                    }
+                }
+            }
+            if( ( flags & CV_CROPRESIZE_GRAY ) && cn == 3 )
+                acc[0] = 0.114 * acc[0] + 0.587 * acc[1] + 0.299 * acc[2]; // BGR
+
+            k = ( flags & CV_CROPRESIZE_TRANSPOSE ) ? u * size.height + v : v * size.width + u;
+            d = dstmat->data.ptr + ( k / dstmat->cols ) * dstmat->step +
+                ( k % dstmat->cols ) * esize;
+            for( ch = 0; ch < ocn; ch++ )
+            {
+                val = acc[ch] / ( kx * ky );
+                if( ddepth == CV_8U )
+                    d[ch] = CV_CAST_8U( cvRound( val ) );
+                else if( ddepth == CV_32F )
+                    ((float*)d)[ch] = (float) val;
+                else
+                    ((double*)d)[ch] = val;
+            }
+        }
+    }
+    __END__;
+}
+
+#endif
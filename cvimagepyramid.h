@@ -0,0 +1,230 @@
+/** @file */
+/* The MIT License
+*
+* Copyright (c) 2008, Naotoshi Seo <sonots(at)sonots.com>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#ifndef CV_IMAGEPYRAMID_INCLUDED
+#define CV_IMAGEPYRAMID_INCLUDED
+
+#include "cv.h"
+#include "cvaux.h"
+#include "cxcore.h"
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include "cvrect32f.h"
+#include "cvcropresizeimageroi.h"
+
+/**
+ * Gaussian image pyramid
+ *
+ * images[l] is images[l-1] smoothed and downsampled by cvPyrDown, so that
+ * a pixel (x,y) of images[l] lies at (x * 2^l, y * 2^l) of images[0].
+ */
+typedef struct CvImagePyramid {
+    int levels;        /**< number of levels */
+    IplImage** images; /**< levels images */
+    int shared;        /**< images[0] is a header on the data of the
+                            original image (not converted) */
+} CvImagePyramid;
+
+//CVAPI(CvImagePyramid*)
+//cvCreateImagePyramid( const IplImage* img, int levels = 0, int flags = 0 );
+//CVAPI(void)
+//cvReleaseImagePyramid( CvImagePyramid** pyramid );
+//CVAPI(void)
+//cvCropResizeImagePyramidROI( const CvImagePyramid* pyramid, CvArr* dst,
+//                             CvRect32f rect32f, CvSize size = cvSize(0,0),
+//                             int flags = 0 );
+
+/**
+ * Create a Gaussian image pyramid
+ *
+ * @param img          The original image, IPL_DEPTH_8U or IPL_DEPTH_32F.
+ *                     The data is shared (not copied) by the level 0
+ *                     unless converted, so keep it while using the pyramid.
+ * @param levels       The number of levels including the original.
+ *                     0 to continue until the width or height gets 1.
+ * @param flags        CV_CROPRESIZE_GRAY to convert BGR into gray once
+ *                     here instead of for each crop
+ * @return CVAPI(CvImagePyramid*)
+ * @see cvReleaseImagePyramid
+ */
+CVAPI(CvImagePyramid*)
+cvCreateImagePyramid( const IplImage* img, int levels CV_DEFAULT(0),
+                      int flags CV_DEFAULT(0) )
+{
+    CvImagePyramid* pyramid = NULL;
+    CvSize size;
+    int l;
+    CV_FUNCNAME( "cvCreateImagePyramid" );
+    __BEGIN__;
+    CV_ASSERT( img->depth == IPL_DEPTH_8U || img->depth == IPL_DEPTH_32F );
+    CV_ASSERT( !( flags & CV_CROPRESIZE_GRAY ) || img->nChannels == 1 || img->nChannels == 3 );
+    if( levels <= 0 )
+    {
+        for( levels = 1, size = cvGetSize( img );
+             size.width > 1 && size.height > 1; levels++ )
+        {
+            size = cvSize( ( size.width + 1 ) / 2, ( size.height + 1 ) / 2 );
+        }
+    }
+
+    CV_CALL( pyramid = (CvImagePyramid*)cvAlloc( sizeof( CvImagePyramid ) ) );
+    pyramid->levels = levels;
+    pyramid->shared = 0;
+    CV_CALL( pyramid->images = (IplImage**)cvAlloc( levels * sizeof( IplImage* ) ) );
+    memset( pyramid->images, 0, levels * sizeof( IplImage* ) );
+
+    size = cvGetSize( img );
+    if( ( flags & CV_CROPRESIZE_GRAY ) && img->nChannels == 3 )
+    {
+        CV_CALL( pyramid->images[0] = cvCreateImage( size, img->depth, 1 ) );
+        cvCvtColor( img, pyramid->images[0], CV_BGR2GRAY );
+    }
+    else
+    {
+        // borrow the pixels. cvSetData would set imageDataOrigin which
+        // cvReleaseImage frees
+        CV_CALL( pyramid->images[0] = cvCreateImageHeader( size, img->depth, img->nChannels ) );
+        pyramid->images[0]->imageData = img->imageData;
+        pyramid->images[0]->widthStep = img->widthStep;
+        pyramid->images[0]->imageSize = img->imageSize;
+        pyramid->images[0]->origin    = img->origin;
+        pyramid->shared = 1;
+    }
+    for( l = 1; l < levels; l++ )
+    {
+        size = cvSize( ( size.width + 1 ) / 2, ( size.height + 1 ) / 2 );
+        CV_CALL( pyramid->images[l] = cvCreateImage( size, img->depth,
+                                                     pyramid->images[0]->nChannels ) );
+        cvPyrDown( pyramid->images[l-1], pyramid->images[l], CV_GAUSSIAN_5x5 );
+    }
+    __END__;
+    return pyramid;
+}
+
+/**
+ * Release a Gaussian image pyramid
+ *
+ * @param pyramid
+ * @return CVAPI(void)
+ * @see cvCreateImagePyramid
+ */
+CVAPI(void)
+cvReleaseImagePyramid( CvImagePyramid** pyramid )
+{
+    int l;
+    if( *pyramid == NULL ) return;
+    for( l = 0; l < (*pyramid)->levels; l++ )
+    {
+        if( (*pyramid)->images[l] == NULL ) continue;
+        if( l == 0 && (*pyramid)->shared )
+            cvReleaseImageHeader( &(*pyramid)->images[l] );
+        else
+            cvReleaseImage( &(*pyramid)->images[l] );
+    }
+    cvFree( &(*pyramid)->images );
+    cvFree( pyramid );
+}
+
+/**
+ * The pyramid level cvCropResizeImagePyramidROI crops a rectangle from
+ *
+ * The level whose scale is the closest in log scale to the ratio of the
+ * rectangle width to the output width.
+ *
+ * @param levels       The number of levels of the pyramid
+ * @param rect32f      The rectangle region in the coordinates of the level 0
+ * @param size         The output size
+ * @return int         The level
+ */
+CV_INLINE int
+icvImagePyramidLevel( int levels, CvRect32f rect32f, CvSize size )
+{
+    int level = cvRound( log( rect32f.width / size.width ) / log( 2.0 ) );
+    return MIN( MAX( level, 0 ), levels - 1 );
+}
+
+/**
+ * Crop image with rotated rectangle and resize it to the given size at once
+ * from the pyramid level whose scale is the closest to the ratio of the
+ * rectangle to the output size
+ *
+ * Compared with cvCropResizeImageROI on the original image, the number
+ * of pixels read per output pixel stays constant (at most 2x2 bilinear
+ * samples) however large the rectangle is, and high frequencies are
+ * removed by the Gaussian filter of the pyramid before downsampling.
+ *
+ * @param pyramid      The image pyramid
+ * @param dst          The cropped and resized image. See cvCropResizeImageROI
+ * @param rect32f      The rectangle region (x,y,width,height) to crop and
+ *                     the rotation angle in degree where the rotation center
+ *                     is (x,y), in the coordinates of the level 0
+ * @param size         The output size. The size of dst if cvSize(0,0)
+ * @param flags        CV_CROPRESIZE_GRAY to convert BGR into gray
+ *                     CV_CROPRESIZE_TRANSPOSE to store column by column
+ * @return CVAPI(void)
+ * @see cvCropResizeImageROI
+ */
+CVAPI(void)
+cvCropResizeImagePyramidROI( const CvImagePyramid* pyramid, CvArr* dst,
+                             CvRect32f rect32f,
+                             CvSize size CV_DEFAULT(cvSize(0,0)),
+                             int flags CV_DEFAULT(0) )
+{
+    CvMat dststub, *dstmat = (CvMat*)dst;
+    int coi = 0, level;
+    double scale, c, s, d;
+    CV_FUNCNAME( "cvCropResizeImagePyramidROI" );
+    __BEGIN__;
+    if( !CV_IS_MAT(dstmat) )
+    {
+        CV_CALL( dstmat = cvGetMat( dstmat, &dststub, &coi ) );
+        if (coi != 0) CV_ERROR_FROM_CODE(CV_BadCOI);
+    }
+    if( size.width == 0 || size.height == 0 )
+    {
+        size = ( flags & CV_CROPRESIZE_TRANSPOSE ) ?
+            cvSize( dstmat->rows, dstmat->cols ) : cvSize( dstmat->cols, dstmat->rows );
+    }
+    CV_ASSERT( rect32f.width > 0 && rect32f.height > 0 );
+
+    level = icvImagePyramidLevel( pyramid->levels, rect32f, size );
+    if( level > 0 )
+    {
+        // keep the pixel centers of the crop at the same positions;
+        // cvCropResizeImageROI samples at (i + 0.5) * scale - 0.5
+        scale = 1 << level;
+        d = 0.5 - 0.5 / scale;
+        c = cos( -M_PI / 180 * rect32f.angle );
+        s = sin( -M_PI / 180 * rect32f.angle );
+        rect32f.x      = rect32f.x / scale + d * ( c - s );
+        rect32f.y      = rect32f.y / scale + d * ( s + c );
+        rect32f.width  = rect32f.width / scale;
+        rect32f.height = rect32f.height / scale;
+    }
+    CV_CALL( cvCropResizeImageROI( pyramid->images[level], dstmat, rect32f,
+                                   size, flags ) );
+    __END__;
+}
+
+#endif
@@ -39,12 +39,14 @@
  * Useful to avoid loss of precision caused by taking exp
  *
  * @param  arr       array having log values. 32F or 64F
+ * @param  workspace array of the same size and type with arr used as 
+ *                   a temporary. Allocated internally if NULL.
  * @return CvScalar  log sum for each channel
  */
-CVAPI(CvScalar) cvLogSum( const CvArr *arr )
+CVAPI(CvScalar) cvLogSum( const CvArr *arr, CvArr *workspace CV_DEFAULT(NULL) )
 {
     IplImage* img = (IplImage*)arr, imgstub;
-    IplImage *tmp, *tmp2;
+    IplImage *tmp = NULL, tmpstub;
     int ch;
     CvScalar sumval;
     CvScalar minval, maxval;
@@ -55,8 +57,16 @@ CVAPI(CvScalar) cvLogSum( const CvArr *arr )
     {
         CV_CALL( img = cvGetImage( img, &imgstub ) );
     }
-    tmp = cvCreateImage( cvGetSize(img), img->depth, img->nChannels );
-    tmp2 = cvCreateImage( cvGetSize(img), img->depth, img->nChannels );
+    if( workspace != NULL )
+    {
+        CV_CALL( tmp = cvGetImage( workspace, &tmpstub ) );
+        CV_ASSERT( tmp->width == img->width && tmp->height == img->height &&
+                   tmp->depth == img->depth && tmp->nChannels == img->nChannels );
+    }
+    else
+    {
+        tmp = cvCreateImage( cvGetSize(img), img->depth, img->nChannels );
+    }
 
     // to avoid loss of precision caused by taking exp as much as possible
     // if this trick is not required, cvExp -> cvSum are enough
@@ -68,14 +78,14 @@ CVAPI(CvScalar) cvLogSum( const CvArr *arr )
     cvSetImageCOI( img, 0 );
     cvSubS( img, maxval, tmp );
 
-    cvExp( tmp, tmp2 );
-    sumval = cvSum( tmp2 );
+    cvExp( tmp, tmp );
+    sumval = cvSum( tmp );
     for( ch = 0; ch < img->nChannels; ch++ )
     {
         sumval.val[ch] = log( sumval.val[ch] ) + maxval.val[ch];
     }
-    cvReleaseImage( &tmp );
-    cvReleaseImage( &tmp2 );
+    if( workspace == NULL )
+        cvReleaseImage( &tmp );
     __END__;
     return sumval;
 }
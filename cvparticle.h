@@ -14,7 +14,7 @@
  *   cvParticleTransition
  *   Measurement
  *   cvParticleNormalize
- *   cvParticleResample
+ *   cvParticleResample (or cvParticleResampleAdaptive)
  * }
  * cvReleaseParticle
  */
@@ -55,6 +55,42 @@
 #include "cvrandgauss.h"
 
 /******************************* Structures **********************************/
+/**
+ * Resampling methods
+ *
+ * CV_PARTICLE_RESAMPLE_SYSTEMATIC - one uniform random offset, N evenly spaced 
+ *                                   points over the cumulative weights
+ * CV_PARTICLE_RESAMPLE_STRATIFIED - one uniform random point in each of N strata
+ * CV_PARTICLE_RESAMPLE_RESIDUAL   - floor(N * weight) deterministic copies, 
+ *                                   the rest is sampled systematically from 
+ *                                   the residual weights
+ * CV_PARTICLE_RESAMPLE_KLD        - KLD-sampling. The number of particles is 
+ *                                   adapted to the number of state space bins 
+ *                                   occupied by the drawn particles. 
+ *                                   See cvParticleSetKLD.
+ */
+enum {
+    CV_PARTICLE_RESAMPLE_SYSTEMATIC = 0,
+    CV_PARTICLE_RESAMPLE_STRATIFIED = 1,
+    CV_PARTICLE_RESAMPLE_RESIDUAL   = 2,
+    CV_PARTICLE_RESAMPLE_KLD        = 3
+};
+
+/**
+ * Structures of dynamics model detected by cvParticleSetDynamics
+ *
+ * CV_PARTICLE_DYNAMICS_DENSE    - general, matrix multiplication
+ * CV_PARTICLE_DYNAMICS_IDENTITY - random walk, new state = state + noise
+ * CV_PARTICLE_DYNAMICS_DIAGONAL - each state is scaled
+ * CV_PARTICLE_DYNAMICS_SPARSE   - at most half of elements are nonzero
+ */
+enum {
+    CV_PARTICLE_DYNAMICS_DENSE    = 0,
+    CV_PARTICLE_DYNAMICS_IDENTITY = 1,
+    CV_PARTICLE_DYNAMICS_DIAGONAL = 2,
+    CV_PARTICLE_DYNAMICS_SPARSE   = 3
+};
+
 /**
  * Particle Filter structure
  */
@@ -62,10 +98,18 @@ typedef struct CvParticle {
     // config
     int num_states;    /**< Number of tracking states, e.g.,
                           4 if x, y, width, height */
-    int num_particles; /**< Number of particles */
+    int num_particles; /**< Number of (active) particles. All the per particle 
+                          matrices below have num_particles columns. 
+                          Varies up to max_particles with KLD-sampling. */
+    int max_particles; /**< Capacity, number of particles allocated */
     bool logweight;    /**< log weights are stored in "weights". */
     // transition
-    CvMat* dynamics;   /**< num_states x num_states. Dynamics model. */
+    CvMat* dynamics;   /**< num_states x num_states. Dynamics model. 
+                          Set by cvParticleSetDynamics. */
+    int dynamics_type; /**< CV_PARTICLE_DYNAMICS_*. Structure of dynamics */
+    CvMat* dynamics_index; /**< num_states x (num_states + 1). Number of 
+                          nonzero elements and their column ids of each 
+                          row of dynamics */
     CvRNG  rng;        /**< Random seed */
     CvMat* std;        /**< num_states x 1. Standard deviation for gaussian noise
                           Set standard deviation == 0 for no noise */
@@ -82,6 +126,32 @@ typedef struct CvParticle {
     CvMat* weights;    /**< 1 x num_particles. The weights of 
                           each particle respect to the particle id in "particles". 
                           "weights" are used to approximated the posterior pdf. */
+    // resampling
+    int resample;      /**< Resampling method, CV_PARTICLE_RESAMPLE_* */
+    CvMat* new_particles; /**< num_states x num_particles. Resampling buffer. 
+                          Swapped with "particles" by cvParticleResample. */
+    CvMat* cumweights; /**< 1 x num_particles. Cumulative weights (workspace) */
+    CvMat* indices;    /**< 1 x num_particles. Selected particle ids (workspace) */
+    CvMat* hashtable;  /**< 1 x (power of 2 >= 2 * max_particles), CV_32SC1. 
+                          Hash table of cvParticleFindDuplicates (workspace) */
+    double resample_threshold; /**< cvParticleResampleAdaptive resamples when 
+                          the effective sample size falls below 
+                          resample_threshold * num_particles */
+    double ess;        /**< Effective sample size computed by 
+                          cvParticleNormalize or cvParticleResampleAdaptive */
+    // KLD-sampling
+    CvMat* kld_bins;   /**< num_states x 1. Number of bins between lowerbound 
+                          and upperbound of each state. 0 to ignore the state */
+    double kld_epsilon; /**< Bound of the KL distance */
+    double kld_z;      /**< Upper 1 - delta quantile of the standard normal */
+    int kld_min_particles; /**< Minimum number of particles */
+    uint64* kld_table; /**< Hash table of the occupied bins (workspace) */
+    int kld_table_size; /**< Size of kld_table, power of 2 */
+    // workspaces
+    CvMat* transits;   /**< num_states x num_particles. Transited states (workspace) */
+    CvMat* noises;     /**< num_states x num_particles. Noises (workspace) */
+    CvMat* tmpweights; /**< 1 x num_particles. Exponentiated weights, or 
+                          log sum temporary (workspace) */
 } CvParticle;
 
 /**************************** Function Prototypes ****************************/
@@ -93,26 +163,71 @@ CVAPI(void) cvReleaseParticle( CvParticle** p );
 CVAPI(void) cvParticleSetDynamics( CvParticle* p, const CvMat* dynamics );
 CVAPI(void) cvParticleSetNoise( CvParticle* p, CvRNG rng, const CvMat* std );
 CVAPI(void) cvParticleSetBound( CvParticle* p, const CvMat* bound );
+CVAPI(void) cvParticleSetResample( CvParticle* p, int method );
+CVAPI(void) cvParticleSetResampleThreshold( CvParticle* p, double fraction );
+CVAPI(void) cvParticleSetKLD( CvParticle* p, const CvMat* bins, double epsilon, 
+                              double delta, int min_particles );
+CVAPI(void) cvParticleSetNumParticles( CvParticle* p, int num_particles );
 
 CVAPI(int)  cvParticleGetMax( const CvParticle* p );
 CVAPI(void) cvParticleGetMean( const CvParticle* p, CvMat* meanp );
+CVAPI(void) cvParticleGetMeanCov( const CvParticle* p, CvMat* meanp, CvMat* covp );
 CVAPI(void) cvParticlePrint( const CvParticle* p, int p_id );
+CVAPI(double) cvParticleGetEffectiveSize( const CvParticle* p );
+CVAPI(int)  cvParticleFindDuplicates( CvParticle* p, const CvMat* quantum, 
+                                      CvMat* origins );
 
 CVAPI(void) cvParticleBound( CvParticle* p );
-CVAPI(void) cvParticleNormalize( CvParticle* p );
+CVAPI(double) cvParticleNormalize( CvParticle* p );
 
 CVAPI(void) cvParticleInit( CvParticle* p, const CvParticle* init );
 CVAPI(void) cvParticleTransition( CvParticle* p );
 CVAPI(void) cvParticleResample( CvParticle* p );
+CVAPI(int)  cvParticleResampleAdaptive( CvParticle* p );
 #endif
 
 /*************************** Constructor / Destructor *************************/
 
+/**
+ * Detect the structure of dynamics and index its nonzero elements
+ *
+ * @param particle
+ * @see cvParticleSetDynamics
+ */
+CV_INLINE void icvParticleAnalyzeDynamics( CvParticle* p )
+{
+    int i, j, nnz = 0, offdiag = 0, identity = 1;
+    double a;
+    for( i = 0; i < p->num_states; i++ )
+    {
+        int* index = (int*)( p->dynamics_index->data.ptr + i * p->dynamics_index->step );
+        index[0] = 0;
+        for( j = 0; j < p->num_states; j++ )
+        {
+            a = cvmGet( p->dynamics, i, j );
+            if( a == 0 ) continue;
+            index[++index[0]] = j;
+            nnz++;
+            if( i != j ) offdiag = 1;
+            if( i != j || a != 1 ) identity = 0;
+        }
+        if( index[0] == 0 ) identity = 0; // zero row is not identity
+    }
+    if( identity )
+        p->dynamics_type = CV_PARTICLE_DYNAMICS_IDENTITY;
+    else if( !offdiag )
+        p->dynamics_type = CV_PARTICLE_DYNAMICS_DIAGONAL;
+    else if( nnz * 2 <= p->num_states * p->num_states )
+        p->dynamics_type = CV_PARTICLE_DYNAMICS_SPARSE;
+    else
+        p->dynamics_type = CV_PARTICLE_DYNAMICS_DENSE;
+}
+
 /**
  * Allocate Particle filter structure
  *
  * @param num_states    Number of tracking states, e.g., 4 if x, y, width, height
- * @param num_particles Number of particles
+ * @param num_particles Number of particles. Also the capacity for KLD-sampling
  * @param logweight     The weights parameter is log  or not
  * @return CvParticle*
  */
@@ -127,8 +242,10 @@ CVAPI(CvParticle*) cvCreateParticle( int num_states,
     CV_ASSERT( num_particles > 0 );
     p = (CvParticle *) cvAlloc( sizeof( CvParticle ) );
     p->num_particles = num_particles;
+    p->max_particles = num_particles;
     p->num_states    = num_states;
     p->dynamics      = cvCreateMat( num_states, num_states, CV_32FC1 );
+    p->dynamics_index = cvCreateMat( num_states, num_states + 1, CV_32SC1 );
     p->rng           = 1;
     p->std           = cvCreateMat( num_states, 1, CV_32FC1 );
     p->bound         = cvCreateMat( num_states, 3, CV_32FC1 );
@@ -136,12 +253,33 @@ CVAPI(CvParticle*) cvCreateParticle( int num_states,
     p->weights       = cvCreateMat( 1, num_particles, CV_64FC1 );
     p->logweight     = logweight;
     p->stds          = NULL;
+    p->resample      = CV_PARTICLE_RESAMPLE_SYSTEMATIC;
+    p->resample_threshold = 0.5;
+    p->ess           = num_particles;
+    p->new_particles = cvCreateMat( num_states, num_particles, CV_32FC1 );
+    p->cumweights    = cvCreateMat( 1, num_particles, CV_64FC1 );
+    p->indices       = cvCreateMat( 1, num_particles, CV_32SC1 );
+    p->transits      = cvCreateMat( num_states, num_particles, CV_32FC1 );
+    p->noises        = cvCreateMat( num_states, num_particles, CV_32FC1 );
+    p->tmpweights    = cvCreateMat( 1, num_particles, CV_64FC1 );
+    p->kld_bins      = cvCreateMat( num_states, 1, CV_32SC1 );
+    p->kld_epsilon   = 0.05;
+    p->kld_z         = 2.326; // delta = 0.01
+    p->kld_min_particles = MIN( num_particles, 10 );
+    for( p->kld_table_size = 1; p->kld_table_size < 2 * num_particles; )
+        p->kld_table_size *= 2;
+    p->kld_table     = (uint64*) cvAlloc( p->kld_table_size * sizeof( uint64 ) );
+    p->hashtable     = cvCreateMat( 1, p->kld_table_size, CV_32SC1 );
 
     // Default dynamics: next state = curr state + noise
     cvSetIdentity( p->dynamics, cvScalar(1.0) );
+    icvParticleAnalyzeDynamics( p );
     cvSet( p->std, cvScalar(1.0) );
 
     cvZero( p->bound );
+    cvSet( p->kld_bins, cvScalar(10) );
+    cvSet( p->weights, cvScalar( logweight ? -log( (double) num_particles ) : 
+                                 1.0 / num_particles ) );
 
     __END__;
     return p;
@@ -161,10 +299,20 @@ CVAPI(void) cvReleaseParticle( CvParticle** particle )
     if( !p ) EXIT;
     
     CV_CALL( cvReleaseMat( &p->dynamics ) );
+    CV_CALL( cvReleaseMat( &p->dynamics_index ) );
     CV_CALL( cvReleaseMat( &p->std ) );
     CV_CALL( cvReleaseMat( &p->bound ) );
     CV_CALL( cvReleaseMat( &p->particles ) );
     CV_CALL( cvReleaseMat( &p->weights ) );
+    CV_CALL( cvReleaseMat( &p->new_particles ) );
+    CV_CALL( cvReleaseMat( &p->cumweights ) );
+    CV_CALL( cvReleaseMat( &p->indices ) );
+    CV_CALL( cvReleaseMat( &p->hashtable ) );
+    CV_CALL( cvReleaseMat( &p->transits ) );
+    CV_CALL( cvReleaseMat( &p->noises ) );
+    CV_CALL( cvReleaseMat( &p->tmpweights ) );
+    CV_CALL( cvReleaseMat( &p->kld_bins ) );
+    CV_CALL( cvFree( &p->kld_table ) );
     if( p->stds != NULL )
         CV_CALL( cvReleaseMat( &p->stds ) );
 
@@ -177,6 +325,9 @@ CVAPI(void) cvReleaseParticle( CvParticle** particle )
 /**
  * Set dynamics model
  *
+ * Identity, diagonal and sparse dynamics are detected so that 
+ * cvParticleTransition skips the matrix multiplication.
+ *
  * @param particle
  * @param dynamics (num_states) x (num_states). dynamics model
  *    new_state = dynamics * curr_state + noise
@@ -189,6 +340,7 @@ CVAPI(void) cvParticleSetDynamics( CvParticle* p, const CvMat* dynamics )
     CV_ASSERT( p->num_states == dynamics->cols );
     //cvCopy( dynamics, p->dynamics );
     cvConvert( dynamics, p->dynamics );
+    icvParticleAnalyzeDynamics( p );
     __END__;
 }
 
@@ -229,6 +381,142 @@ CVAPI(void) cvParticleSetBound( CvParticle* p, const CvMat* bound )
     __END__;
 }
 
+/**
+ * Set resampling method used by cvParticleResample
+ *
+ * @param particle
+ * @param method   CV_PARTICLE_RESAMPLE_SYSTEMATIC (default), 
+ *                 CV_PARTICLE_RESAMPLE_STRATIFIED, 
+ *                 CV_PARTICLE_RESAMPLE_RESIDUAL, or
+ *                 CV_PARTICLE_RESAMPLE_KLD
+ */
+CVAPI(void) cvParticleSetResample( CvParticle* p, int method )
+{
+    CV_FUNCNAME( "cvParticleSetResample" );
+    __BEGIN__;
+    CV_ASSERT( method == CV_PARTICLE_RESAMPLE_SYSTEMATIC ||
+               method == CV_PARTICLE_RESAMPLE_STRATIFIED ||
+               method == CV_PARTICLE_RESAMPLE_RESIDUAL ||
+               method == CV_PARTICLE_RESAMPLE_KLD );
+    p->resample = method;
+    __END__;
+}
+
+/**
+ * Set threshold of the effective sample size used by cvParticleResampleAdaptive
+ *
+ * @param particle
+ * @param fraction fraction of num_particles (0.5 by default). 
+ *                 1 resamples always, 0 never.
+ */
+CVAPI(void) cvParticleSetResampleThreshold( CvParticle* p, double fraction )
+{
+    CV_FUNCNAME( "cvParticleSetResampleThreshold" );
+    __BEGIN__;
+    CV_ASSERT( fraction >= 0 && fraction <= 1 );
+    p->resample_threshold = fraction;
+    __END__;
+}
+
+/**
+ * Upper p quantile of the standard normal distribution (0 < p <= 0.5)
+ *
+ * Abramowitz and Stegun 26.2.23, absolute error < 4.5e-4
+ *
+ * @param p
+ * @return double
+ */
+CV_INLINE double icvNormalQuantile( double p )
+{
+    double t = sqrt( -2.0 * log( p ) );
+    return t - ( 2.515517 + 0.802853 * t + 0.010328 * t * t ) / 
+        ( 1.0 + 1.432788 * t + 0.189269 * t * t + 0.001308 * t * t * t );
+}
+
+/**
+ * Enable KLD-sampling (Fox, 2003)
+ *
+ * cvParticleResample draws particles until their number exceeds the bound 
+ * (k - 1) / (2 epsilon) * { 1 - 2/(9(k - 1)) + sqrt(2/(9(k - 1))) z_{1-delta} }^3
+ * where k is the number of bins occupied by the drawn particles, so that 
+ * the KL distance between the sample based and the true posterior does not 
+ * exceed epsilon with probability 1 - delta. num_particles varies between 
+ * min_particles and max_particles (given to cvCreateParticle) without 
+ * reallocation.
+ *
+ * Bins are defined by dividing lowerbound..upperbound (cvParticleSetBound) 
+ * of each state. States without bound are ignored.
+ *
+ * @param particle
+ * @param bins          num_states x 1. Number of bins of each state. 
+ *                      NULL to keep (10 bins by default)
+ * @param epsilon       bound of the KL distance, e.g., 0.05
+ * @param delta         e.g., 0.01
+ * @param min_particles minimum number of particles
+ */
+CVAPI(void) cvParticleSetKLD( CvParticle* p, const CvMat* bins CV_DEFAULT(NULL), 
+                              double epsilon CV_DEFAULT(0.05), 
+                              double delta CV_DEFAULT(0.01), 
+                              int min_particles CV_DEFAULT(10) )
+{
+    CV_FUNCNAME( "cvParticleSetKLD" );
+    __BEGIN__;
+    CV_ASSERT( epsilon > 0 );
+    CV_ASSERT( delta > 0 && delta < 0.5 );
+    CV_ASSERT( min_particles > 0 );
+    if( bins != NULL )
+    {
+        CV_ASSERT( p->num_states == bins->rows && 1 == bins->cols );
+        cvConvert( bins, p->kld_bins );
+    }
+    p->kld_epsilon = epsilon;
+    p->kld_z = icvNormalQuantile( delta );
+    p->kld_min_particles = MIN( min_particles, p->max_particles );
+    p->resample = CV_PARTICLE_RESAMPLE_KLD;
+    __END__;
+}
+
+/**
+ * Set the first n columns of a matrix allocated with capacity columns 
+ * as its active columns
+ */
+CV_INLINE void icvParticleSetCols( CvMat* mat, int cols, int capacity )
+{
+    mat->cols = cols;
+    if( mat->rows == 1 || cols == capacity )
+        mat->type |= CV_MAT_CONT_FLAG;
+    else
+        mat->type &= ~CV_MAT_CONT_FLAG;
+}
+
+/**
+ * Set the number of (active) particles
+ *
+ * Particle matrices are not reallocated, their headers are narrowed to 
+ * the first num_particles columns of the max_particles columns allocated. 
+ * States and weights of the first min(old, new) particles are kept, 
+ * those of newly activated particles are undefined.
+ *
+ * @param particle
+ * @param num_particles 1 <= num_particles <= max_particles
+ */
+CVAPI(void) cvParticleSetNumParticles( CvParticle* p, int num_particles )
+{
+    CV_FUNCNAME( "cvParticleSetNumParticles" );
+    __BEGIN__;
+    CV_ASSERT( num_particles > 0 && num_particles <= p->max_particles );
+    p->num_particles = num_particles;
+    icvParticleSetCols( p->particles, num_particles, p->max_particles );
+    icvParticleSetCols( p->new_particles, num_particles, p->max_particles );
+    icvParticleSetCols( p->weights, num_particles, p->max_particles );
+    icvParticleSetCols( p->cumweights, num_particles, p->max_particles );
+    icvParticleSetCols( p->indices, num_particles, p->max_particles );
+    icvParticleSetCols( p->transits, num_particles, p->max_particles );
+    icvParticleSetCols( p->noises, num_particles, p->max_particles );
+    icvParticleSetCols( p->tmpweights, num_particles, p->max_particles );
+    __END__;
+}
+
 /************************ Utility ******************************************/
 
 /**
@@ -246,57 +534,294 @@ CVAPI(int) cvParticleGetMax( const CvParticle* p )
 }
 
 /**
- * Get the mean state (particle)
+ * Accumulate a wrapped state for its circular mean
+ *
+ * @param x         state value
+ * @param w         weight
+ * @param lower     lowerbound of the state
+ * @param upper     upperbound of the state. One period is upper - lower
+ * @param csum      sum of w * cos (input/output)
+ * @param ssum      sum of w * sin (input/output)
+ * @see icvParticleCircularMean
+ */
+CV_INLINE void icvParticleCircularSum( double x, double w, double lower, double upper,
+                                       double* csum, double* ssum )
+{
+    double theta = ( x - lower ) * 2 * CV_PI / ( upper - lower );
+    *csum += w * cos( theta );
+    *ssum += w * sin( theta );
+}
+
+/**
+ * Circular mean of a wrapped state in lowerbound..upperbound
+ *
+ * @param csum      sum of w * cos by icvParticleCircularSum
+ * @param ssum      sum of w * sin by icvParticleCircularSum
+ * @param lower     lowerbound of the state
+ * @param upper     upperbound of the state
+ * @return mean in [lower, upper)
+ */
+CV_INLINE double icvParticleCircularMean( double csum, double ssum, double lower, double upper )
+{
+    double theta = atan2( ssum, csum );
+    if( theta < 0 ) theta += 2 * CV_PI;
+    return lower + theta * ( upper - lower ) / ( 2 * CV_PI );
+}
+
+/**
+ * Maximum number of states whose mean and covariance accumulators 
+ * cvParticleGetMeanCov keeps on the stack (3KB). More states are 
+ * allocated per call.
+ */
+#define CV_PARTICLE_MOMENTS_STATES 16
+
+/**
+ * Get the weighted mean, covariance and circular mean/variance of particles
+ *
+ * Computed in one pass over particles (West's weighted incremental 
+ * algorithm). Weights need not be normalized, log weights are used 
+ * as they are (relative to the max). 
+ *
+ * For wrapped states (bound column 2), the mean is the circular mean 
+ * in lowerbound..upperbound, and the variance (diagonal of covp) is 
+ * the circular variance -2 ln R expressed in the unit of the state, 
+ * where R is the mean resultant length. Covariances between a wrapped 
+ * state and other states are 0. 
+ *
+ * The accumulators are local to the call, on the stack up to 
+ * CV_PARTICLE_MOMENTS_STATES states, so that concurrent calls on the 
+ * same particles (const) do not race. 
  *
  * @param particle
  * @param meanp     num_states x 1, CV_32FC1 or CV_64FC1
- * @return CVAPI(void)
+ * @param covp      num_states x num_states, CV_32FC1 or CV_64FC1. 
+ *                  NULL not to compute the covariance
  */
-CVAPI(void) cvParticleGetMean( const CvParticle* p, CvMat* meanp )
+CVAPI(void) cvParticleGetMeanCov( const CvParticle* p, CvMat* meanp, 
+                                  CvMat* covp CV_DEFAULT(NULL) )
 {
-    CvMat* weights = NULL;
-    CvMat* particles_i, hdr;
-    int i, j;
-    CV_FUNCNAME( "cvParticleGetMean" );
+    int S = p->num_states, n = p->num_particles;
+    int s, t, j, depth = CV_MAT_DEPTH( p->particles->type );
+    const double* weights = p->weights->data.db;
+    double local[CV_PARTICLE_MOMENTS_STATES * ( CV_PARTICLE_MOMENTS_STATES + 8 )];
+    double *buf = NULL, *x, *mean, *delta, *cov, *csum, *ssum;
+    double *lower, *upper, *circular;
+    double maxweight = 0, sumw = 0, w, r, R;
+    CV_FUNCNAME( "cvParticleGetMeanCov" );
     __BEGIN__;
-    CV_ASSERT( meanp->rows == p->num_states && meanp->cols == 1 );
-    if( !p->logweight )
-    {
-        weights = p->weights;
-    }
+    CV_ASSERT( meanp->rows == S && meanp->cols == 1 );
+    CV_ASSERT( covp == NULL || ( covp->rows == S && covp->cols == S ) );
+    CV_ASSERT( depth == CV_32F || depth == CV_64F );
+
+    if( S <= CV_PARTICLE_MOMENTS_STATES )
+        x = local;
     else
+        CV_CALL( x = buf = (double*) cvAlloc( S * ( S + 8 ) * sizeof( double ) ) );
+    mean = x + S; delta = mean + S; csum = delta + S; ssum = csum + S;
+    lower = ssum + S; upper = lower + S; circular = upper + S; cov = circular + S;
+    memset( mean, 0, S * sizeof( double ) );
+    memset( csum, 0, S * 2 * sizeof( double ) );
+    memset( cov, 0, S * S * sizeof( double ) );
+    for( s = 0; s < S; s++ )
     {
-        weights = cvCreateMat( 1, p->num_particles, p->weights->type );
-        cvExp( p->weights, weights );
+        circular[s] = cvmGet( p->bound, s, 2 );
+        lower[s]    = cvmGet( p->bound, s, 0 );
+        upper[s]    = cvmGet( p->bound, s, 1 );
     }
+    if( p->logweight )
+        cvMinMaxLoc( p->weights, NULL, &maxweight );
 
-    for( i = 0; i < p->num_states; i++ )
+    for( j = 0; j < n; j++ )
     {
-        int circular = (int) cvmGet( p->bound, i, 2 );
-        if( !circular ) // usual mean
+        w = p->logweight ? exp( weights[j] - maxweight ) : weights[j];
+        if( w <= 0 ) continue;
+        sumw += w;
+        r = w / sumw;
+        for( s = 0; s < S; s++ )
         {
-            particles_i = cvGetRow( p->particles, &hdr, i );
-            double mean = 0;
-            for( j = 0; j < p->num_particles; j++ )
+            const uchar* row = p->particles->data.ptr + s * p->particles->step;
+            x[s] = depth == CV_32F ? ((const float*)row)[j] : ((const double*)row)[j];
+            if( circular[s] )
             {
-                mean += cvmGet( particles_i, 0, j ) * cvmGet( weights, 0, j );
+                icvParticleCircularSum( x[s], w, lower[s], upper[s], &csum[s], &ssum[s] );
+            }
+            else
+            {
+                delta[s] = x[s] - mean[s];
+                mean[s] += r * delta[s];
             }
-            cvmSet( meanp, i, 0, mean );
         }
-        else // wrapped mean (angle)
+        if( covp == NULL ) continue;
+        for( s = 0; s < S; s++ )
         {
-            double wrap = cvmGet( p->bound, i, 1 ) - cvmGet( p->bound, i, 0 );
-            particles_i = cvGetRow( p->particles, &hdr, i );
-            CvScalar mean = cvAngleMean( particles_i, weights, wrap );
-            cvmSet( meanp, i, 0, mean.val[0] );
+            if( circular[s] ) continue;
+            for( t = 0; t <= s; t++ )
+            {
+                if( circular[t] ) continue;
+                cov[s * S + t] += w * delta[s] * ( x[t] - mean[t] );
+            }
         }
     }
 
-    if( weights != p->weights )
-        cvReleaseMat( &weights );
+    for( s = 0; s < S; s++ )
+    {
+        if( circular[s] && sumw > 0 )
+        {
+            double period = 2 * CV_PI / ( upper[s] - lower[s] );
+            mean[s] = icvParticleCircularMean( csum[s], ssum[s], lower[s], upper[s] );
+            R = sqrt( csum[s] * csum[s] + ssum[s] * ssum[s] ) / sumw;
+            cov[s * S + s] = -2 * log( MAX( R, DBL_MIN ) ) / ( period * period );
+        }
+        cvmSet( meanp, s, 0, mean[s] );
+    }
+    if( covp != NULL )
+    {
+        for( s = 0; s < S; s++ )
+        {
+            for( t = 0; t <= s; t++ )
+            {
+                double c = cov[s * S + t];
+                if( !circular[s] && !circular[t] && sumw > 0 ) c /= sumw;
+                cvmSet( covp, s, t, c );
+                cvmSet( covp, t, s, c );
+            }
+        }
+    }
     __END__;
+    cvFree( &buf );
+}
+
+/**
+ * Get the mean state (particle)
+ *
+ * @param particle
+ * @param meanp     num_states x 1, CV_32FC1 or CV_64FC1
+ * @see cvParticleGetMeanCov
+ */
+CVAPI(void) cvParticleGetMean( const CvParticle* p, CvMat* meanp )
+{
+    cvParticleGetMeanCov( p, meanp, NULL );
+}
+
+/**
+ * Get the effective sample size of the weights
+ *
+ * ESS = (sum w)^2 / sum w^2. It is num_particles for uniform weights and 
+ * 1 if a single particle has all the weight. Weights need not be normalized.
+ *
+ * @param particle
+ * @return double
+ */
+CVAPI(double) cvParticleGetEffectiveSize( const CvParticle* p )
+{
+    const double* weights = p->weights->data.db;
+    double sum = 0, sqsum = 0, maxweight = 0, w;
+    int i;
+    if( p->logweight )
+        cvMinMaxLoc( p->weights, NULL, &maxweight );
+    for( i = 0; i < p->num_particles; i++ )
+    {
+        w = p->logweight ? exp( weights[i] - maxweight ) : weights[i];
+        sum += w;
+        sqsum += w * w;
+    }
+    return sqsum > 0 ? sum * sum / sqsum : 0;
+}
+
+/**
+ * Quantized s-th state of the particle-th particle
+ *
+ * @see cvParticleFindDuplicates
+ */
+CV_INLINE double icvParticleQuantizedState( const CvParticle* p, const CvMat* quantum, 
+                                            int s, int particle )
+{
+    double q = quantum ? cvmGet( quantum, s, 0 ) : -1;
+    double x = cvmGet( p->particles, s, particle );
+    if( q == 0 ) return 0; // ignored
+    return ( q < 0 ? x : cvRound( x / q ) ) + 0.0; // + 0.0 makes -0.0 0.0
 }
 
+/**
+ * Find particles whose quantized states are equal to a preceding particle
+ *
+ * Typically used to evaluate likelihoods only once for duplicated particles 
+ * which resampling produces (and transition leaves if noise is 0 or small). 
+ * States are quantized as round( state / quantum ), hashed and compared, 
+ * in O(num_particles). The hash table is the "hashtable" workspace, and 
+ * allocated per call only for views without workspaces (CvParticleFilter, 
+ * CvParticleBank). 
+ *
+ * @param particle
+ * @param quantum  num_states x 1. Quantization step of each state. 
+ *                 0 to ignore the state (e.g., previous states of 
+ *                 2nd order dynamics), NULL to compare states exactly.
+ * @param origins  1 x num_particles, CV_32SC1. The id of the first particle 
+ *                 having the same quantized states (the particle itself if 
+ *                 it is unique)
+ * @return number of unique particles
+ */
+CVAPI(int) cvParticleFindDuplicates( CvParticle* p, const CvMat* quantum, 
+                                     CvMat* origins )
+{
+    int i, j, s, slot, size, mask, num_unique = 0;
+    int *table = NULL, *buf = NULL;
+    int* org = origins->data.i;
+    uint64 hash;
+    double q;
+    CV_FUNCNAME( "cvParticleFindDuplicates" );
+    __BEGIN__;
+    CV_ASSERT( CV_MAT_TYPE( origins->type ) == CV_32SC1 );
+    CV_ASSERT( origins->rows == 1 && origins->cols == p->num_particles );
+    CV_ASSERT( quantum == NULL || 
+               ( quantum->rows == p->num_states && quantum->cols == 1 ) );
+
+    for( size = 1; size < 2 * p->num_particles; size *= 2 )
+        ;
+    mask = size - 1;
+    if( p->hashtable != NULL )
+        table = p->hashtable->data.i;
+    else
+        CV_CALL( table = buf = (int*) cvAlloc( size * sizeof( int ) ) );
+    memset( table, -1, size * sizeof( int ) );
+
+    for( i = 0; i < p->num_particles; i++ )
+    {
+        hash = 0;
+        for( s = 0; s < p->num_states; s++ )
+        {
+            uint64 bits;
+            q = icvParticleQuantizedState( p, quantum, s, i );
+            memcpy( &bits, &q, sizeof( bits ) );
+            hash = ( hash ^ bits ) * CV_BIG_UINT(0x100000001B3);
+        }
+        hash ^= hash >> 29;
+        org[i] = i;
+        for( slot = (int)( hash & mask ); ( j = table[slot] ) != -1; 
+             slot = ( slot + 1 ) & mask )
+        {
+            for( s = 0; s < p->num_states; s++ )
+            {
+                if( icvParticleQuantizedState( p, quantum, s, i ) != 
+                    icvParticleQuantizedState( p, quantum, s, j ) )
+                    break;
+            }
+            if( s == p->num_states ) // same
+            {
+                org[i] = j;
+                break;
+            }
+        }
+        if( org[i] == i )
+        {
+            table[slot] = i;
+            num_unique++;
+        }
+    }
+    __END__;
+    cvFree( &buf );
+    return num_unique;
+}
 
 /**
  * Print states of a particle
@@ -330,9 +855,11 @@ CVAPI(void) cvParticlePrint( const CvParticle*p, int p_id CV_DEFAULT(-1) )
  * Do normalization of weights
  *
  * @param particle
+ * @return effective sample size, also stored into p->ess
  * @see cvParticleResample
+ * @see cvParticleGetEffectiveSize
  */
-CVAPI(void) cvParticleNormalize( CvParticle* p )
+CVAPI(double) cvParticleNormalize( CvParticle* p )
 {
     if( !p->logweight )
     {
@@ -341,24 +868,55 @@ CVAPI(void) cvParticleNormalize( CvParticle* p )
     }
     else // log version
     {
-        CvScalar normterm = cvLogSum( p->weights );
+        CvScalar normterm = cvLogSum( p->weights, p->tmpweights );
         cvSubS( p->weights, normterm, p->weights );
     }
+    p->ess = cvParticleGetEffectiveSize( p );
+    return p->ess;
 }
 
 /**
- * Apply lower bound and upper bound for particle states.
+ * Number of particles in a chunk. 
+ *
+ * Bounding, initialization and transition process particles by chunks 
+ * (in parallel if OpenMP is enabled). Each chunk draws random numbers 
+ * from its own stream, so results do not depend on the number of threads.
+ */
+#define CV_PARTICLE_CHUNK 256
+
+/**
+ * Random state of the chunk-th stream
+ *
+ * Counter based: the stream is a hash (splitmix64) of the seed and 
+ * the chunk index, so streams can be created in any order.
+ *
+ * @param seed  state of CvParticle::rng at the beginning of a step
+ * @param chunk chunk index
+ * @return CvRNG
+ */
+CV_INLINE CvRNG icvParticleChunkRNG( CvRNG seed, int chunk )
+{
+    uint64 z = seed + (uint64)( chunk + 1 ) * CV_BIG_UINT(0x9E3779B97F4A7C15);
+    z = ( z ^ ( z >> 30 ) ) * CV_BIG_UINT(0xBF58476D1CE4E5B9);
+    z = ( z ^ ( z >> 27 ) ) * CV_BIG_UINT(0x94D049BB133111EB);
+    z = z ^ ( z >> 31 );
+    return z != 0 ? z : (CvRNG)-1;
+}
+
+/**
+ * Apply lower bound and upper bound for states of particles start..end-1
  *
  * @param particle
- * @note Used by See also functions
- * @see cvParticleTransition
+ * @param start
+ * @param end
+ * @see cvParticleBound
  */
-CVAPI(void) cvParticleBound( CvParticle* p )
+CV_INLINE void icvParticleBoundCols( CvParticle* p, int start, int end )
 {
     int row, col;
     double lower, upper;
     int circular;
-    CvMat* stateparticles, hdr;
+    CvMat stateparticles;
     float state;
     // @todo:     np.width   = (double)MAX( 2.0, MIN( maxX - 1 - x, width ) );
     for( row = 0; row < p->num_states; row++ )
@@ -368,95 +926,272 @@ CVAPI(void) cvParticleBound( CvParticle* p )
         circular = (int) cvmGet( p->bound, row, 2 );
         if( lower == upper ) continue; // no bound flag
         if( circular ) {
-            for( col = 0; col < p->num_particles; col++ ) {
+            for( col = start; col < end; col++ ) {
                 state = cvmGet( p->particles, row, col );
                 state = state < lower ? state + upper : ( state >= upper ? state - upper : state );
                 cvmSet( p->particles, row, col, state );
             }
         } else {
-            stateparticles = cvGetRow( p->particles, &hdr, row );
-            cvMinS( stateparticles, upper, stateparticles );
-            cvMaxS( stateparticles, lower, stateparticles );
+            cvGetSubRect( p->particles, &stateparticles, 
+                          cvRect( start, row, end - start, 1 ) );
+            cvMinS( &stateparticles, upper, &stateparticles );
+            cvMaxS( &stateparticles, lower, &stateparticles );
         }
     }
 }
 
+/**
+ * Apply lower bound and upper bound for particle states.
+ *
+ * @param particle
+ * @note Used by See also functions
+ * @see cvParticleTransition
+ */
+CVAPI(void) cvParticleBound( CvParticle* p )
+{
+    int c, num_chunks = ( p->num_particles + CV_PARTICLE_CHUNK - 1 ) / CV_PARTICLE_CHUNK;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif /* _OPENMP */
+    for( c = 0; c < num_chunks; c++ )
+    {
+        icvParticleBoundCols( p, c * CV_PARTICLE_CHUNK, 
+                              MIN( ( c + 1 ) * CV_PARTICLE_CHUNK, p->num_particles ) );
+    }
+}
+
 /******************* Main (Related to Algorithm) *****************************/
 
+/**
+ * Initialize states of the chunk-th chunk of particles
+ *
+ * @param particle
+ * @param init     initial states or NULL
+ * @param chunk    chunk index
+ * @param seed     seed of the chunk random streams
+ * @see cvParticleInit
+ */
+CV_INLINE void icvParticleInitChunk( CvParticle* p, const CvParticle* init, 
+                                     int chunk, CvRNG seed )
+{
+    int start = chunk * CV_PARTICLE_CHUNK;
+    int end   = MIN( start + CV_PARTICLE_CHUNK, p->num_particles );
+    CvRNG rng = icvParticleChunkRNG( seed, chunk );
+    CvMat stateparticles;
+    CvScalar lower, upper;
+    int i, n, s;
+    if( init ) // copy
+    {
+        // the first <remain> initial states are copied <divide> + 1 times, 
+        // the rest <divide> times
+        int divide = p->num_particles / init->num_particles;
+        int remain = p->num_particles - divide * init->num_particles;
+        for( n = start; n < end; n++ )
+        {
+            i = ( n < remain * ( divide + 1 ) ) ? n / ( divide + 1 ) : 
+                remain + ( n - remain * ( divide + 1 ) ) / divide;
+            for( s = 0; s < init->num_states; s++ )
+            {
+                double state = cvmGet( init->particles, s, i );
+                if( FLT_MAX - state < FLT_EPSILON ) // randomize flag
+                {
+                    double lowerval = cvmGet( p->bound, s, 0 );
+                    double upperval = cvmGet( p->bound, s, 1 );
+                    state = lowerval + cvRandReal( &rng ) * ( upperval - lowerval );
+                }
+                cvmSet( p->particles, s, n, state );
+            }
+        }
+    }
+    else // randomize all states
+    {
+        for( s = 0; s < p->num_states; s++ )
+        {
+            lower = cvScalar( cvmGet( p->bound, s, 0 ) );
+            upper = cvScalar( cvmGet( p->bound, s, 1 ) );
+            cvGetSubRect( p->particles, &stateparticles, 
+                          cvRect( start, s, end - start, 1 ) );
+            cvRandArr( &rng, &stateparticles, CV_RAND_UNI, lower, upper );
+        }
+    }
+}
+
 /**
  * Initialize states
  *
  * If initial states are given, these states are uniformly copied.
  * If not given, states are uniform randomly sampled within lowerbound 
- * and upperbound regions.
+ * and upperbound regions. Weights are set uniform. 
  *
  * @param particle
  * @param init       initial states.
  */
 CVAPI(void) cvParticleInit( CvParticle* p, const CvParticle* init = NULL )
 {
-    int i, c, n, s;
-    if( init ) // copy
+    int c, num_chunks = ( p->num_particles + CV_PARTICLE_CHUNK - 1 ) / CV_PARTICLE_CHUNK;
+    CvRNG seed = p->rng;
+    cvRandInt( &p->rng ); // advance to the seed of the next step
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif /* _OPENMP */
+    for( c = 0; c < num_chunks; c++ )
     {
-        int *num_copy;
-        CvMat init_particle;
+        icvParticleInitChunk( p, init, c, seed );
+    }
+    cvSet( p->weights, cvScalar( p->logweight ? -log( (double) p->num_particles ) : 
+                                 1.0 / p->num_particles ) );
+}
 
-        int divide = p->num_particles / init->num_particles;
-        int remain = p->num_particles - divide * init->num_particles;
-        num_copy = (int*) malloc( init->num_particles * sizeof(int) );
-        for( i = 0; i < init->num_particles; i++ )
-        {
-            num_copy[i] = divide + ( i < remain ? 1 : 0 );
-        }
-        
-        n = 0; // copy all states once
-        for( i = 0; i < init->num_particles; i++ )
+/**
+ * Apply dynamics of identity, diagonal or sparse structure, add noises 
+ * and bound for particles start..end-1 in one pass over each state
+ *
+ * Identity and diagonal dynamics update particles in place. Sparse 
+ * dynamics accumulate the nonzero terms into "transits" which are copied 
+ * back after all states are computed.
+ *
+ * @param particle
+ * @param start
+ * @param end
+ * @see icvParticleTransitionChunk
+ */
+CV_INLINE void icvParticleTransitionStructured( CvParticle* p, int start, int end )
+{
+    int s, j, c, k, n = end - start;
+    int sparse = ( p->dynamics_type == CV_PARTICLE_DYNAMICS_SPARSE );
+    for( s = 0; s < p->num_states; s++ )
+    {
+        float* x = (float*)( p->particles->data.ptr + s * p->particles->step ) + start;
+        const float* e = (const float*)( p->noises->data.ptr + s * p->noises->step ) + start;
+        float* y = sparse ? (float*)( p->transits->data.ptr + s * p->transits->step ) + start : x;
+        const float* a = (const float*)( p->dynamics->data.ptr + s * p->dynamics->step );
+        const int* index = (const int*)( p->dynamics_index->data.ptr + 
+                                         s * p->dynamics_index->step );
+        float lower = (float) cvmGet( p->bound, s, 0 );
+        float upper = (float) cvmGet( p->bound, s, 1 );
+        int circular = (int) cvmGet( p->bound, s, 2 );
+        int bounded = ( lower != upper );
+        float v;
+
+        for( j = 0; j < n; j++ )
         {
-            cvGetCol( init->particles, &init_particle, i );
-            for( c = 0; c < num_copy[i]; c++ )
+            if( p->dynamics_type == CV_PARTICLE_DYNAMICS_IDENTITY )
+                v = x[j] + e[j];
+            else if( p->dynamics_type == CV_PARTICLE_DYNAMICS_DIAGONAL )
+                v = a[s] * x[j] + e[j];
+            else
             {
-                cvSetCol( &init_particle, p->particles, n++ );
+                v = e[j];
+                for( c = 1; c <= index[0]; c++ )
+                {
+                    k = index[c];
+                    v += a[k] * ((const float*)( p->particles->data.ptr + 
+                                                 k * p->particles->step ))[start + j];
+                }
+            }
+            if( bounded )
+            {
+                if( circular )
+                    v = v < lower ? v + upper : ( v >= upper ? v - upper : v );
+                else
+                    v = MIN( MAX( v, lower ), upper );
             }
+            y[j] = v;
+        }
+    }
+    if( sparse )
+    {
+        for( s = 0; s < p->num_states; s++ )
+        {
+            memcpy( (float*)( p->particles->data.ptr + s * p->particles->step ) + start, 
+                    (float*)( p->transits->data.ptr + s * p->transits->step ) + start, 
+                    n * sizeof( float ) );
+        }
+    }
+}
+
+/**
+ * Generate gaussian noises of particles start..start+noises->cols-1 
+ * with "std", or "stds" if set
+ *
+ * @param particle
+ * @param noises   num_states x (number of particles). Output
+ * @param start    id of the first particle
+ * @param rng      random stream of the chunk
+ * @see icvParticleTransitionChunk
+ */
+CV_INLINE void icvParticleNoiseCols( const CvParticle* p, CvMat* noises, int start, 
+                                     CvRNG* rng )
+{
+    CvMat noise, stds;
+    double std;
+    int i, j;
+    if( p->stds == NULL )
+    {
+        for( i = 0; i < p->num_states; i++ )
+        {
+            std = cvmGet( p->std, i, 0 );
+            cvGetRow( noises, &noise, i );
+            if( std == 0.0 )
+                cvZero( &noise );
+            else
+                cvRandArr( rng, &noise, CV_RAND_NORMAL, cvScalar(0), cvScalar( std ) );
         }
-        // randomize partial states if necessary
-        for( s = 0; s < init->num_states; s++ )
+    }
+    else
+    {
+        // one block of standard normal variates, scaled by each particle's std
+        cvRandArr( rng, noises, CV_RAND_NORMAL, cvScalar(0), cvScalar(1) );
+        if( CV_MAT_TYPE( p->stds->type ) == CV_MAT_TYPE( noises->type ) )
         {
-            n = 0;
-            for( i = 0; i < init->num_particles; i++ )
+            cvGetCols( p->stds, &stds, start, start + noises->cols );
+            cvMul( noises, &stds, noises );
+        }
+        else
+        {
+            for( i = 0; i < p->num_states; i++ )
             {
-                if( FLT_MAX - cvmGet( init->particles, s, i ) < FLT_EPSILON ) // randomize flag
+                for( j = 0; j < noises->cols; j++ )
                 {
-                    CvScalar lower, upper;
-                    CvMat* statenoiseT = cvCreateMat( num_copy[i], 1, p->particles->type );
-                    lower = cvScalar( cvmGet( p->bound, s, 0 ) );
-                    upper = cvScalar( cvmGet( p->bound, s, 1 ) );
-                    cvRandArr( &p->rng, statenoiseT, CV_RAND_UNI, lower, upper );
-                    for( c = 0; c < num_copy[i]; c++ )
-                    {
-                        cvmSet( p->particles, s, n++, cvmGet( statenoiseT, c, 0 ) );
-                    }
-                    cvReleaseMat( &statenoiseT );
+                    cvmSet( noises, i, j, 
+                            cvmGet( noises, i, j ) * cvmGet( p->stds, i, start + j ) );
                 }
             }
         }
+    }
+}
 
-        free( num_copy );
-    } 
-    else // randomize all states
+/**
+ * Samples new particles of the chunk-th chunk
+ *
+ * @param particle
+ * @param chunk    chunk index
+ * @param seed     seed of the chunk random streams
+ * @see cvParticleTransition
+ */
+CV_INLINE void icvParticleTransitionChunk( CvParticle* p, int chunk, CvRNG seed )
+{
+    int start = chunk * CV_PARTICLE_CHUNK;
+    int end   = MIN( start + CV_PARTICLE_CHUNK, p->num_particles );
+    CvRNG rng = icvParticleChunkRNG( seed, chunk );
+    CvMat particles, transits, noises;
+
+    cvGetCols( p->particles, &particles, start, end );
+    cvGetCols( p->transits, &transits, start, end );
+    cvGetCols( p->noises, &noises, start, end );
+    icvParticleNoiseCols( p, &noises, start, &rng );
+
+    if( p->dynamics_type == CV_PARTICLE_DYNAMICS_DENSE || 
+        CV_MAT_TYPE( p->particles->type ) != CV_32FC1 )
     {
-        CvScalar lower, upper;
-        CvMat* statenoiseT = cvCreateMat( p->num_particles, 1, p->particles->type );
-        CvMat* statenoise  = cvCreateMat( 1, p->num_particles, p->particles->type );
-        for( s = 0; s < p->num_states; s++ )
-        {
-            lower = cvScalar( cvmGet( p->bound, s, 0 ) );
-            upper = cvScalar( cvmGet( p->bound, s, 1 ) );
-            cvRandArr( &p->rng, statenoiseT, CV_RAND_UNI, lower, upper );
-            cvT( statenoiseT, statenoise );
-            cvSetRow( statenoise, p->particles, s );
-        }
-        cvReleaseMat( &statenoise );
-        cvReleaseMat( &statenoiseT );
+        // dynamics + noise
+        cvMatMul( p->dynamics, &particles, &transits );
+        cvAdd( &transits, &noises, &particles );
+        icvParticleBoundCols( p, start, end );
+    }
+    else
+    {
+        icvParticleTransitionStructured( p, start, end );
     }
 }
 
@@ -468,97 +1203,267 @@ CVAPI(void) cvParticleInit( CvParticle* p, const CvParticle* init = NULL )
  * such as Taylor series model and call your function instead of this function. 
  * Other functions should not necessary be modified.
  *
+ * Particles are processed by chunks of CV_PARTICLE_CHUNK (in parallel if 
+ * OpenMP is enabled). The results are identical for any number of threads.
+ * Identity, diagonal and sparse dynamics (detected by cvParticleSetDynamics) 
+ * are applied together with noises and bounds without matrix multiplication.
+ *
  * @param particle
  * @note Uses See also functions inside.
  * @see cvParticleBound
  */
 CVAPI(void) cvParticleTransition( CvParticle* p )
 {
-    int i, j;
-    CvMat* transits = cvCreateMat( p->num_states, p->num_particles, p->particles->type );
-    CvMat* noises   = cvCreateMat( p->num_states, p->num_particles, p->particles->type );
-    CvMat* noise, noisehdr;
-    double std;
-    
-    // dynamics
-    cvMatMul( p->dynamics, p->particles, transits );
-    
-    // noise generation
-    if( p->stds == NULL )
+    int c, num_chunks = ( p->num_particles + CV_PARTICLE_CHUNK - 1 ) / CV_PARTICLE_CHUNK;
+    CvRNG seed = p->rng;
+    cvRandInt( &p->rng ); // advance to the seed of the next step
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif /* _OPENMP */
+    for( c = 0; c < num_chunks; c++ )
     {
-        for( i = 0; i < p->num_states; i++ )
+        icvParticleTransitionChunk( p, c, seed );
+    }
+}
+
+/**
+ * Select <count> particle ids by walking once over the cumulative weights 
+ * with evenly spaced (systematic) or per stratum random (stratified) points
+ *
+ * @param cumweights cumulative weights of n particles
+ * @param n          number of particles
+ * @param count      number of ids to select
+ * @param stratified draw a random offset per stratum or one for all
+ * @param rng
+ * @param indices    selected ids (output)
+ */
+CV_INLINE void icvParticleSelect( const double* cumweights, int n, int count, 
+                                  bool stratified, CvRNG* rng, int* indices )
+{
+    double step = cumweights[n - 1] / count;
+    double offset = cvRandReal( rng );
+    double u;
+    int j = 0, k;
+    for( k = 0; k < count; k++ )
+    {
+        if( stratified && k > 0 )
+            offset = cvRandReal( rng );
+        u = ( k + offset ) * step;
+        while( j < n - 1 && cumweights[j] <= u )
+            j++;
+        indices[k] = j;
+    }
+}
+
+/**
+ * Select n particle ids from the cumulative weights of n particles 
+ * with a fixed size resampling method
+ *
+ * @param method     CV_PARTICLE_RESAMPLE_SYSTEMATIC, _STRATIFIED or _RESIDUAL
+ * @param cumweights cumulative weights of n particles. Overwritten by 
+ *                   the residual method.
+ * @param n          number of particles
+ * @param rng
+ * @param indices    selected ids (output)
+ */
+CV_INLINE void icvParticleSelectMethod( int method, double* cumweights, int n, 
+                                        CvRNG* rng, int* indices )
+{
+    double total = cumweights[n - 1];
+    double prev = 0, residual = 0, expected;
+    int i, k, copies, count;
+    if( !( total > 0 ) ) // degenerated weights, keep particles
+    {
+        for( k = 0; k < n; k++ )
+            indices[k] = k;
+    }
+    else if( method == CV_PARTICLE_RESAMPLE_RESIDUAL )
+    {
+        // deterministic copies, residual weights are accumulated in place
+        k = 0;
+        for( i = 0; i < n; i++ )
         {
-            std = cvmGet( p->std, i, 0 );
-            noise = cvGetRow( noises, &noisehdr, i );
-            if( std == 0.0 )
-                cvZero( noise );
-            else
-                cvRandArr( &p->rng, noise, CV_RAND_NORMAL, cvScalar(0), cvScalar( std ) );
+            expected = ( cumweights[i] - prev ) * n / total;
+            prev = cumweights[i];
+            copies = (int) expected;
+            residual += expected - copies;
+            while( copies-- > 0 && k < n )
+                indices[k++] = i;
+            cumweights[i] = residual;
         }
+        count = n - k;
+        if( count > 0 )
+            icvParticleSelect( cumweights, n, count, false, rng, indices + k );
     }
     else
     {
-        for( i = 0; i < p->num_states; i++ )
-        {
-            for( j = 0; j < p->num_particles; j++ )
-            {
-                std = cvmGet( p->stds, i, j );
-                if( std == 0.0 )
-                    cvmSet( noises, i, j, 0.0 );
-                else
-                    cvmSet( noises, i, j, cvRandGauss( &p->rng, std ) );
-            }
-        }
+        icvParticleSelect( cumweights, n, n, 
+                           method == CV_PARTICLE_RESAMPLE_STRATIFIED, 
+                           rng, indices );
     }
+}
 
-    // dynamics + noise
-    cvAdd( transits, noises, p->particles );
+/**
+ * Number of particles required by KLD-sampling for k occupied bins
+ *
+ * @param k       number of occupied bins
+ * @param epsilon bound of the KL distance
+ * @param z       upper 1 - delta quantile of the standard normal
+ * @return int
+ * @see cvParticleSetKLD
+ */
+CV_INLINE int icvParticleKLDBound( int k, double epsilon, double z )
+{
+    double a, b;
+    if( k <= 1 ) return 1;
+    a = 2.0 / ( 9.0 * ( k - 1 ) );
+    b = 1.0 - a + sqrt( a ) * z;
+    return (int) ceil( ( k - 1 ) / ( 2.0 * epsilon ) * b * b * b );
+}
+
+/**
+ * Select particle ids by KLD-sampling
+ *
+ * Particles are drawn independently (binary search over the cumulative 
+ * weights) and the bin of each drawn particle is inserted into a hash 
+ * table until the KLD bound or max_particles is reached.
+ *
+ * @param particle
+ * @param cumweights cumulative weights of num_particles particles
+ * @param indices    selected ids (output), max_particles long
+ * @return number of selected ids
+ * @see cvParticleSetKLD
+ */
+CV_INLINE int icvParticleSelectKLD( CvParticle* p, const double* cumweights, 
+                                    int* indices )
+{
+    int n = p->num_particles, mask = p->kld_table_size - 1;
+    uint64* table = p->kld_table;
+    double total = cumweights[n - 1], u, lower, upper, state;
+    int count = 0, occupied = 0, required = 1;
+    int lo, hi, mid, s, nbins, bin, h;
+    uint64 key;
+    memset( table, 0, p->kld_table_size * sizeof( uint64 ) );
+    do
+    {
+        u = cvRandReal( &p->rng ) * total;
+        for( lo = 0, hi = n - 1; lo < hi; )
+        {
+            mid = ( lo + hi ) / 2;
+            if( cumweights[mid] <= u ) lo = mid + 1; else hi = mid;
+        }
+        indices[count++] = lo;
 
-    cvReleaseMat( &transits );
-    cvReleaseMat( &noises );
+        // bin of the drawn particle
+        key = 0;
+        for( s = 0; s < p->num_states; s++ )
+        {
+            nbins = p->kld_bins->data.i[s];
+            lower = cvmGet( p->bound, s, 0 );
+            upper = cvmGet( p->bound, s, 1 );
+            if( nbins <= 0 || lower == upper ) continue;
+            state = ((const float*)( p->particles->data.ptr + s * p->particles->step ))[lo];
+            bin = cvFloor( ( state - lower ) * nbins / ( upper - lower ) );
+            bin = MIN( MAX( bin, 0 ), nbins - 1 );
+            key = key * CV_BIG_UINT(1000003) + (uint64) bin;
+        }
+        key = ( key ^ ( key >> 31 ) ) * CV_BIG_UINT(0x9E3779B97F4A7C15) + 1;
+        if( key == 0 ) key = 1; // 0 marks an empty slot
 
-    cvParticleBound( p );
+        // open addressing
+        for( h = (int)( key >> 40 ) & mask; table[h] != 0 && table[h] != key; 
+             h = ( h + 1 ) & mask )
+            ;
+        if( table[h] == 0 )
+        {
+            table[h] = key;
+            occupied++;
+            required = icvParticleKLDBound( occupied, p->kld_epsilon, p->kld_z );
+        }
+    } while( count < p->max_particles && 
+             ( count < p->kld_min_particles || count < required ) );
+    return count;
 }
 
 /**
  * Re-samples a set of particles according to their weights to produce a
  * new set of unweighted particles
  *
- * Simply copy, not uniform randomly selects
+ * Particles are selected with the method set by cvParticleSetResample 
+ * in O(num_particles) and gathered into the preallocated buffer which is 
+ * swapped with "particles". Weights need not be normalized. 
+ * Weights are reset to uniform.
+ *
+ * With CV_PARTICLE_RESAMPLE_KLD, num_particles is changed to the number 
+ * of particles drawn (cvParticleSetNumParticles).
  *
  * @param particle
  */
 CVAPI(void) cvParticleResample( CvParticle* p )
 {
-    int i, j, np, k = 0;
-    CvMat* particle, hdr;
-    CvMat* new_particles = cvCreateMat( p->num_states, p->num_particles, p->particles->type );
-    double weight;
-    int max_loc;
+    int i, k, s, n = p->num_particles, num_new = n;
+    double* weights = p->weights->data.db;
+    double* cumweights = p->cumweights->data.db;
+    int* indices = p->indices->data.i;
+    double maxweight = 0, total = 0;
+    CvMat* tmp;
+    CV_FUNCNAME( "cvParticleResample" );
+    __BEGIN__;
+    CV_ASSERT( CV_MAT_TYPE( p->particles->type ) == CV_32FC1 );
 
-    k = 0;
-    for( i = 0; i < p->num_particles; i++ )
+    if( p->logweight )
+        cvMinMaxLoc( p->weights, NULL, &maxweight );
+    for( i = 0; i < n; i++ )
     {
-        particle = cvGetCol( p->particles, &hdr, i );
-        weight = cvmGet( p->weights, 0, i );
-        weight = p->logweight ? exp( weight ) : weight;
-        np = cvRound( weight * p->num_particles );
-        for( j = 0; j < np; j++ )
-        {
-            cvSetCol( particle, new_particles, k++ );
-            if( k == p->num_particles )
-                goto exit;
-        }
+        total += p->logweight ? exp( weights[i] - maxweight ) : weights[i];
+        cumweights[i] = total;
     }
 
-    max_loc = cvParticleGetMax( p );
-    particle = cvGetCol( p->particles, &hdr, max_loc );
-    while( k < p->num_particles )
-        cvSetCol( particle, new_particles, k++ );
+    if( p->resample == CV_PARTICLE_RESAMPLE_KLD && total > 0 )
+        num_new = icvParticleSelectKLD( p, cumweights, indices );
+    else
+        icvParticleSelectMethod( p->resample, cumweights, n, &p->rng, indices );
 
-exit:
-    cvReleaseMat( &p->particles );
-    p->particles = new_particles;
+    // gather row by row
+    for( s = 0; s < p->num_states; s++ )
+    {
+        const float* src = (const float*)( p->particles->data.ptr + s * p->particles->step );
+        float* dst = (float*)( p->new_particles->data.ptr + s * p->new_particles->step );
+        for( k = 0; k < num_new; k++ )
+            dst[k] = src[indices[k]];
+    }
+    tmp = p->particles;
+    p->particles = p->new_particles;
+    p->new_particles = tmp;
+    if( num_new != n )
+        CV_CALL( cvParticleSetNumParticles( p, num_new ) );
+
+    cvSet( p->weights, cvScalar( p->logweight ? -log( (double) num_new ) : 1.0 / num_new ) );
+    __END__;
+}
+
+/**
+ * Re-samples only when the effective sample size of the weights falls 
+ * below resample_threshold * num_particles
+ *
+ * If particles are not resampled, the weights are kept, thus the next 
+ * measurement must multiply its likelihoods into "weights" (add in log) 
+ * instead of overwriting them, as the observation models in cvparticle/ 
+ * do. Weights are uniform after cvParticleInit and resampling. 
+ *
+ * @param particle
+ * @return 1 if resampled, 0 otherwise
+ * @see cvParticleSetResampleThreshold
+ */
+CVAPI(int) cvParticleResampleAdaptive( CvParticle* p )
+{
+    p->ess = cvParticleGetEffectiveSize( p );
+    if( p->ess >= p->resample_threshold * p->num_particles && 
+        p->resample_threshold < 1 )
+        return 0;
+    cvParticleResample( p );
+    p->ess = p->num_particles;
+    return 1;
 }
 
 #endif
@@ -29,19 +29,82 @@
 #define CV_PARTICLE_OBSERVE_TEMPLATE_H
 
 #include "cvparticle.h"
+#include "observecommon.h"
 #include "cvrect32f.h"
-#include "cvcropimageroi.h"
+#include "cvcropresizeimageroi.h"
+#include "cvimagepyramid.h"
 using namespace std;
 
 /********************* Globals **********************************/
 int num_observes = 1;
 CvSize feature_size = cvSize(24, 24);
 
+/******************** Globals in this file **********************/
+const IplImage *observe_reference = NULL; // template being matched
+
 /******************** Function Prototypes **********************/
 #ifndef NO_DOXYGEN
+void cvParticleObserveFinalize();
+void icvObserveTemplateMeasure( const CvParticle* p, const IplImage* frame, 
+                                const int* ids, int num_ids, double* loglikelis );
 void cvParticleObserveMeasure( CvParticle* p, IplImage* cur_frame, IplImage *pre_frame );
 #endif
 
+/**
+ * Finalization
+ */
+void cvParticleObserveFinalize()
+{
+    icvObserveCommonFinalize();
+}
+
+/**
+ * Measure template matching log likelihoods of a subset of particles
+ *
+ * Particles are measured in parallel if OpenMP is enabled. Each thread 
+ * has its own patch image. Patches are cropped from an image pyramid of 
+ * the frame (see observe_pyramid) and compared with observe_reference. 
+ *
+ * @param particle
+ * @param frame
+ * @param ids         particle ids to measure
+ * @param num_ids     number of ids
+ * @param loglikelis  num_ids log likelihoods (output)
+ * @see CvParticleObserveFunc
+ */
+void icvObserveTemplateMeasure( const CvParticle* p, const IplImage* frame, 
+                                const int* ids, int num_ids, double* loglikelis )
+{
+    int k;
+    CvImagePyramid* pyramid = icvObserveCreatePyramid( frame, feature_size, 0 );
+#ifdef _OPENMP
+#pragma omp parallel
+#endif /* _OPENMP */
+    {
+        IplImage *resize;
+        resize = cvCreateImage( feature_size, frame->depth, frame->nChannels );
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif /* _OPENMP */
+        for( k = 0; k < num_ids; k++ ) 
+        {
+            CvParticleState s = cvParticleStateGet( p, ids[k] );
+            CvBox32f box32f = cvBox32f( s.x, s.y, s.width, s.height, s.angle );
+            CvRect32f rect32f = cvRect32fFromBox32f( box32f );
+
+            // crop and resize into feature size at once
+            cvCropResizeImagePyramidROI( pyramid, resize, rect32f );
+
+            // log likeli. kinds of Gaussian model
+            // exp( -d^2 / sigma^2 )
+            // sigma can be omitted because common param does not affect ML estimate
+            loglikelis[k] = -cvNorm( resize, observe_reference, CV_L2 ); 
+        }
+        cvReleaseImage( &resize );
+    }
+    cvReleaseImagePyramid( &pyramid );
+}
+
 /**
  * Measure and weight particles. 
  *
@@ -52,37 +115,18 @@ void cvParticleObserveMeasure( CvParticle* p, IplImage* cur_frame, IplImage *pre
  *
  * CvParticleState s must have s.x, s.y, s.width, s.height, s.angle
  *
+ * Duplicated particles (see observe_quantum) are measured once 
+ * (see icvObserveTemplateMeasure). Likelihoods are multiplied into the 
+ * weights (see icvObserveWeight).
+ *
  * @param particle
  * @param frame
  * @param reference
  */
 void cvParticleObserveMeasure( CvParticle* p, IplImage* frame, IplImage *reference )
 {
-    int i;
-    double likeli;
-    IplImage *patch;
-    IplImage *resize;
-    resize = cvCreateImage( feature_size, frame->depth, frame->nChannels );
-    for( i = 0; i < p->num_particles; i++ ) 
-    {
-        CvParticleState s = cvParticleStateGet( p, i );
-        CvBox32f box32f = cvBox32f( s.x, s.y, s.width, s.height, s.angle );
-        CvRect32f rect32f = cvRect32fFromBox32f( box32f );
-        CvRect rect = cvRectFromRect32f( rect32f );
-        
-        patch = cvCreateImage( cvSize(rect.width,rect.height), frame->depth, frame->nChannels );
-        cvCropImageROI( frame, patch, rect32f );
-        cvResize( patch, resize );
-
-        // log likeli. kinds of Gaussian model
-        // exp( -d^2 / sigma^2 )
-        // sigma can be omitted because common param does not affect ML estimate
-        likeli = -cvNorm( resize, reference, CV_L2 ); 
-        cvmSet( p->weights, 0, i, likeli );
-        
-        cvReleaseImage( &patch );
-    }
-    cvReleaseImage( &resize );
+    observe_reference = reference;
+    icvObserveUnique( p, frame, icvObserveTemplateMeasure );
 }
 
 #endif
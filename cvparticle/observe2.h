@@ -30,33 +30,18 @@
 #define CV_PARTICLE_OBSERVE_PCADIFFS_H
 
 #include "cvparticle.h"
-#include "cvrect32f.h"
-#include "cvcropimageroi.h"
-#include "cvpcadiffs.h"
-#include "cvgaussnorm.h"
-#include <iostream>
+#include "observecommon.h"
+#include "observepca.h"
 using namespace std;
 
 /********************************* Globals ******************************************/
 int    num_observes = 1;
-CvSize feature_size = cvSize(24, 24);
-string data_dir = "";
-string data_pcaval = "pcaval.xml";
-string data_pcavec = "pcavec.xml";
-string data_pcaavg = "pcaavg.xml";
-
-/******************************* Globals in this file ******************************/
-CvMat *eigenvalues;
-CvMat *eigenvectors;
-CvMat *eigenavg;
 
 /****************************** Function Prototypes ********************************/
 #ifndef NO_DOXYGEN
 void cvParticleObserveInitialize();
 void cvParticleObserveFinalize();
-void icvPreprocess( const IplImage* patch, CvMat *mat );
-void icvGetFeatures( const CvParticle* p, const IplImage* frame, CvMat* features );
-void cvParticleObserveMeasure( CvParticle* p, IplImage* cur_frame, IplImage *pre_frame );
+void cvParticleObserveMeasure( CvParticle* p, IplImage* frame );
 #endif
 
 /****************************** Functions ******************************************/
@@ -66,22 +51,7 @@ void cvParticleObserveMeasure( CvParticle* p, IplImage* cur_frame, IplImage *pre
  */
 void cvParticleObserveInitialize()
 {
-    string filename;
-    filename = data_dir + data_pcaval;
-    if( (eigenvalues = (CvMat*)cvLoad( filename.c_str() )) == NULL ) {
-        cerr << filename << " is not loadable." << endl << flush;
-        exit( 1 );
-    }
-    filename = data_dir + data_pcavec;
-    if( (eigenvectors = (CvMat*)cvLoad( filename.c_str() )) == NULL ) {
-        cerr << filename << " is not loadable." << endl << flush;
-        exit( 1 );
-    }
-    filename = data_dir + data_pcaavg;
-    if( (eigenavg = (CvMat*)cvLoad( filename.c_str() )) == NULL ) {
-        cerr << filename << " is not loadable." << endl << flush;
-        exit( 1 );
-    }
+    icvObservePcaInitialize();
 }
 
 /**
@@ -89,70 +59,8 @@ void cvParticleObserveInitialize()
  */
 void cvParticleObserveFinalize()
 {
-    cvReleaseMat( &eigenvalues );
-    cvReleaseMat( &eigenvectors );
-    cvReleaseMat( &eigenavg );
-}
-
-/**
- * Preprocess as did in training PCA subspace
- */
-void icvPreprocess( const IplImage* patch, CvMat *mat )
-{
-    IplImage *gry;
-    if( patch->nChannels != 1 ) {
-        gry = cvCreateImage( cvGetSize(patch), patch->depth, 1 );
-        cvCvtColor( patch, gry, CV_BGR2GRAY );
-    } else {
-        gry = (IplImage*)patch;
-    }
-    IplImage *resize = cvCreateImage( cvSize(mat->rows, mat->cols), patch->depth, 1 );
-
-    cvResize( gry, resize );
-    cvConvert( resize, mat );
-    cvImgGaussNorm( mat, mat );
-
-    cvReleaseImage( &resize );
-    if( gry != patch )
-        cvReleaseImage( &gry );
-}
-
-/**
- * Get observation features
- *
- * CvParticleState must have x, y, width, height, angle
- */
-void icvGetFeatures( const CvParticle* p, const IplImage* frame, CvMat* features )
-{
-    int feature_height = feature_size.height;
-    int feature_width  = feature_size.width;
-    //cvNamedWindow( "patch" );
-    CvMat* normed = cvCreateMat( feature_height, feature_width, CV_64FC1 );
-    CvMat* normedT = cvCreateMat( feature_width, feature_height, CV_64FC1 );
-    CvMat* feature, featurehdr;
-    IplImage *patch;
-    for( int n = 0; n < p->num_particles; n++ ) {
-        CvParticleState s = cvParticleStateGet( p, n );
-        CvBox32f box32f = cvBox32f( s.x, s.y, s.width, s.height, s.angle );
-        CvRect32f rect32f = cvRect32fFromBox32f( box32f );
-
-        // get image patch and preprocess
-        patch = cvCreateImage( cvSize( cvRound( s.width ), cvRound( s.height ) ), 
-                               frame->depth, frame->nChannels );
-        cvCropImageROI( (IplImage*)frame, patch, rect32f );
-        //cvShowImage( "patch", patch );
-        //cvWaitKey( 10 );
-        icvPreprocess( patch, normed );
-        cvReleaseImage( &patch );
-
-        // vectorize
-        cvT( normed, normedT ); // transpose to make the same with matlab's reshape
-        feature = cvReshape( normedT, &featurehdr, 1, feature_height * feature_width );
-
-        cvSetCol( feature, features, n );
-    }
-    cvReleaseMat( &normedT );
-    cvReleaseMat( &normed );
+    icvObservePcaFinalize();
+    icvObserveCommonFinalize();
 }
 
 /**
@@ -165,21 +73,14 @@ void icvGetFeatures( const CvParticle* p, const IplImage* frame, CvMat* features
  *
  * CvParticleState s must have s.x, s.y, s.width, s.height, s.angle
  *
+ * Duplicated particles (see observe_quantum) are measured once.
+ *
  * @param particle
  * @param frame
- * @param reference
  */
 void cvParticleObserveMeasure( CvParticle* p, IplImage* frame )
 {
-    int feature_height = feature_size.height;
-    int feature_width  = feature_size.width;
-
-    // extract features from particle states
-    CvMat* features = cvCreateMat( feature_height*feature_width, p->num_particles, CV_64FC1 );
-    icvGetFeatures( p, frame, features );
-    
-    // Likelihood measurments
-    cvMatPcaDiffs( features, eigenavg, eigenvalues, eigenvectors, p->weights, 0, TRUE);
+    icvObserveUnique( p, frame, icvObservePcaMeasure );
 }
 
 #endif
@@ -0,0 +1,88 @@
+/** @file
+ *
+ * Color histogram observation model for particle filter
+ * CvParticleState s must have s.x, s.y, s.width, s.height, s.angle
+ */
+/* The MIT License
+ *
+ * Copyright (c) 2008, Naotoshi Seo <sonots(at)sonots.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CV_PARTICLE_OBSERVE_HISTOGRAM_H
+#define CV_PARTICLE_OBSERVE_HISTOGRAM_H
+
+#include "cvparticle.h"
+#include "observecommon.h"
+#include "observehist.h"
+using namespace std;
+
+/********************************* Globals ******************************************/
+int    num_observes = 1;
+
+/****************************** Function Prototypes ********************************/
+#ifndef NO_DOXYGEN
+void cvParticleObserveInitialize( const IplImage* frame, CvBox32f box );
+void cvParticleObserveFinalize();
+void cvParticleObserveMeasure( CvParticle* p, IplImage* frame );
+#endif
+
+/****************************** Functions ******************************************/
+
+/**
+ * Initialization
+ *
+ * @param frame  The first frame, 8U
+ * @param box    The target region in the first frame
+ */
+void cvParticleObserveInitialize( const IplImage* frame, CvBox32f box )
+{
+    icvObserveHistInitialize( frame, box );
+}
+
+/**
+ * Finalization
+ */
+void cvParticleObserveFinalize()
+{
+    icvObserveHistFinalize();
+    icvObserveCommonFinalize();
+}
+
+/**
+ * Measure and weight particles. 
+ *
+ * The proposal function q is set p(xt|xt-1) in SIR/Condensation, and it results 
+ * that "weights" are set to be proportional to the likelihood probability 
+ * (Normalize later).
+ * Rewrite here if you want to use a different proposal function q. 
+ *
+ * CvParticleState s must have s.x, s.y, s.width, s.height, s.angle
+ *
+ * Duplicated particles (see observe_quantum) are measured once.
+ *
+ * @param particle
+ * @param frame    8U image of the same number of channels as the first frame
+ */
+void cvParticleObserveMeasure( CvParticle* p, IplImage* frame )
+{
+    icvObserveUnique( p, frame, icvObserveHistMeasure );
+}
+
+#endif
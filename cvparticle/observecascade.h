@@ -0,0 +1,185 @@
+/** @file
+ *
+ * Two-tier cascade of observation models for particle filter
+ */
+/* The MIT License
+ * 
+ * Copyright (c) 2008, Naotoshi Seo <sonots(at)sonots.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CV_PARTICLE_OBSERVE_CASCADE_H
+#define CV_PARTICLE_OBSERVE_CASCADE_H
+
+#include "cvparticle.h"
+#include "observecommon.h"
+#include <stdlib.h>
+#include <float.h>
+
+/** Cheap log likelihood and its index, to rank particles */
+typedef struct CvObserveRank {
+    double loglikeli;
+    int index;
+} CvObserveRank;
+
+/******************************* Globals in this file ******************************/
+int            cascade_capacity = 0;         // number of particles the buffers below hold
+CvObserveRank *cascade_ranks = NULL;         // particles ranked by cheap log likelihoods
+int           *cascade_ids = NULL;           // ids of survivors
+double        *cascade_loglikelis = NULL;    // expensive log likelihoods of survivors
+
+/****************************** Function Prototypes ********************************/
+#ifndef NO_DOXYGEN
+void icvObserveCascadeReserve( int num_ids );
+void icvObserveCascadeFinalize();
+int icvObserveCascade( const CvParticle* p, const IplImage* frame, 
+                       const int* ids, int num_ids, 
+                       CvParticleObserveFunc cheap, CvParticleObserveFunc expensive, 
+                       double ratio, double threshold, double* loglikelis );
+#endif
+
+/****************************** Functions ******************************************/
+
+/**
+ * Grow the buffers kept across frames to hold num_ids particles
+ *
+ * @param num_ids
+ */
+void icvObserveCascadeReserve( int num_ids )
+{
+    if( cascade_capacity >= num_ids )
+        return;
+    icvObserveCascadeFinalize();
+    cascade_capacity   = num_ids;
+    cascade_ranks      = (CvObserveRank*) cvAlloc( cascade_capacity * sizeof( CvObserveRank ) );
+    cascade_ids        = (int*) cvAlloc( cascade_capacity * sizeof( int ) );
+    cascade_loglikelis = (double*) cvAlloc( cascade_capacity * sizeof( double ) );
+}
+
+/**
+ * Release the buffers kept across frames
+ */
+void icvObserveCascadeFinalize()
+{
+    if( cascade_capacity == 0 )
+        return;
+    cvFree( &cascade_ranks );
+    cvFree( &cascade_ids );
+    cvFree( &cascade_loglikelis );
+    cascade_capacity = 0;
+}
+
+CV_INLINE int icvObserveRankCmp( const void* _a, const void* _b )
+{
+    const CvObserveRank* a = (const CvObserveRank*)_a;
+    const CvObserveRank* b = (const CvObserveRank*)_b;
+    return ( a->loglikeli < b->loglikeli ) - ( a->loglikeli > b->loglikeli ); // descending
+}
+
+/**
+ * Measure particles with a cheap model, then an expensive model on survivors
+ *
+ * All particles are measured with the cheap model, and the top ratio of 
+ * them and those whose cheap log likelihoods are threshold or more are 
+ * measured with the expensive model. The other particles get a fallback 
+ * log likelihood calibrated to the expensive model, a * cheap + b fitted
+ * by least squares on the survivors (a > 0), but not more than the least
+ * expensive log likelihood of the survivors, so that rejected particles 
+ * never outweigh survivors. Without a usable slope (one survivor, flat or 
+ * negative correlation), rejected particles get the least survivor log 
+ * likelihood minus the spread of survivors (at least 1) and minus log of 
+ * the number of rejected particles, so that all of them together weigh 
+ * less than the least survivor. If no particle survives, the cheap log 
+ * likelihoods are left as they are.
+ *
+ * The buffers are kept across frames (see icvObserveCascadeReserve),
+ * release them with icvObserveCascadeFinalize.
+ *
+ * @param particle
+ * @param frame
+ * @param ids         particle ids to measure
+ * @param num_ids     number of ids
+ * @param cheap       cheap measurement applied to all particles
+ * @param expensive   expensive measurement applied to survivors
+ * @param ratio       ratio of particles to survive in [0, 1]
+ * @param threshold   particles whose cheap log likelihoods are this or more
+ *                    survive too. DBL_MAX to disable
+ * @param loglikelis  num_ids log likelihoods (output)
+ * @return int        number of survivors
+ */
+int icvObserveCascade( const CvParticle* p, const IplImage* frame, 
+                       const int* ids, int num_ids, 
+                       CvParticleObserveFunc cheap, CvParticleObserveFunc expensive, 
+                       double ratio, double threshold, double* loglikelis )
+{
+    int n, num_keep, num_survivors;
+    double sx = 0, sy = 0, sxx = 0, sxy = 0, var, a = 0, b;
+    double miny = DBL_MAX, maxy = -DBL_MAX;
+    CvObserveRank* rank;
+    int* survivor_ids;
+    double* survivor_loglikelis;
+    icvObserveCascadeReserve( num_ids );
+    rank = cascade_ranks;
+    survivor_ids = cascade_ids;
+    survivor_loglikelis = cascade_loglikelis;
+
+    // cheap model on all, ranked
+    cheap( p, frame, ids, num_ids, loglikelis );
+    for( n = 0; n < num_ids; n++ )
+    {
+        rank[n].loglikeli = loglikelis[n];
+        rank[n].index = n;
+    }
+    qsort( rank, num_ids, sizeof( CvObserveRank ), icvObserveRankCmp );
+    num_keep = MIN( cvCeil( ratio * num_ids ), num_ids );
+    for( num_survivors = 0; num_survivors < num_ids; num_survivors++ )
+    {
+        if( num_survivors >= num_keep && rank[num_survivors].loglikeli < threshold ) break;
+        survivor_ids[num_survivors] = ids[rank[num_survivors].index];
+    }
+
+    // expensive model on survivors
+    if( num_survivors > 0 )
+        expensive( p, frame, survivor_ids, num_survivors, survivor_loglikelis );
+
+    // calibrate the cheap model into the expensive one
+    for( n = 0; n < num_survivors; n++ )
+    {
+        double x = rank[n].loglikeli, y = survivor_loglikelis[n];
+        sx += x; sy += y; sxx += x * x; sxy += x * y;
+        miny = MIN( miny, y );
+        maxy = MAX( maxy, y );
+    }
+    if( num_survivors > 0 )
+    {
+        var = sxx - sx * sx / num_survivors;
+        if( num_survivors >= 2 && var > DBL_EPSILON * sxx )
+            a = MAX( ( sxy - sx * sy / num_survivors ) / var, 0 );
+        b = ( sy - a * sx ) / num_survivors;
+        if( a <= 0 && num_survivors < num_ids ) // no slope, below the least survivor
+            b = miny - MAX( maxy - miny, 1.0 ) - log( (double)( num_ids - num_survivors ) );
+        for( n = num_survivors; n < num_ids; n++ )
+            loglikelis[rank[n].index] = MIN( a * rank[n].loglikeli + b, miny );
+        for( n = 0; n < num_survivors; n++ )
+            loglikelis[rank[n].index] = survivor_loglikelis[n];
+    }
+    return num_survivors;
+}
+
+#endif
@@ -0,0 +1,228 @@
+/** @file
+ *
+ * Common functions of observation models for particle filter
+ */
+/* The MIT License
+ * 
+ * Copyright (c) 2008, Naotoshi Seo <sonots(at)sonots.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CV_PARTICLE_OBSERVE_COMMON_H
+#define CV_PARTICLE_OBSERVE_COMMON_H
+
+#include "cvparticle.h"
+#include "cvimagepyramid.h"
+
+/********************************* Globals ******************************************/
+double observe_quantum = 1.0; // particles whose states are equal in this 
+                              // quantization share a likelihood. 0 to disable
+int    observe_pyramid = 1;   // crop particles from a Gaussian pyramid of the
+                              // frame built once per frame. 0 to disable
+
+/******************************* Globals in this file ******************************/
+CvMat  *observe_quantums = NULL;   // num_states x 1 quantum of each state
+int     observe_capacity = 0;      // number of particles the buffers below hold
+int    *observe_origins = NULL;    // origins of duplicated particles
+int    *observe_columns = NULL;    // index of each unique particle in observe_ids
+int    *observe_ids = NULL;        // ids of unique particles
+double *observe_loglikelis = NULL; // log likelihoods of unique particles
+
+/**
+ * Measure log likelihoods of a subset of particles
+ *
+ * @param particle
+ * @param frame
+ * @param ids         particle ids to measure
+ * @param num_ids     number of ids
+ * @param loglikelis  num_ids log likelihoods (output)
+ */
+typedef void (*CvParticleObserveFunc)( const CvParticle* p, const IplImage* frame, 
+                                       const int* ids, int num_ids, double* loglikelis );
+
+/****************************** Function Prototypes ********************************/
+#ifndef NO_DOXYGEN
+int icvObserveFindDuplicates( CvParticle* p, CvMat* origins );
+void icvObserveReserve( const CvParticle* p );
+void icvObserveCommonFinalize();
+void icvObserveWeight( CvParticle* p, int i, double loglikeli );
+void icvObserveUnique( CvParticle* p, const IplImage* frame, CvParticleObserveFunc measure );
+int icvObservePyramidLevels( const IplImage* frame, CvSize feature_size );
+CvImagePyramid* icvObserveCreatePyramid( const IplImage* frame, CvSize feature_size, int flags );
+#endif
+
+/****************************** Functions ******************************************/
+
+/**
+ * Find particles sharing a likelihood
+ *
+ * x, y, width, height and angle (the first 5 states) are quantized by 
+ * observe_quantum, the other states are ignored. The quantum matrix is 
+ * kept across frames.
+ *
+ * @param particle
+ * @param origins   1 x num_particles, CV_32SC1. See cvParticleFindDuplicates
+ * @return number of unique particles
+ */
+int icvObserveFindDuplicates( CvParticle* p, CvMat* origins )
+{
+    int i;
+    if( observe_quantum <= 0 )
+    {
+        for( i = 0; i < p->num_particles; i++ )
+            origins->data.i[i] = i;
+        return p->num_particles;
+    }
+    if( observe_quantums == NULL || observe_quantums->rows != p->num_states )
+    {
+        if( observe_quantums != NULL )
+            cvReleaseMat( &observe_quantums );
+        observe_quantums = cvCreateMat( p->num_states, 1, CV_64FC1 );
+    }
+    cvZero( observe_quantums );
+    for( i = 0; i < MIN( 5, p->num_states ); i++ )
+        cvmSet( observe_quantums, i, 0, observe_quantum );
+    return cvParticleFindDuplicates( p, observe_quantums, origins );
+}
+
+/**
+ * Make the buffers of icvObserveUnique hold max_particles particles
+ *
+ * The buffers are kept across frames and only grow.
+ *
+ * @param particle
+ */
+void icvObserveReserve( const CvParticle* p )
+{
+    if( observe_capacity >= p->max_particles )
+        return;
+    icvObserveCommonFinalize();
+    observe_capacity   = p->max_particles;
+    observe_origins    = (int*) cvAlloc( observe_capacity * sizeof( int ) );
+    observe_columns    = (int*) cvAlloc( observe_capacity * sizeof( int ) );
+    observe_ids        = (int*) cvAlloc( observe_capacity * sizeof( int ) );
+    observe_loglikelis = (double*) cvAlloc( observe_capacity * sizeof( double ) );
+}
+
+/**
+ * Release the buffers kept across frames
+ */
+void icvObserveCommonFinalize()
+{
+    if( observe_quantums != NULL )
+        cvReleaseMat( &observe_quantums );
+    if( observe_capacity == 0 )
+        return;
+    cvFree( &observe_origins );
+    cvFree( &observe_columns );
+    cvFree( &observe_ids );
+    cvFree( &observe_loglikelis );
+    observe_capacity = 0;
+}
+
+/**
+ * Multiply a likelihood into the weight of a particle
+ *
+ * Likelihoods are accumulated instead of overwriting the weights, because 
+ * the weights are kept when cvParticleResampleAdaptive skips resampling 
+ * (and are uniform after resampling). 
+ *
+ * @param particle
+ * @param i         particle id
+ * @param loglikeli log likelihood
+ */
+void icvObserveWeight( CvParticle* p, int i, double loglikeli )
+{
+    double w = cvmGet( p->weights, 0, i );
+    cvmSet( p->weights, 0, i, p->logweight ? w + loglikeli : w * exp( loglikeli ) );
+}
+
+/**
+ * Weight particles by measuring unique particles only
+ *
+ * Duplicated particles (see observe_quantum) are measured once and
+ * share the log likelihood. The likelihoods are multiplied into the 
+ * weights (see icvObserveWeight). The buffers are kept across frames 
+ * (see icvObserveReserve), release them with icvObserveCommonFinalize.
+ *
+ * @param particle
+ * @param frame
+ * @param measure   measurement of log likelihoods of a subset of particles
+ */
+void icvObserveUnique( CvParticle* p, const IplImage* frame, CvParticleObserveFunc measure )
+{
+    int i, num_unique;
+    CvMat origins;
+    icvObserveReserve( p );
+    cvInitMatHeader( &origins, 1, p->num_particles, CV_32SC1, observe_origins );
+
+    icvObserveFindDuplicates( p, &origins );
+    for( i = 0, num_unique = 0; i < p->num_particles; i++ )
+    {
+        if( observe_origins[i] != i ) continue;
+        observe_columns[i] = num_unique;
+        observe_ids[num_unique++] = i;
+    }
+
+    measure( p, frame, observe_ids, num_unique, observe_loglikelis );
+    for( i = 0; i < p->num_particles; i++ )
+    {
+        icvObserveWeight( p, i, observe_loglikelis[observe_columns[observe_origins[i]]] );
+    }
+}
+
+/**
+ * Number of levels of the image pyramid to crop particles from
+ *
+ * Levels are added while they are at least as large as feature_size, 
+ * so that every particle larger than feature_size is cropped from a level 
+ * where it is about feature_size and reads a constant number of pixels. 
+ * With observe_pyramid = 0, the pyramid has only the frame itself.
+ *
+ * @param frame
+ * @param feature_size  size of cropped patches
+ * @return number of levels including the frame
+ */
+int icvObservePyramidLevels( const IplImage* frame, CvSize feature_size )
+{
+    int levels = 1;
+    if( observe_pyramid )
+    {
+        while( ( frame->width >> levels ) >= feature_size.width &&
+               ( frame->height >> levels ) >= feature_size.height )
+            levels++;
+    }
+    return levels;
+}
+
+/**
+ * Create the image pyramid of a frame to crop particles from
+ *
+ * @param frame
+ * @param feature_size  size of cropped patches
+ * @param flags         CV_CROPRESIZE_GRAY to convert the frame into gray once
+ * @return pyramid. Release with cvReleaseImagePyramid
+ * @see icvObservePyramidLevels
+ */
+CvImagePyramid* icvObserveCreatePyramid( const IplImage* frame, CvSize feature_size, int flags )
+{
+    return cvCreateImagePyramid( frame, icvObservePyramidLevels( frame, feature_size ), flags );
+}
+
+#endif
@@ -0,0 +1,304 @@
+/** @file
+ *
+ * Color histogram (Bhattacharyya) likelihood for particle filter, 
+ * shared by observation models
+ * CvParticleState s must have s.x, s.y, s.width, s.height, s.angle
+ */
+/* The MIT License
+ *
+ * Copyright (c) 2008, Naotoshi Seo <sonots(at)sonots.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CV_PARTICLE_OBSERVE_HIST_H
+#define CV_PARTICLE_OBSERVE_HIST_H
+
+#include "cvparticle.h"
+#include "cvrect32f.h"
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <iostream>
+using namespace std;
+
+/********************************* Globals ******************************************/
+int    hist_bins = 4;         // number of bins per channel
+int    hist_cell = 2;         // the integral histogram is sampled every
+                              // hist_cell pixels to save memory
+double hist_lambda = 20.0;    // likelihood is exp( -hist_lambda * d^2 ) where
+                              // d is the Bhattacharyya distance
+
+/******************************* Globals in this file ******************************/
+CvMat *reference_hist = NULL; // 1 x bins normalized histogram of the target
+CvMat *integral_hist = NULL;  // (rows+1) x (cols+1)*bins integral histogram
+                              // of the current frame on the cell grid
+int   *integral_counts = NULL; // cols*bins pixel counts of a row of cells,
+                               // reallocated with integral_hist
+
+/****************************** Function Prototypes ********************************/
+#ifndef NO_DOXYGEN
+void icvObserveHistInitialize( const IplImage* frame, CvBox32f box );
+void icvObserveHistFinalize();
+int icvHistNumBins( const IplImage* frame );
+void icvBuildIntegralHistogram( const IplImage* frame );
+CvBox32f icvInscribedBox( CvBox32f box );
+bool icvBoxHistogram( CvBox32f box, double* hist );
+void icvObserveHistMeasure( const CvParticle* p, const IplImage* frame, 
+                            const int* ids, int num_ids, double* loglikelis );
+#endif
+
+/****************************** Functions ******************************************/
+
+/**
+ * Take the reference histogram
+ *
+ * @param frame  The first frame, 8U
+ * @param box    The target region in the first frame
+ */
+void icvObserveHistInitialize( const IplImage* frame, CvBox32f box )
+{
+    reference_hist = cvCreateMat( 1, icvHistNumBins( frame ), CV_64FC1 );
+    icvBuildIntegralHistogram( frame );
+    if( !icvBoxHistogram( box, reference_hist->data.db ) ) {
+        cerr << "The target region is out of the frame." << endl << flush;
+        exit( 1 );
+    }
+}
+
+/**
+ * Release the histograms
+ */
+void icvObserveHistFinalize()
+{
+    cvReleaseMat( &reference_hist );
+    if( integral_hist != NULL )
+        cvReleaseMat( &integral_hist );
+    if( integral_counts != NULL )
+        cvFree( &integral_counts );
+}
+
+/**
+ * Number of histogram bins, hist_bins ^ nChannels
+ *
+ * @param frame
+ * @return int
+ */
+int icvHistNumBins( const IplImage* frame )
+{
+    int c, num_bins = 1;
+    for( c = 0; c < frame->nChannels; c++ )
+        num_bins *= hist_bins;
+    return num_bins;
+}
+
+/**
+ * Build the integral histogram of a frame into integral_hist
+ *
+ * Element (y, x * bins + b) is the number of pixels of bin b in the
+ * cells above and left of the cell grid point (x, y), so that the
+ * histogram of any cell aligned rectangle is obtained with 4 lookups
+ * per bin.
+ *
+ * @param frame  8U image of the same number of channels as the frame
+ *               of the reference histogram, if taken
+ */
+void icvBuildIntegralHistogram( const IplImage* frame )
+{
+    int num_bins = icvHistNumBins( frame );
+    int cn = frame->nChannels;
+    int grid_width = ( frame->width + hist_cell - 1 ) / hist_cell;
+    int grid_height = ( frame->height + hist_cell - 1 ) / hist_cell;
+    int x, y, c, b, gx, gy, bin;
+    int *counts, *row, *above;
+    const uchar* pix;
+    CV_FUNCNAME( "icvBuildIntegralHistogram" );
+    __BEGIN__;
+    CV_ASSERT( frame->depth == IPL_DEPTH_8U );
+    // the same channels as the frame the reference histogram was taken from
+    CV_ASSERT( reference_hist == NULL || reference_hist->cols == num_bins );
+    if( integral_hist == NULL ||
+        integral_hist->rows != grid_height + 1 ||
+        integral_hist->cols != ( grid_width + 1 ) * num_bins )
+    {
+        if( integral_hist != NULL )
+            cvReleaseMat( &integral_hist );
+        if( integral_counts != NULL )
+            cvFree( &integral_counts );
+        integral_hist = cvCreateMat( grid_height + 1, ( grid_width + 1 ) * num_bins, CV_32SC1 );
+        integral_counts = (int*) cvAlloc( grid_width * num_bins * sizeof( int ) );
+    }
+    cvZero( integral_hist );
+    counts = integral_counts;
+
+    for( gy = 0; gy < grid_height; gy++ )
+    {
+        // pixel counts of the cells in this row of the grid
+        memset( counts, 0, grid_width * num_bins * sizeof( int ) );
+        for( y = gy * hist_cell; y < MIN( ( gy + 1 ) * hist_cell, frame->height ); y++ )
+        {
+            pix = (const uchar*)frame->imageData + y * frame->widthStep;
+            for( x = 0; x < frame->width; x++, pix += cn )
+            {
+                for( c = cn - 1, bin = 0; c >= 0; c-- )
+                    bin = bin * hist_bins + ( pix[c] * hist_bins >> 8 );
+                counts[( x / hist_cell ) * num_bins + bin]++;
+            }
+        }
+
+        // accumulate along the row and add the row above
+        above = integral_hist->data.i + gy * ( integral_hist->step / sizeof( int ) );
+        row = above + integral_hist->step / sizeof( int );
+        for( gx = 0; gx < grid_width; gx++ )
+        {
+            for( b = 0; b < num_bins; b++ )
+            {
+                row[( gx + 1 ) * num_bins + b] = row[gx * num_bins + b] +
+                    counts[gx * num_bins + b];
+            }
+        }
+        for( gx = 1; gx <= grid_width; gx++ )
+        {
+            for( b = 0; b < num_bins; b++ )
+                row[gx * num_bins + b] += above[gx * num_bins + b];
+        }
+    }
+    __END__;
+}
+
+/**
+ * The largest axis aligned box inscribed in a rotated box
+ *
+ * @param box
+ * @return CvBox32f  The axis aligned box sharing the center
+ */
+CvBox32f icvInscribedBox( CvBox32f box )
+{
+    double w = box.width, h = box.height, wr, hr, half;
+    double sin_a = fabs( sin( box.angle * M_PI / 180.0 ) );
+    double cos_a = fabs( cos( box.angle * M_PI / 180.0 ) );
+    double side_long = MAX( w, h ), side_short = MIN( w, h );
+    if( sin_a < 1e-6 ) return cvBox32f( box.cx, box.cy, w, h );
+    if( cos_a < 1e-6 ) return cvBox32f( box.cx, box.cy, h, w );
+    if( side_short <= 2.0 * sin_a * cos_a * side_long || fabs( sin_a - cos_a ) < 1e-10 )
+    {
+        // touches the long sides only
+        half = 0.5 * side_short;
+        if( w >= h ) { wr = half / sin_a; hr = half / cos_a; }
+        else         { wr = half / cos_a; hr = half / sin_a; }
+    }
+    else
+    {
+        double cos_2a = cos_a * cos_a - sin_a * sin_a;
+        wr = ( w * cos_a - h * sin_a ) / cos_2a;
+        hr = ( h * cos_a - w * sin_a ) / cos_2a;
+    }
+    return cvBox32f( box.cx, box.cy, (float)wr, (float)hr );
+}
+
+/**
+ * Normalized histogram of a box from integral_hist in O(bins)
+ *
+ * A rotated box is approximated by its inscribed axis aligned box,
+ * and the box is rounded to the cell grid.
+ *
+ * @param box
+ * @param hist  bins, output
+ * @return false if the box does not cover any cell
+ */
+bool icvBoxHistogram( CvBox32f box, double* hist )
+{
+    int num_bins = reference_hist->cols;
+    int grid_width = integral_hist->cols / num_bins - 1;
+    int grid_height = integral_hist->rows - 1;
+    int stride = integral_hist->step / sizeof( int );
+    int b, x1, x2, y1, y2;
+    double total = 0;
+    const int *top, *bottom;
+    CvBox32f inscribed = icvInscribedBox( box );
+    x1 = cvRound( ( inscribed.cx - inscribed.width / 2 ) / hist_cell );
+    x2 = cvRound( ( inscribed.cx + inscribed.width / 2 ) / hist_cell );
+    y1 = cvRound( ( inscribed.cy - inscribed.height / 2 ) / hist_cell );
+    y2 = cvRound( ( inscribed.cy + inscribed.height / 2 ) / hist_cell );
+    x1 = MIN( MAX( x1, 0 ), grid_width ); x2 = MIN( MAX( x2, 0 ), grid_width );
+    y1 = MIN( MAX( y1, 0 ), grid_height ); y2 = MIN( MAX( y2, 0 ), grid_height );
+    if( x2 <= x1 || y2 <= y1 ) return false;
+
+    top = integral_hist->data.i + y1 * stride;
+    bottom = integral_hist->data.i + y2 * stride;
+    for( b = 0; b < num_bins; b++ )
+    {
+        hist[b] = bottom[x2 * num_bins + b] - bottom[x1 * num_bins + b] -
+            top[x2 * num_bins + b] + top[x1 * num_bins + b];
+        total += hist[b];
+    }
+    for( b = 0; b < num_bins; b++ )
+        hist[b] /= total;
+    return true;
+}
+
+/**
+ * Measure color histogram log likelihoods of particles
+ *
+ * The integral histogram of the frame is built once, then each particle
+ * costs O(bins) regardless of its size. Particles are measured in 
+ * parallel if OpenMP is enabled.
+ *
+ * CvParticleState s must have s.x, s.y, s.width, s.height, s.angle
+ *
+ * @param particle
+ * @param frame       8U image of the same number of channels as the first frame
+ * @param ids         particle ids to measure
+ * @param num_ids     number of ids
+ * @param loglikelis  num_ids log likelihoods (output)
+ */
+void icvObserveHistMeasure( const CvParticle* p, const IplImage* frame, 
+                            const int* ids, int num_ids, double* loglikelis )
+{
+    int n;
+    int num_bins = reference_hist->cols;
+    const double* reference = reference_hist->data.db;
+    icvBuildIntegralHistogram( frame );
+#ifdef _OPENMP
+#pragma omp parallel
+#endif /* _OPENMP */
+    {
+        int b;
+        double coeff;
+        double *hist = (double*) cvAlloc( num_bins * sizeof( double ) );
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif /* _OPENMP */
+        for( n = 0; n < num_ids; n++ ) 
+        {
+            CvParticleState s = cvParticleStateGet( p, ids[n] );
+            CvBox32f box32f = cvBox32f( s.x, s.y, s.width, s.height, s.angle );
+
+            // log likeli. exp( -lambda * d^2 ) where d^2 = 1 - Bhattacharyya coefficient
+            coeff = 0;
+            if( icvBoxHistogram( box32f, hist ) )
+            {
+                for( b = 0; b < num_bins; b++ )
+                    coeff += sqrt( hist[b] * reference[b] );
+            }
+            loglikelis[n] = -hist_lambda * ( 1.0 - coeff );
+        }
+        cvFree( &hist );
+    }
+}
+
+#endif
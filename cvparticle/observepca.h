@@ -0,0 +1,292 @@
+/** @file
+ * 
+ * Moghaddam's PCA DIFS + DFFS (distance-in-feature-space + distance-from-feature-space) 
+ * likelihood for particle filter, shared by observation models
+ * CvParticleState must have x, y, width, height, and angle
+ */
+/* The MIT License
+ * 
+ * Copyright (c) 2008, Naotoshi Seo <sonots(at)sonots.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CV_PARTICLE_OBSERVE_PCA_H
+#define CV_PARTICLE_OBSERVE_PCA_H
+
+#include "cvparticle.h"
+#include "observecommon.h"
+#include "cvrect32f.h"
+#include "cvcropresizeimageroi.h"
+#include "cvimagepyramid.h"
+#include "cvpcamodel.h"
+#include <iostream>
+using namespace std;
+
+/********************************* Globals ******************************************/
+CvSize feature_size = cvSize(24, 24);
+double observe_margin = 0;    // stop scoring particles less likely than the best
+                              // by this log likelihood margin. 0 to disable
+string data_dir = "";
+string data_pcaval = "pcaval.xml";
+string data_pcavec = "pcavec.xml";
+string data_pcaavg = "pcaavg.xml";
+double pca_num_samples = 0;   // number of samples the subspace was trained with.
+                              // cvParticleObserveUpdate adapts it if > 0
+double pca_forget = 0.95;     // forgetting factor of the subspace update
+int    pca_batch = 5;         // number of frames folded into the subspace at once
+
+/******************************* Globals in this file ******************************/
+CvMat *eigenvalues;
+CvMat *eigenvectors;
+CvMat *eigenavg;
+CvPcaModel *pcamodel; // subspace quantities cached over frames
+CvMat *update_features = NULL; // features waiting for the subspace update
+int num_update_features = 0;
+
+/****************************** Function Prototypes ********************************/
+#ifndef NO_DOXYGEN
+void icvObservePcaInitialize();
+void icvObservePcaFinalize();
+void icvNormalizeFeature( CvMat* feature );
+void icvGetFeatures( const CvParticle* p, const IplImage* frame, CvMat* features, 
+                     const int* ids = NULL );
+void icvGetFeature( const CvParticle* p, const IplImage* frame, CvMat* feature, int id );
+void icvObservePcaMeasure( const CvParticle* p, const IplImage* frame, 
+                           const int* ids, int num_ids, double* loglikelis );
+void cvParticleObserveUpdate( const CvParticle* p, const IplImage* frame );
+#endif
+
+/****************************** Functions ******************************************/
+
+/**
+ * Load the PCA subspace
+ */
+void icvObservePcaInitialize()
+{
+    string filename;
+    filename = data_dir + data_pcaval;
+    if( (eigenvalues = (CvMat*)cvLoad( filename.c_str() )) == NULL ) {
+        cerr << filename << " is not loadable." << endl << flush;
+        exit( 1 );
+    }
+    filename = data_dir + data_pcavec;
+    if( (eigenvectors = (CvMat*)cvLoad( filename.c_str() )) == NULL ) {
+        cerr << filename << " is not loadable." << endl << flush;
+        exit( 1 );
+    }
+    filename = data_dir + data_pcaavg;
+    if( (eigenavg = (CvMat*)cvLoad( filename.c_str() )) == NULL ) {
+        cerr << filename << " is not loadable." << endl << flush;
+        exit( 1 );
+    }
+    pcamodel = cvCreatePcaModel( eigenavg, eigenvalues, eigenvectors, CV_64FC1, 
+                                 pca_num_samples );
+}
+
+/**
+ * Release the PCA subspace
+ */
+void icvObservePcaFinalize()
+{
+    cvReleaseMat( &eigenvalues );
+    cvReleaseMat( &eigenvectors );
+    cvReleaseMat( &eigenavg );
+    cvReleasePcaModel( &pcamodel );
+    if( update_features != NULL )
+        cvReleaseMat( &update_features );
+}
+
+/**
+ * Normalize a feature to zero mean and unit variance in place
+ *
+ * A flat patch has no variance to normalize and becomes the zero vector.
+ *
+ * @param feature  D x 1
+ */
+void icvNormalizeFeature( CvMat* feature )
+{
+    CvScalar mean, std;
+    cvAvgSdv( feature, &mean, &std );
+    if( std.val[0] == 0 )
+        cvZero( feature );
+    else
+        cvConvertScale( feature, feature, 1.0 / std.val[0], -mean.val[0] / std.val[0] );
+}
+
+/**
+ * Get observation features
+ *
+ * CvParticleState must have x, y, width, height, angle
+ *
+ * Particles are processed in parallel if OpenMP is enabled. Each particle 
+ * is written straight into its own column, so no workspace is shared.
+ * The frame is converted into gray and its image pyramid is built once 
+ * here, and each particle is cropped from the level of its scale 
+ * (see observe_pyramid).
+ *
+ * @param particle
+ * @param frame
+ * @param features  D x (number of ids or num_particles)
+ * @param ids       particle id of each column. NULL for all particles
+ */
+void icvGetFeatures( const CvParticle* p, const IplImage* frame, CvMat* features, 
+                     const int* ids )
+{
+    int feature_height = feature_size.height;
+    int feature_width  = feature_size.width;
+    int n;
+    CvImagePyramid* pyramid = icvObserveCreatePyramid( frame, feature_size, CV_CROPRESIZE_GRAY );
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16)
+#endif /* _OPENMP */
+    for( n = 0; n < features->cols; n++ ) {
+        CvMat feature;
+        CvParticleState s = cvParticleStateGet( p, ids ? ids[n] : n );
+        CvBox32f box32f = cvBox32f( s.x, s.y, s.width, s.height, s.angle );
+        CvRect32f rect32f = cvRect32fFromBox32f( box32f );
+
+        // crop, resize and convert to gray straight into the column, 
+        // transposed to make the same with matlab's reshape
+        cvGetCol( features, &feature, n );
+        cvCropResizeImagePyramidROI( pyramid, &feature, rect32f, 
+                                     cvSize( feature_width, feature_height ), 
+                                     CV_CROPRESIZE_GRAY | CV_CROPRESIZE_TRANSPOSE );
+
+        icvNormalizeFeature( &feature );
+    }
+    cvReleaseImagePyramid( &pyramid );
+}
+
+/**
+ * Get the observation feature of a particle
+ *
+ * Same with a column of icvGetFeatures (up to the borders of the patch), 
+ * without building the pyramid of the whole frame. Only the region of 
+ * the particle is cropped, at 2^level times feature_size, and reduced by 
+ * cvPyrDown to the pyramid level icvGetFeatures would crop it from.
+ * The patch is cropped in gray and transposed as icvGetFeatures does, 
+ * which cvPyrDown keeps because its filter is symmetric.
+ *
+ * @param particle
+ * @param frame
+ * @param feature   D x 1
+ * @param id        particle id
+ */
+void icvGetFeature( const CvParticle* p, const IplImage* frame, CvMat* feature, int id )
+{
+    int feature_height = feature_size.height;
+    int feature_width  = feature_size.width;
+    int level, l;
+    CvMat *patch, *half, vec;
+    CvParticleState s = cvParticleStateGet( p, id );
+    CvBox32f box32f = cvBox32f( s.x, s.y, s.width, s.height, s.angle );
+    CvRect32f rect32f = cvRect32fFromBox32f( box32f );
+
+    // the level of cvCropResizeImagePyramidROI on icvObserveCreatePyramid
+    level = icvImagePyramidLevel( icvObservePyramidLevels( frame, feature_size ),
+                                  rect32f, feature_size );
+    if( level == 0 )
+    {
+        cvCropResizeImageROI( frame, feature, rect32f, feature_size,
+                              CV_CROPRESIZE_GRAY | CV_CROPRESIZE_TRANSPOSE );
+        icvNormalizeFeature( feature );
+        return;
+    }
+
+    // transposed to make the same with matlab's reshape
+    patch = cvCreateMat( feature_width << level, feature_height << level, CV_64FC1 );
+    cvCropResizeImageROI( frame, patch, rect32f, cvSize(0,0),
+                          CV_CROPRESIZE_GRAY | CV_CROPRESIZE_TRANSPOSE );
+    for( l = 0; l < level; l++ )
+    {
+        half = cvCreateMat( patch->rows / 2, patch->cols / 2, CV_64FC1 );
+        cvPyrDown( patch, half, CV_GAUSSIAN_5x5 );
+        cvReleaseMat( &patch );
+        patch = half;
+    }
+    cvCopy( cvReshape( patch, &vec, 1, feature_height*feature_width ), feature );
+    icvNormalizeFeature( feature );
+    cvReleaseMat( &patch );
+}
+
+/**
+ * Measure PCA log likelihoods of particles
+ *
+ * CvParticleState s must have s.x, s.y, s.width, s.height, s.angle
+ *
+ * @param particle
+ * @param frame
+ * @param ids         particle ids to measure
+ * @param num_ids     number of ids
+ * @param loglikelis  num_ids log likelihoods (output)
+ */
+void icvObservePcaMeasure( const CvParticle* p, const IplImage* frame, 
+                           const int* ids, int num_ids, double* loglikelis )
+{
+    int feature_height = feature_size.height;
+    int feature_width  = feature_size.width;
+    CvMat likelihoods = cvMat( 1, num_ids, CV_64FC1, loglikelis );
+
+    // extract features from particle states
+    CvMat* features = cvCreateMat( feature_height*feature_width, num_ids, CV_64FC1 );
+    icvGetFeatures( p, frame, features, ids );
+    
+    // Likelihood measurments
+    if( observe_margin > 0 )
+        cvPcaModelProgressiveDiffs( pcamodel, features, &likelihoods, observe_margin, 0 );
+    else
+        cvPcaModelDiffs( pcamodel, features, &likelihoods, 0, TRUE );
+
+    cvReleaseMat( &features );
+}
+
+/**
+ * Adapt the PCA subspace to the tracked object
+ *
+ * The feature of the most probable particle is stored every frame, and
+ * every pca_batch frames they are folded into the subspace with the
+ * forgetting factor pca_forget. Call after measuring particles.
+ * Nothing is done unless pca_num_samples > 0.
+ *
+ * @param particle
+ * @param frame
+ */
+void cvParticleObserveUpdate( const CvParticle* p, const IplImage* frame )
+{
+    int maxp_id;
+    CvMat feature;
+    if( pca_num_samples <= 0 ) return;
+    if( update_features == NULL )
+    {
+        update_features = cvCreateMat( feature_size.height*feature_size.width,
+                                       pca_batch, CV_64FC1 );
+        num_update_features = 0;
+    }
+
+    maxp_id = cvParticleGetMax( p );
+    cvGetCol( update_features, &feature, num_update_features );
+    icvGetFeature( p, frame, &feature, maxp_id );
+    if( ++num_update_features == update_features->cols )
+    {
+        cvUpdatePcaModel( pcamodel, update_features, pca_forget );
+        num_update_features = 0;
+    }
+}
+
+#endif
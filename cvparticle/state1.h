@@ -60,7 +60,7 @@ typedef struct CvParticleState {
 // Definition of dynamics model
 // new_particle = cvMatMul( dynamics, particle ) + noise
 // curr_x =: curr_x + noise
-double dynamics[] = {
+const double dynamics[] = {
     1, 0, 0, 0, 0, 
     0, 1, 0, 0, 0, 
     0, 0, 1, 0, 0, 
@@ -68,6 +68,14 @@ double dynamics[] = {
     0, 0, 0, 0, 1, 
 };
 
+// Compile-time definition of the model for CvParticleFilter (cvparticlefilter.h)
+// Must agree with dynamics above and circular flags of cvParticleStateConfig
+struct CvParticleStateModel {
+    enum { num_states = 5 };
+    static double dynamics( int i, int j ) { return ::dynamics[i * num_states + j]; }
+    static bool circular( int i ) { return i == 4; } // angle
+};
+
 /********************** Function Prototypes *********************************/
 
 #ifndef NO_DOXYGEN
@@ -177,7 +185,7 @@ void cvParticleStateSet( CvParticle* p, int p_id, const CvParticleState& state )
 void cvParticleStateConfig( CvParticle* p, CvSize imsize, CvParticleState& std )
 {
     // config dynamics model
-    CvMat dynamicsmat = cvMat( p->num_states, p->num_states, CV_64FC1, dynamics );
+    CvMat dynamicsmat = cvMat( p->num_states, p->num_states, CV_64FC1, (void*)dynamics );
 
     // config random noise standard deviation
     CvRNG rng = cvRNG( time( NULL ) );
@@ -66,7 +66,7 @@ typedef struct CvParticleState {
 // new_particle = cvMatMul( dynamics, particle ) + noise
 // curr_x =: curr_x + dx + noise = curr_x + (curr_x - prev_x) + noise
 // prev_x =: curr_x
-double dynamics[] = {
+const double dynamics[] = {
     2, 0, 0, 0, 0, -1, 0, 0, 0, 0,
     0, 2, 0, 0, 0, 0, -1, 0, 0, 0,
     0, 0, 2, 0, 0, 0, 0, -1, 0, 0,
@@ -79,6 +79,14 @@ double dynamics[] = {
     0, 0, 0, 0, 1, 0, 0, 0, 0, 0,
 };
 
+// Compile-time definition of the model for CvParticleFilter (cvparticlefilter.h)
+// Must agree with dynamics above and circular flags of cvParticleStateConfig
+struct CvParticleStateModel {
+    enum { num_states = 10 };
+    static double dynamics( int i, int j ) { return ::dynamics[i * num_states + j]; }
+    static bool circular( int i ) { return i == 4; } // angle
+};
+
 /********************** Function Prototypes *********************************/
 
 #ifndef NO_DOXYGEN
@@ -209,7 +217,7 @@ void cvParticleStateSet( CvParticle* p, int p_id, const CvParticleState& state )
 void cvParticleStateConfig( CvParticle* p, CvSize imsize, CvParticleState& std )
 {
     // config dynamics model
-    CvMat dynamicsmat = cvMat( p->num_states, p->num_states, CV_64FC1, dynamics );
+    CvMat dynamicsmat = cvMat( p->num_states, p->num_states, CV_64FC1, (void*)dynamics );
 
     // config random noise standard deviation
     CvRNG rng = cvRNG( time( NULL ) );
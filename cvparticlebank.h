@@ -0,0 +1,632 @@
+/** @file
+ * Particle Filter bank for tracking multiple targets
+ *
+ * Keeps particles of all targets in one structure-of-arrays buffer so that
+ * transition, normalization, mean and resampling of all targets are done
+ * by one call (parallelized over targets if OpenMP is enabled).
+ * All targets share the same dynamics, noise and bound models.
+ *
+ * cvCreateParticleBank
+ * cvParticleBankSetXxx
+ * cvParticleBankInit
+ * loop {
+ *   cvParticleBankTransition
+ *   Measurement of each cvParticleBankTarget( bank, t )
+ *   cvParticleBankNormalize
+ *   cvParticleBankResample
+ * }
+ * cvReleaseParticleBank
+ */
+/* The MIT License
+ *
+ * Copyright (c) 2008, Naotoshi Seo <sonots(at)sonots.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CV_PARTICLE_BANK_INCLUDED
+#define CV_PARTICLE_BANK_INCLUDED
+
+#include "cv.h"
+#include "cvaux.h"
+#include "cxcore.h"
+
+#include "cvparticle.h"
+
+/******************************* Structures **********************************/
+/**
+ * Alignment of each target's particles in bytes
+ */
+#define CV_PARTICLE_BANK_ALIGN 32
+
+/**
+ * Particle Filter bank structure
+ *
+ * Particles are stored state-major: row s of "particles" holds the s-th
+ * state of all particles of all targets, target t occupying columns
+ * t * stride .. t * stride + num_particles - 1 (32 bytes aligned).
+ */
+typedef struct CvParticleBank {
+    // config
+    int num_targets;   /**< Number of targets */
+    int num_states;    /**< Number of tracking states */
+    int num_particles; /**< Number of particles of each target */
+    int stride;        /**< num_particles rounded up to CV_PARTICLE_BANK_ALIGN bytes */
+    bool logweight;    /**< log weights are stored in "weights". */
+    int resample;      /**< Resampling method, CV_PARTICLE_RESAMPLE_* except KLD */
+    // models shared by all targets
+    CvMat* dynamics;   /**< num_states x num_states. Dynamics model. */
+    CvMat* dynamics_index; /**< num_states x (num_states + 1). See CvParticle */
+    CvRNG  rng;        /**< Random seed */
+    CvMat* std;        /**< num_states x 1. Standard deviation for gaussian noise */
+    CvMat* bound;      /**< num_states x 3 (lowerbound, upperbound, circular flag) */
+    // particle states
+    CvMat* particles;  /**< num_states x (num_targets * stride), CV_32FC1 */
+    CvMat* weights;    /**< num_targets x stride, CV_64FC1 */
+    // workspaces
+    CvMat* new_particles; /**< num_states x (num_targets * stride). Swapped with
+                          "particles" by transition and resampling */
+    CvMat* noises;     /**< num_states x (num_targets * stride) */
+    CvMat* cumweights; /**< num_targets x stride, CV_64FC1 */
+    CvMat* tmpweights; /**< num_targets x stride, CV_64FC1 */
+    CvMat* indices;    /**< num_targets x stride, CV_32SC1 */
+    void* buffer;      /**< Memory of particles, new_particles and noises */
+    // per target views
+    CvParticle* targets; /**< num_targets. CvParticle views of each target */
+    CvMat* particle_views; /**< num_targets. Headers of targets[t].particles */
+    CvMat* weight_views; /**< num_targets. Headers of targets[t].weights */
+} CvParticleBank;
+
+/**************************** Function Prototypes ****************************/
+
+#ifndef NO_DOXYGEN
+CVAPI(CvParticleBank*) cvCreateParticleBank( int num_targets, int num_states,
+                                             int num_particles, bool logweight );
+CVAPI(void) cvReleaseParticleBank( CvParticleBank** bank );
+
+CVAPI(void) cvParticleBankSetDynamics( CvParticleBank* bank, const CvMat* dynamics );
+CVAPI(void) cvParticleBankSetNoise( CvParticleBank* bank, CvRNG rng, const CvMat* std );
+CVAPI(void) cvParticleBankSetBound( CvParticleBank* bank, const CvMat* bound );
+CVAPI(void) cvParticleBankSetResample( CvParticleBank* bank, int method );
+
+CV_INLINE CvParticle* cvParticleBankTarget( CvParticleBank* bank, int target );
+CVAPI(void) cvParticleBankGetMean( const CvParticleBank* bank, CvMat* means );
+
+CVAPI(void) cvParticleBankInit( CvParticleBank* bank, int target,
+                                const CvParticle* init );
+CVAPI(void) cvParticleBankTransition( CvParticleBank* bank );
+CVAPI(void) cvParticleBankNormalize( CvParticleBank* bank );
+CVAPI(void) cvParticleBankResample( CvParticleBank* bank );
+#endif
+
+/*************************** Constructor / Destructor *************************/
+
+/**
+ * Point the per target views to the current particle buffer
+ *
+ * @param bank
+ */
+CV_INLINE void icvParticleBankSetViews( CvParticleBank* bank )
+{
+    int t;
+    for( t = 0; t < bank->num_targets; t++ )
+    {
+        cvInitMatHeader( &bank->particle_views[t], bank->num_states,
+                         bank->num_particles, CV_32FC1,
+                         bank->particles->data.fl + t * bank->stride,
+                         bank->particles->step );
+        cvInitMatHeader( &bank->weight_views[t], 1, bank->num_particles,
+                         CV_64FC1,
+                         bank->weights->data.ptr + t * bank->weights->step );
+        bank->targets[t].particles = &bank->particle_views[t];
+        bank->targets[t].weights   = &bank->weight_views[t];
+    }
+}
+
+/**
+ * Allocate Particle filter bank structure
+ *
+ * @param num_targets   Number of targets
+ * @param num_states    Number of tracking states, e.g., 4 if x, y, width, height
+ * @param num_particles Number of particles of each target
+ * @param logweight     The weights parameter is log  or not
+ * @return CvParticleBank*
+ */
+CVAPI(CvParticleBank*) cvCreateParticleBank( int num_targets,
+                                             int num_states,
+                                             int num_particles,
+                                             bool logweight CV_DEFAULT(false) )
+{
+    CvParticleBank *bank = NULL;
+    uchar* data;
+    int t, step, size;
+    CV_FUNCNAME( "cvCreateParticleBank" );
+    __BEGIN__;
+    CV_ASSERT( num_targets > 0 );
+    CV_ASSERT( num_states > 0 );
+    CV_ASSERT( num_particles > 0 );
+    bank = (CvParticleBank *) cvAlloc( sizeof( CvParticleBank ) );
+    bank->num_targets   = num_targets;
+    bank->num_states    = num_states;
+    bank->num_particles = num_particles;
+    bank->stride        = cvAlign( num_particles,
+                                   CV_PARTICLE_BANK_ALIGN / sizeof( float ) );
+    bank->logweight     = logweight;
+    bank->resample      = CV_PARTICLE_RESAMPLE_SYSTEMATIC;
+    bank->dynamics      = cvCreateMat( num_states, num_states, CV_32FC1 );
+    bank->dynamics_index = cvCreateMat( num_states, num_states + 1, CV_32SC1 );
+    bank->rng           = 1;
+    bank->std           = cvCreateMat( num_states, 1, CV_32FC1 );
+    bank->bound         = cvCreateMat( num_states, 3, CV_32FC1 );
+
+    // particles, new_particles and noises in one aligned block
+    step = num_targets * bank->stride * sizeof( float );
+    size = num_states * step;
+    bank->buffer = cvAlloc( 3 * size + CV_PARTICLE_BANK_ALIGN );
+    data = (uchar*)( ( (size_t) bank->buffer + CV_PARTICLE_BANK_ALIGN - 1 ) &
+                     ~(size_t)( CV_PARTICLE_BANK_ALIGN - 1 ) );
+    bank->particles     = cvCreateMatHeader( num_states, num_targets * bank->stride, CV_32FC1 );
+    bank->new_particles = cvCreateMatHeader( num_states, num_targets * bank->stride, CV_32FC1 );
+    bank->noises        = cvCreateMatHeader( num_states, num_targets * bank->stride, CV_32FC1 );
+    cvSetData( bank->particles, data, step );
+    cvSetData( bank->new_particles, data + size, step );
+    cvSetData( bank->noises, data + 2 * size, step );
+    cvZero( bank->particles );
+
+    bank->weights       = cvCreateMat( num_targets, bank->stride, CV_64FC1 );
+    bank->cumweights    = cvCreateMat( num_targets, bank->stride, CV_64FC1 );
+    bank->tmpweights    = cvCreateMat( num_targets, bank->stride, CV_64FC1 );
+    bank->indices       = cvCreateMat( num_targets, bank->stride, CV_32SC1 );
+    cvSet( bank->weights, cvScalar( logweight ? -log( (double) num_particles ) :
+                                    1.0 / num_particles ) );
+
+    // Default dynamics: next state = curr state + noise
+    cvSetIdentity( bank->dynamics, cvScalar(1.0) );
+    cvSet( bank->std, cvScalar(1.0) );
+    cvZero( bank->bound );
+
+    // views. Only states and weights are owned by the views, models are
+    // shared with the bank and workspaces are not available.
+    bank->targets = (CvParticle*) cvAlloc( num_targets * sizeof( CvParticle ) );
+    bank->particle_views = (CvMat*) cvAlloc( num_targets * sizeof( CvMat ) );
+    bank->weight_views = (CvMat*) cvAlloc( num_targets * sizeof( CvMat ) );
+    memset( bank->targets, 0, num_targets * sizeof( CvParticle ) );
+    for( t = 0; t < num_targets; t++ )
+    {
+        CvParticle* p = &bank->targets[t];
+        p->num_states    = num_states;
+        p->num_particles = num_particles;
+        p->max_particles = num_particles;
+        p->logweight     = logweight;
+        p->dynamics      = bank->dynamics;
+        p->dynamics_index = bank->dynamics_index;
+        p->rng           = icvParticleChunkRNG( bank->rng, t );
+        p->std           = bank->std;
+        p->bound         = bank->bound;
+        p->resample      = bank->resample;
+        p->resample_threshold = 0.5;
+        p->ess           = num_particles;
+        icvParticleAnalyzeDynamics( p );
+    }
+    icvParticleBankSetViews( bank );
+
+    __END__;
+    return bank;
+}
+
+/**
+ * Release Particle filter bank structure
+ *
+ * @param bank
+ */
+CVAPI(void) cvReleaseParticleBank( CvParticleBank** _bank )
+{
+    CvParticleBank *bank = NULL;
+    CV_FUNCNAME( "cvReleaseParticleBank" );
+    __BEGIN__;
+    bank = *_bank;
+    if( !bank ) EXIT;
+
+    CV_CALL( cvReleaseMat( &bank->dynamics ) );
+    CV_CALL( cvReleaseMat( &bank->dynamics_index ) );
+    CV_CALL( cvReleaseMat( &bank->std ) );
+    CV_CALL( cvReleaseMat( &bank->bound ) );
+    CV_CALL( cvReleaseMat( &bank->particles ) );
+    CV_CALL( cvReleaseMat( &bank->new_particles ) );
+    CV_CALL( cvReleaseMat( &bank->noises ) );
+    CV_CALL( cvFree( &bank->buffer ) );
+    CV_CALL( cvReleaseMat( &bank->weights ) );
+    CV_CALL( cvReleaseMat( &bank->cumweights ) );
+    CV_CALL( cvReleaseMat( &bank->tmpweights ) );
+    CV_CALL( cvReleaseMat( &bank->indices ) );
+    CV_CALL( cvFree( &bank->targets ) );
+    CV_CALL( cvFree( &bank->particle_views ) );
+    CV_CALL( cvFree( &bank->weight_views ) );
+
+    CV_CALL( cvFree( _bank ) );
+    __END__;
+}
+
+/***************************** Setter ***************************************/
+
+/**
+ * Set dynamics model shared by all targets
+ *
+ * @param bank
+ * @param dynamics (num_states) x (num_states). dynamics model
+ *    new_state = dynamics * curr_state + noise
+ */
+CVAPI(void) cvParticleBankSetDynamics( CvParticleBank* bank, const CvMat* dynamics )
+{
+    int t;
+    CV_FUNCNAME( "cvParticleBankSetDynamics" );
+    __BEGIN__;
+    CV_ASSERT( bank->num_states == dynamics->rows );
+    CV_ASSERT( bank->num_states == dynamics->cols );
+    cvConvert( dynamics, bank->dynamics );
+    for( t = 0; t < bank->num_targets; t++ )
+        icvParticleAnalyzeDynamics( &bank->targets[t] );
+    __END__;
+}
+
+/**
+ * Set noise model shared by all targets
+ *
+ * @param bank
+ * @param rng      random seed. refer cvRNG(time(NULL))
+ * @param std      num_states x 1. standard deviation for gaussian noise
+ *                 Set standard deviation == 0 for no noise
+ */
+CVAPI(void) cvParticleBankSetNoise( CvParticleBank* bank, CvRNG rng, const CvMat* std )
+{
+    int t;
+    CV_FUNCNAME( "cvParticleBankSetNoise" );
+    __BEGIN__;
+    CV_ASSERT( bank->num_states == std->rows );
+    bank->rng = rng;
+    for( t = 0; t < bank->num_targets; t++ )
+        bank->targets[t].rng = icvParticleChunkRNG( rng, t );
+    cvConvert( std, bank->std );
+    __END__;
+}
+
+/**
+ * Set lowerbound and upperbound shared by all targets
+ *
+ * @param bank
+ * @param bound    num_states x 3 (lowerbound, upperbound, circular flag 0 or 1)
+ *                 Set lowerbound == upperbound to express no bound
+ */
+CVAPI(void) cvParticleBankSetBound( CvParticleBank* bank, const CvMat* bound )
+{
+    CV_FUNCNAME( "cvParticleBankSetBound" );
+    __BEGIN__;
+    CV_ASSERT( bank->num_states == bound->rows );
+    CV_ASSERT( 3 == bound->cols );
+    cvConvert( bound, bank->bound );
+    __END__;
+}
+
+/**
+ * Set resampling method used by cvParticleBankResample
+ *
+ * @param bank
+ * @param method   CV_PARTICLE_RESAMPLE_SYSTEMATIC (default),
+ *                 CV_PARTICLE_RESAMPLE_STRATIFIED, or
+ *                 CV_PARTICLE_RESAMPLE_RESIDUAL
+ */
+CVAPI(void) cvParticleBankSetResample( CvParticleBank* bank, int method )
+{
+    int t;
+    CV_FUNCNAME( "cvParticleBankSetResample" );
+    __BEGIN__;
+    CV_ASSERT( method == CV_PARTICLE_RESAMPLE_SYSTEMATIC ||
+               method == CV_PARTICLE_RESAMPLE_STRATIFIED ||
+               method == CV_PARTICLE_RESAMPLE_RESIDUAL );
+    bank->resample = method;
+    for( t = 0; t < bank->num_targets; t++ )
+        bank->targets[t].resample = method;
+    __END__;
+}
+
+/************************ Utility ******************************************/
+
+/**
+ * Get the CvParticle view of a target
+ *
+ * The view shares states and weights with the bank, thus it can be
+ * given to cvParticleStateGet/Set, cvParticleGetMax, cvParticlePrint,
+ * cvParticleInit and measurement functions. Do not release it, and do
+ * not give it to functions requiring workspaces (cvParticleTransition,
+ * cvParticleResample). The view itself stays valid, but headers obtained
+ * from its "particles" (e.g., cvGetCol) must be re-obtained after
+ * cvParticleBankTransition or cvParticleBankResample.
+ *
+ * @param bank
+ * @param target target id
+ * @return CvParticle*
+ */
+CV_INLINE CvParticle* cvParticleBankTarget( CvParticleBank* bank, int target )
+{
+    return &bank->targets[target];
+}
+
+/**
+ * Get the mean states of all targets
+ *
+ * Wrapped states take the circular mean as cvParticleGetMean. 
+ *
+ * @param bank
+ * @param means  num_states x num_targets, CV_32FC1 or CV_64FC1
+ */
+CVAPI(void) cvParticleBankGetMean( const CvParticleBank* bank, CvMat* means )
+{
+    int t;
+    CV_FUNCNAME( "cvParticleBankGetMean" );
+    __BEGIN__;
+    CV_ASSERT( means->rows == bank->num_states && means->cols == bank->num_targets );
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif /* _OPENMP */
+    for( t = 0; t < bank->num_targets; t++ )
+    {
+        const float* particles = bank->particles->data.fl + t * bank->stride;
+        int rowstep = bank->particles->step / sizeof( float );
+        const double* weights = (const double*)( bank->weights->data.ptr +
+                                                 t * bank->weights->step );
+        double* tmpweights = (double*)( bank->tmpweights->data.ptr +
+                                        t * bank->tmpweights->step );
+        int i, s, n = bank->num_particles;
+        double mean;
+        if( bank->logweight )
+        {
+            for( i = 0; i < n; i++ )
+                tmpweights[i] = exp( weights[i] );
+            weights = tmpweights;
+        }
+        for( s = 0; s < bank->num_states; s++ )
+        {
+            const float* state = particles + s * rowstep;
+            if( !(int) cvmGet( bank->bound, s, 2 ) ) // usual mean
+            {
+                mean = 0;
+                for( i = 0; i < n; i++ )
+                    mean += state[i] * weights[i];
+            }
+            else // circular mean (angle)
+            {
+                double lower = cvmGet( bank->bound, s, 0 );
+                double upper = cvmGet( bank->bound, s, 1 );
+                double csum = 0, ssum = 0;
+                for( i = 0; i < n; i++ )
+                    icvParticleCircularSum( state[i], weights[i], lower, upper, &csum, &ssum );
+                mean = icvParticleCircularMean( csum, ssum, lower, upper );
+            }
+            cvmSet( means, s, t, mean );
+        }
+    }
+    __END__;
+}
+
+/******************* Main (Related to Algorithm) *****************************/
+
+/**
+ * Initialize states of a target or all targets
+ *
+ * @param bank
+ * @param target   target id, or -1 for all targets
+ * @param init     initial states, or NULL to sample uniformly within bound
+ * @see cvParticleInit
+ */
+CVAPI(void) cvParticleBankInit( CvParticleBank* bank, int target,
+                                const CvParticle* init CV_DEFAULT(NULL) )
+{
+    int t;
+    CV_FUNCNAME( "cvParticleBankInit" );
+    __BEGIN__;
+    CV_ASSERT( target >= -1 && target < bank->num_targets );
+    for( t = 0; t < bank->num_targets; t++ )
+    {
+        CvMat weights;
+        if( target != -1 && t != target ) continue;
+        CV_CALL( cvParticleInit( &bank->targets[t], init ) );
+        cvGetRow( bank->weights, &weights, t );
+        cvSet( &weights, cvScalar( bank->logweight ?
+                                   -log( (double) bank->num_particles ) :
+                                   1.0 / bank->num_particles ) );
+    }
+    __END__;
+}
+
+/**
+ * Swap particles with new_particles and re-point the views
+ */
+CV_INLINE void icvParticleBankSwap( CvParticleBank* bank )
+{
+    CvMat* tmp = bank->particles;
+    bank->particles = bank->new_particles;
+    bank->new_particles = tmp;
+    icvParticleBankSetViews( bank );
+}
+
+/**
+ * Samples new particles of all targets
+ *
+ * new_state = dynamics * curr_state + noise, followed by bounding,
+ * computed in one pass over the states of each target. Each target draws
+ * random numbers from its own stream, so results do not depend on the
+ * number of threads.
+ *
+ * @param bank
+ * @see cvParticleTransition
+ */
+CVAPI(void) cvParticleBankTransition( CvParticleBank* bank )
+{
+    int t, num_states = bank->num_states;
+    int rowstep = bank->particles->step / sizeof( float );
+    CvRNG seed = bank->rng;
+    cvRandInt( &bank->rng ); // advance to the seed of the next step
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif /* _OPENMP */
+    for( t = 0; t < bank->num_targets; t++ )
+    {
+        int n = bank->num_particles, i, s, k;
+        const float* src = bank->particles->data.fl + t * bank->stride;
+        float* dst = bank->new_particles->data.fl + t * bank->stride;
+        float* noise = bank->noises->data.fl + t * bank->stride;
+        CvRNG rng = icvParticleChunkRNG( seed, t );
+        CvMat noises = cvMat( num_states, n, CV_32FC1, noise );
+        noises.step = bank->noises->step;
+        noises.type &= ~CV_MAT_CONT_FLAG;
+        cvRandArr( &rng, &noises, CV_RAND_NORMAL, cvScalar(0), cvScalar(1) );
+
+        for( s = 0; s < num_states; s++ )
+        {
+            float* d = dst + s * rowstep;
+            const float* e = noise + s * rowstep;
+            const float* D = (const float*)( bank->dynamics->data.ptr +
+                                             s * bank->dynamics->step );
+            float std = bank->std->data.fl[s];
+            float lower = (float) cvmGet( bank->bound, s, 0 );
+            float upper = (float) cvmGet( bank->bound, s, 1 );
+            int circular = (int) cvmGet( bank->bound, s, 2 );
+
+            for( i = 0; i < n; i++ )
+                d[i] = std * e[i];
+            for( k = 0; k < num_states; k++ )
+            {
+                const float* x = src + k * rowstep;
+                float a = D[k];
+                if( a == 0 ) continue;
+                for( i = 0; i < n; i++ )
+                    d[i] += a * x[i];
+            }
+
+            if( lower == upper ) continue; // no bound flag
+            if( circular )
+            {
+                for( i = 0; i < n; i++ )
+                    d[i] = d[i] < lower ? d[i] + upper : ( d[i] >= upper ? d[i] - upper : d[i] );
+            }
+            else
+            {
+                for( i = 0; i < n; i++ )
+                    d[i] = MIN( MAX( d[i], lower ), upper );
+            }
+        }
+    }
+    icvParticleBankSwap( bank );
+}
+
+/**
+ * Normalize weights of each target
+ *
+ * @param bank
+ * @see cvParticleNormalize
+ */
+CVAPI(void) cvParticleBankNormalize( CvParticleBank* bank )
+{
+    int t;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif /* _OPENMP */
+    for( t = 0; t < bank->num_targets; t++ )
+    {
+        double* weights = (double*)( bank->weights->data.ptr + t * bank->weights->step );
+        double sum = 0, maxweight;
+        int i, n = bank->num_particles;
+        if( !bank->logweight )
+        {
+            for( i = 0; i < n; i++ )
+                sum += weights[i];
+            sum = 1.0 / sum;
+            for( i = 0; i < n; i++ )
+                weights[i] *= sum;
+        }
+        else // log version
+        {
+            maxweight = weights[0];
+            for( i = 1; i < n; i++ )
+                maxweight = MAX( maxweight, weights[i] );
+            for( i = 0; i < n; i++ )
+                sum += exp( weights[i] - maxweight );
+            sum = maxweight + log( sum );
+            for( i = 0; i < n; i++ )
+                weights[i] -= sum;
+        }
+    }
+}
+
+/**
+ * Re-samples particles of all targets according to their weights
+ *
+ * Weights need not be normalized. Weights are reset to uniform.
+ *
+ * @param bank
+ * @see cvParticleResample
+ */
+CVAPI(void) cvParticleBankResample( CvParticleBank* bank )
+{
+    int t, num_states = bank->num_states;
+    int rowstep = bank->particles->step / sizeof( float );
+    CvRNG seed = bank->rng;
+    cvRandInt( &bank->rng ); // advance to the seed of the next step
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif /* _OPENMP */
+    for( t = 0; t < bank->num_targets; t++ )
+    {
+        double* weights = (double*)( bank->weights->data.ptr + t * bank->weights->step );
+        double* cumweights = (double*)( bank->cumweights->data.ptr +
+                                        t * bank->cumweights->step );
+        int* indices = (int*)( bank->indices->data.ptr + t * bank->indices->step );
+        const float* src = bank->particles->data.fl + t * bank->stride;
+        float* dst = bank->new_particles->data.fl + t * bank->stride;
+        CvRNG rng = icvParticleChunkRNG( seed, t );
+        double maxweight = 0, total = 0;
+        int i, k, s, n = bank->num_particles;
+
+        if( bank->logweight )
+        {
+            maxweight = weights[0];
+            for( i = 1; i < n; i++ )
+                maxweight = MAX( maxweight, weights[i] );
+        }
+        for( i = 0; i < n; i++ )
+        {
+            total += bank->logweight ? exp( weights[i] - maxweight ) : weights[i];
+            cumweights[i] = total;
+        }
+        icvParticleSelectMethod( bank->resample, cumweights, n, &rng, indices );
+
+        for( s = 0; s < num_states; s++ )
+        {
+            const float* x = src + s * rowstep;
+            float* y = dst + s * rowstep;
+            for( k = 0; k < n; k++ )
+                y[k] = x[indices[k]];
+        }
+        for( i = 0; i < n; i++ )
+            weights[i] = bank->logweight ? -log( (double) n ) : 1.0 / n;
+    }
+    icvParticleBankSwap( bank );
+}
+
+
+#endif
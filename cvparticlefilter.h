@@ -0,0 +1,455 @@
+/** @file
+ * Particle Filter specialized for a state model at compile time
+ *
+ * The number of states, the dynamics model and the circular flags of
+ * states are given by a model class so that the compiler can unroll the
+ * loops over states, drop the zero terms of the dynamics and vectorize
+ * the loops over particles. States are stored state-major in arrays of
+ * Scalar (float or double).
+ *
+ * A model class looks like
+ * <pre>
+ * struct Model {
+ *     enum { num_states = 5 };
+ *     static double dynamics( int i, int j ); // (i,j) element of dynamics
+ *     static bool circular( int i );          // i-th state wraps around
+ * };
+ * </pre>
+ * cvparticle/state1.h and cvparticle/state2.h define CvParticleStateModel.
+ *
+ * CvParticleFilter<CvParticleStateModel> pf( num_particles )
+ * cvParticleStateConfig( pf.particle(), imsize, std ) (or cvParticleSetXxx)
+ * pf.init()
+ * loop {
+ *   pf.transition()
+ *   Measurement on pf.particle()
+ *   pf.normalize()
+ *   pf.resample()
+ * }
+ *
+ * pf.particle() is a CvParticle sharing states, weights, noise and bound
+ * with the filter, so cvParticleStateGet/Set, cvParticleGetMax,
+ * cvParticlePrint, cvParticleInit, cvParticleSetNoise, cvParticleSetBound
+ * and the measurement functions work on it. Do not release it, and do not
+ * give it to functions requiring workspaces (cvParticleTransition,
+ * cvParticleResample). The model gives the initial dynamics and circular
+ * flags. pf.transition() follows cvParticleSetDynamics, cvParticleSetBound
+ * and per particle "stds" set on pf.particle() as cvParticleTransition does,
+ * and draws the same noises, so the two produce the same particles for
+ * the same seed (up to rounding for dense dynamics). The loops are unrolled
+ * by the model while pf.particle()->dynamics equals the model's.
+ */
+/* The MIT License
+ *
+ * Copyright (c) 2008, Naotoshi Seo <sonots(at)sonots.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CV_PARTICLE_FILTER_INCLUDED
+#define CV_PARTICLE_FILTER_INCLUDED
+
+#include "cv.h"
+#include "cvaux.h"
+#include "cxcore.h"
+
+#include "cvparticle.h"
+
+/**
+ * Particle Filter specialized for a state model
+ *
+ * @param Model  state model class
+ * @param Scalar float or double
+ */
+template< class Model, typename Scalar = float >
+class CvParticleFilter
+{
+public:
+    enum { num_states = Model::num_states };
+
+    /**
+     * @param num_particles Number of particles
+     * @param logweight     The weights parameter is log  or not
+     */
+    CvParticleFilter( int num_particles, bool logweight = false );
+    ~CvParticleFilter();
+
+    /** CvParticle view of this filter */
+    CvParticle* particle() { return &p; }
+    const CvParticle* particle() const { return &p; }
+
+    void init( const CvParticle* init = NULL ) { cvParticleInit( &p, init ); }
+    void transition();
+    double normalize();
+    void resample();
+    int getMax() const;
+    void getMean( CvMat* meanp ) const;
+
+protected:
+    void setViews();
+    bool modelDynamics() const;
+    void transitionChunk( int chunk, CvRNG seed, bool model );
+    static void addScaled( Scalar* y, const Scalar* x, Scalar a, int start, int end );
+
+    int stride;           /**< num_particles rounded up to 32 bytes */
+    Scalar* states;       /**< num_states x stride */
+    Scalar* new_states;   /**< num_states x stride. Resampling buffer */
+    Scalar* noises;       /**< num_states x stride. Workspace */
+    double* cumweights;   /**< num_particles. Workspace */
+    int* indices;         /**< num_particles. Workspace */
+    CvParticle p;         /**< CvParticle view */
+    CvMat particles_hdr;  /**< Header of p.particles */
+
+private:
+    CvParticleFilter( const CvParticleFilter& );
+    CvParticleFilter& operator=( const CvParticleFilter& );
+};
+
+/*************************** Constructor / Destructor *************************/
+
+template< class Model, typename Scalar >
+CvParticleFilter<Model, Scalar>::CvParticleFilter( int num_particles, bool logweight )
+{
+    int i, j, size;
+    CV_FUNCNAME( "CvParticleFilter" );
+    __BEGIN__;
+    CV_ASSERT( num_particles > 0 );
+    CV_ASSERT( sizeof( Scalar ) == sizeof( float ) || sizeof( Scalar ) == sizeof( double ) );
+    stride     = cvAlign( num_particles, 32 / sizeof( Scalar ) );
+    size       = num_states * stride * sizeof( Scalar );
+    states     = (Scalar*) cvAlloc( size );
+    new_states = (Scalar*) cvAlloc( size );
+    noises     = (Scalar*) cvAlloc( size );
+    cumweights = (double*) cvAlloc( num_particles * sizeof( double ) );
+    indices    = (int*) cvAlloc( num_particles * sizeof( int ) );
+    memset( states, 0, size );
+
+    memset( &p, 0, sizeof( CvParticle ) );
+    p.num_states    = num_states;
+    p.num_particles = num_particles;
+    p.max_particles = num_particles;
+    p.logweight     = logweight;
+    p.dynamics      = cvCreateMat( num_states, num_states, CV_32FC1 );
+    p.dynamics_index = cvCreateMat( num_states, num_states + 1, CV_32SC1 );
+    p.rng           = 1;
+    p.std           = cvCreateMat( num_states, 1, CV_32FC1 );
+    p.bound         = cvCreateMat( num_states, 3, CV_32FC1 );
+    p.weights       = cvCreateMat( 1, num_particles, CV_64FC1 );
+    p.resample      = CV_PARTICLE_RESAMPLE_SYSTEMATIC;
+    p.resample_threshold = 0.5;
+    p.ess           = num_particles;
+    setViews();
+
+    for( i = 0; i < num_states; i++ )
+    {
+        for( j = 0; j < num_states; j++ )
+            cvmSet( p.dynamics, i, j, Model::dynamics( i, j ) );
+    }
+    icvParticleAnalyzeDynamics( &p );
+    cvSet( p.std, cvScalar(1.0) );
+    cvZero( p.bound );
+    for( i = 0; i < num_states; i++ )
+        cvmSet( p.bound, i, 2, Model::circular( i ) );
+    cvSet( p.weights, cvScalar( logweight ? -log( (double) num_particles ) :
+                                1.0 / num_particles ) );
+    __END__;
+}
+
+template< class Model, typename Scalar >
+CvParticleFilter<Model, Scalar>::~CvParticleFilter()
+{
+    cvReleaseMat( &p.dynamics );
+    cvReleaseMat( &p.dynamics_index );
+    cvReleaseMat( &p.std );
+    if( p.stds != NULL )
+        cvReleaseMat( &p.stds );
+    cvReleaseMat( &p.bound );
+    cvReleaseMat( &p.weights );
+    cvFree( &states );
+    cvFree( &new_states );
+    cvFree( &noises );
+    cvFree( &cumweights );
+    cvFree( &indices );
+}
+
+/**
+ * Point p.particles to the current states
+ */
+template< class Model, typename Scalar >
+void CvParticleFilter<Model, Scalar>::setViews()
+{
+    cvInitMatHeader( &particles_hdr, num_states, p.num_particles,
+                     sizeof( Scalar ) == sizeof( float ) ? CV_32FC1 : CV_64FC1,
+                     states, stride * sizeof( Scalar ) );
+    p.particles = &particles_hdr;
+}
+
+/******************* Main (Related to Algorithm) *****************************/
+
+/**
+ * Whether p.dynamics is still the dynamics of the model
+ */
+template< class Model, typename Scalar >
+bool CvParticleFilter<Model, Scalar>::modelDynamics() const
+{
+    int i, j;
+    for( i = 0; i < num_states; i++ )
+    {
+        for( j = 0; j < num_states; j++ )
+        {
+            if( cvmGet( p.dynamics, i, j ) != (float) Model::dynamics( i, j ) )
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * y[i] += a * x[i] for i = start..end-1
+ */
+template< class Model, typename Scalar >
+inline void CvParticleFilter<Model, Scalar>::addScaled( Scalar* y, const Scalar* x, Scalar a,
+                                                        int start, int end )
+{
+    int i;
+    if( a == 0 ) return;
+    if( a == 1 )
+    {
+        for( i = start; i < end; i++ )
+            y[i] += x[i];
+    }
+    else
+    {
+        for( i = start; i < end; i++ )
+            y[i] += a * x[i];
+    }
+}
+
+/**
+ * Samples new particles of the chunk-th chunk
+ *
+ * new_state = dynamics * curr_state + noise, followed by bounding,
+ * in one pass over each state. The noises are drawn as
+ * icvParticleTransitionChunk does.
+ *
+ * @param chunk    chunk index
+ * @param seed     seed of the chunk random streams
+ * @param model    p.dynamics equals the dynamics of the model
+ */
+template< class Model, typename Scalar >
+void CvParticleFilter<Model, Scalar>::transitionChunk( int chunk, CvRNG seed, bool model )
+{
+    int start = chunk * CV_PARTICLE_CHUNK;
+    int end   = MIN( start + CV_PARTICLE_CHUNK, p.num_particles );
+    CvRNG rng = icvParticleChunkRNG( seed, chunk );
+    int i, s, k, c;
+    CvMat noisemat;
+    cvInitMatHeader( &noisemat, num_states, end - start, particles_hdr.type,
+                     noises + start, stride * sizeof( Scalar ) );
+    icvParticleNoiseCols( &p, &noisemat, start, &rng );
+
+    for( s = 0; s < num_states; s++ )
+    {
+        Scalar* y = new_states + s * stride;
+        const Scalar* e = noises + s * stride;
+        const Scalar lower = (Scalar) cvmGet( p.bound, s, 0 );
+        const Scalar upper = (Scalar) cvmGet( p.bound, s, 1 );
+        const int* index = (const int*)( p.dynamics_index->data.ptr +
+                                         s * p.dynamics_index->step );
+
+        for( i = start; i < end; i++ )
+            y[i] = e[i];
+        if( model ) // constant coefficients, zero terms dropped
+        {
+            for( k = 0; k < num_states; k++ )
+                addScaled( y, states + k * stride, (Scalar) Model::dynamics( s, k ), start, end );
+        }
+        else // nonzero elements of p.dynamics
+        {
+            for( c = 1; c <= index[0]; c++ )
+            {
+                k = index[c];
+                addScaled( y, states + k * stride, (Scalar) cvmGet( p.dynamics, s, k ), start, end );
+            }
+        }
+
+        if( lower == upper ) continue; // no bound flag
+        if( cvmGet( p.bound, s, 2 ) )
+        {
+            for( i = start; i < end; i++ )
+                y[i] = y[i] < lower ? y[i] + upper : ( y[i] >= upper ? y[i] - upper : y[i] );
+        }
+        else
+        {
+            for( i = start; i < end; i++ )
+                y[i] = y[i] < lower ? lower : ( y[i] > upper ? upper : y[i] );
+        }
+    }
+}
+
+/**
+ * Samples new particles
+ *
+ * Particles are processed by chunks of CV_PARTICLE_CHUNK with the random
+ * streams of cvParticleTransition.
+ *
+ * @see cvParticleTransition
+ */
+template< class Model, typename Scalar >
+void CvParticleFilter<Model, Scalar>::transition()
+{
+    int c, num_chunks = ( p.num_particles + CV_PARTICLE_CHUNK - 1 ) / CV_PARTICLE_CHUNK;
+    CvRNG seed = p.rng;
+    bool model = modelDynamics();
+    cvRandInt( &p.rng ); // advance to the seed of the next step
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif /* _OPENMP */
+    for( c = 0; c < num_chunks; c++ )
+    {
+        transitionChunk( c, seed, model );
+    }
+    Scalar* tmp = states; states = new_states; new_states = tmp;
+    setViews();
+}
+
+/**
+ * Do normalization of weights
+ *
+ * @return effective sample size, also stored into particle()->ess
+ * @see cvParticleNormalize
+ */
+template< class Model, typename Scalar >
+double CvParticleFilter<Model, Scalar>::normalize()
+{
+    return cvParticleNormalize( &p );
+}
+
+/**
+ * Re-samples particles according to their weights
+ *
+ * The method is set by cvParticleSetResample( particle(), method )
+ * except CV_PARTICLE_RESAMPLE_KLD, which is treated as systematic.
+ *
+ * @see cvParticleResample
+ */
+template< class Model, typename Scalar >
+void CvParticleFilter<Model, Scalar>::resample()
+{
+    int n = p.num_particles, i, k, s;
+    const double* weights = p.weights->data.db;
+    double maxweight = 0, total = 0;
+    if( p.logweight )
+        cvMinMaxLoc( p.weights, NULL, &maxweight );
+    for( i = 0; i < n; i++ )
+    {
+        total += p.logweight ? exp( weights[i] - maxweight ) : weights[i];
+        cumweights[i] = total;
+    }
+    icvParticleSelectMethod( p.resample == CV_PARTICLE_RESAMPLE_KLD ?
+                             CV_PARTICLE_RESAMPLE_SYSTEMATIC : p.resample,
+                             cumweights, n, &p.rng, indices );
+
+    for( s = 0; s < num_states; s++ )
+    {
+        const Scalar* x = states + s * stride;
+        Scalar* y = new_states + s * stride;
+        for( k = 0; k < n; k++ )
+            y[k] = x[indices[k]];
+    }
+    Scalar* tmp = states; states = new_states; new_states = tmp;
+    setViews();
+
+    cvSet( p.weights, cvScalar( p.logweight ? -log( (double) n ) : 1.0 / n ) );
+}
+
+/************************ Utility ******************************************/
+
+/**
+ * Get id of the most probable particle
+ */
+template< class Model, typename Scalar >
+int CvParticleFilter<Model, Scalar>::getMax() const
+{
+    return cvParticleGetMax( &p );
+}
+
+/**
+ * Get the mean state (particle)
+ *
+ * Weights need not be normalized, log weights are used relative to the
+ * max, and wrapped states take the circular mean as cvParticleGetMeanCov.
+ *
+ * @param meanp     num_states x 1, CV_32FC1 or CV_64FC1
+ * @see cvParticleGetMeanCov
+ */
+template< class Model, typename Scalar >
+void CvParticleFilter<Model, Scalar>::getMean( CvMat* meanp ) const
+{
+    int n = p.num_particles, i, s;
+    const double* weights = p.weights->data.db;
+    double* expweights = cumweights; // workspace
+    double mean, maxweight = 0, sumw = 0;
+    CV_FUNCNAME( "CvParticleFilter::getMean" );
+    __BEGIN__;
+    CV_ASSERT( meanp->rows == num_states && meanp->cols == 1 );
+    if( p.logweight )
+    {
+        cvMinMaxLoc( p.weights, NULL, &maxweight );
+        for( i = 0; i < n; i++ )
+            expweights[i] = exp( weights[i] - maxweight );
+        weights = expweights;
+    }
+    for( i = 0; i < n; i++ )
+    {
+        if( weights[i] > 0 )
+            sumw += weights[i];
+    }
+    for( s = 0; s < num_states; s++ )
+    {
+        const Scalar* x = states + s * stride;
+        if( !cvmGet( p.bound, s, 2 ) ) // usual mean
+        {
+            mean = 0;
+            for( i = 0; i < n; i++ )
+            {
+                if( weights[i] > 0 )
+                    mean += x[i] * weights[i];
+            }
+            if( sumw > 0 )
+                mean /= sumw;
+        }
+        else // circular mean (angle)
+        {
+            double lower = cvmGet( p.bound, s, 0 );
+            double upper = cvmGet( p.bound, s, 1 );
+            double csum = 0, ssum = 0;
+            for( i = 0; i < n; i++ )
+            {
+                if( weights[i] > 0 )
+                    icvParticleCircularSum( x[i], weights[i], lower, upper, &csum, &ssum );
+            }
+            mean = icvParticleCircularMean( csum, ssum, lower, upper );
+        }
+        cvmSet( meanp, s, 0, mean );
+    }
+    __END__;
+}
+
+
+#endif
@@ -16,6 +16,7 @@
 #include <iostream>
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include "cvpcamodel.h"
 
 #ifndef CV_PCADIFFS_INCLUDED
 #define CV_PCADIFFS_INCLUDED
@@ -41,6 +42,12 @@ cvPcaDiffs( const CvMat* sample, const CvMat* avg, const CvMat* eigenvalues,
  *   approximated likelihood Gaussian density distribution. 
  *   See [1] for more details. 
  *
+ *   Each call creates a CvPcaModel, i.e., copies the mean, converts
+ *   (and transposes) eigenvectors and allocates workspaces, and releases
+ *   it again, which may cost as much as the scoring itself for few
+ *   samples. To score samples against the same subspace repeatedly,
+ *   create a CvPcaModel once and use cvPcaModelDiffs instead. 
+ *
  * @param samples             D x N sample vectors
  * @param avg                 D x 1 mean vector
  * @param eigenvalues         nEig x 1 eigen values
@@ -51,6 +58,7 @@ cvPcaDiffs( const CvMat* sample, const CvMat* avg, const CvMat* eigenvalues,
  *                            1 - normalization term
  *                            2 - normalize so that sum becomes 1.0
  * @param logprob             Log probability or not
+ * @see cvPcaModelDiffs
  * @see CVAPI(void) cvCalcPCA( const CvArr* data, CvArr* avg, CvArr* eigenvalues, CvArr* eigenvectors, int flags );
  * @see CVAPI(void) cvProjectPCA( const CvArr* data, const CvArr* avg, const CvArr* eigenvectors, CvArr* result );
  * @see CVAPI(void) cvBackProjectPCA( const CvArr* proj, const CvArr* avg,const CvArr* eigenvects, CvArr* result );
@@ -78,127 +86,18 @@ cvMatPcaDiffs( const CvMat* samples, const CvMat* avg, const CvMat* eigenvalues,
                const CvMat* eigenvectors, CvMat* probs, 
                int normalize CV_DEFAULT(1), bool logprob CV_DEFAULT(false) )
 {
-    int D = samples->rows;
-    int N = samples->cols;
-    int M = (eigenvectors->rows == D) ? eigenvectors->cols : eigenvectors->rows;
-    int type = samples->type;
-    int nEig = eigenvalues->rows;
-    int d, n;
-    double normterm = 0;
-    CvMat *_eigenvectors; // cvProjectPCA requires M x D vec
-    CvMat *proj = cvCreateMat( N, M, type );
-    CvMat *subproj, subprojhdr;
-    CvMat *sclsubproj = cvCreateMat( 1, M, type );
-    CvMat *pLambda, pLambdaHdr;
-    CvMat *rLambda, rLambdaHdr;
-    CvMat *sqrt_pLambda = cvCreateMat( M, 1, type );
-    CvMat *DIFS = cvCreateMat( 1, N, type );
-    CvMat *DFFS = cvCreateMat( 1, N, type );
-    CvMat *samples0 = cvCreateMat( D, N, type ); // mean subtracted samples
-    CvMat *subsamples0, subsamples0hdr;
-    CvScalar rho;
-    CvMat *_proj;
+    CvPcaModel* model = NULL;
     CV_FUNCNAME( "cvMatPcaDiffs" );
     __BEGIN__;
     CV_ASSERT( CV_IS_MAT(samples) );
     CV_ASSERT( CV_IS_MAT(avg) );
-    CV_ASSERT( CV_IS_MAT(eigenvalues) );
-    CV_ASSERT( CV_IS_MAT(eigenvectors) );
-    CV_ASSERT( D == eigenvectors->rows || D == eigenvectors->cols );
-    CV_ASSERT( D == avg->rows && 1 == avg->cols );
-    CV_ASSERT( 1 == probs->rows && N == probs->cols );
-    
-    cvZero( DIFS );
-    cvZero( DFFS );
-
-    if( D == eigenvectors->rows ) {
-        _eigenvectors = cvCreateMat( M, D, type );
-        cvT( eigenvectors, _eigenvectors );
-    } else {
-        _eigenvectors = (CvMat*)eigenvectors;
-    }
-    //cvProjectPCA( samples, avg, _eigenvectors, proj );
-    for( n = 0; n < N; n++ ) { // want mean subtracted samples for laster too
-        for( d = 0; d < D; d++ ) {
-            cvmSet( samples0, d, n, cvmGet( samples, d, n ) - cvmGet( avg, d, 0 ) );
-        }
-    }
-    _proj = cvCreateMat( M, N, type );
-    cvMatMul( _eigenvectors, samples0, _proj );
-    cvT( _proj, proj );
-    cvReleaseMat( &_proj );
-
-    // distance in feature space
-    if( M > 0 ) {
-        pLambda = cvGetRows( eigenvalues, &pLambdaHdr, 0, M );
-        cvPow( pLambda, sqrt_pLambda, 0.5 );
-        for( n = 0; n < N; n++ ) {
-            subproj = cvGetRow( proj, &subprojhdr, n );
-            for( d = 0; d < M; d++ ) {
-                cvmSet( sclsubproj, 0, d, cvmGet( subproj, 0, d ) / cvmGet( sqrt_pLambda, d, 0 ) );
-            }
-            cvmSet( DIFS, 0, n, pow(cvNorm( sclsubproj, NULL, CV_L2 ), 2) );
-        }
-        if( normalize == 1 ) {
-            //cvLog( sqrt_pLambda, sqrt_pLambda );
-            //cvSum( sqrt_pLambda );
-            for( d = 0; d < M; d++ ) {
-                normterm += log( cvmGet( sqrt_pLambda, d, 0 ) );
-            }
-            normterm += log(2*M_PI)*(M/2.0);
-        }
-    }
-
-    // distance from feature space
-    if( nEig > M ) {
-        rLambda = cvGetRows( eigenvalues, &rLambdaHdr, M, nEig );
-        rho = cvAvg( rLambda );
-        for( n = 0; n < N; n++ ) {
-            subsamples0 = cvGetCol( samples0, &subsamples0hdr, n );
-            subproj = cvGetRow( proj, &subprojhdr, n );
-            cvmSet( DFFS, 0, n, pow(cvNorm( subsamples0, NULL, CV_L2 ),2) - pow(cvNorm( subproj, NULL, CV_L2 ),2) );
-        }
-        cvScale( DFFS, DFFS, 1.0/rho.val[0] );
-        if( normalize == 1 ) {
-            normterm += log(2*M_PI*rho.val[0]) * ((nEig - M)/2.0);
-        }
-    }
-    
-    // sum DIFS and DFFS in log form
-    for( n = 0; n < N; n++ ) {
-        cvmSet( probs, 0, n, cvmGet( DIFS, 0, n ) / (-2) + cvmGet( DFFS, 0, n) / (-2) - normterm );
-    }
+    CV_ASSERT( samples->rows == avg->rows && 1 == avg->cols );
 
-    // normalization and so on
-    if( normalize == 2 ) {
-        double minval, maxval;
-        cvMinMaxLoc( probs, &minval, &maxval );
-        cvSubS( probs, cvScalar( maxval ), probs );
-    }
-    if( !logprob || normalize == 2 ) {
-        for( n = 0; n < N; n++ ) {
-            cvmSet( probs, 0, n, exp(cvmGet( probs, 0, n )) );
-        }
-        if( normalize == 2 ) {
-            CvScalar sumprob = cvSum( probs );
-            cvScale( probs, probs, 1.0 / sumprob.val[0] );
-        }
-    }
-    if( logprob && normalize == 2 ) {
-        for( n = 0; n < N; n++ ) {
-            cvmSet( probs, 0, n, log(cvmGet( probs, 0, n )) );
-        }
-    }
-    cvReleaseMat( &proj );
-    cvReleaseMat( &sclsubproj );
-    cvReleaseMat( &sqrt_pLambda );
-    cvReleaseMat( &DIFS );
-    cvReleaseMat( &DFFS );
-    cvReleaseMat( &samples0 );
-    if( D == eigenvectors->rows ) {
-        cvReleaseMat( &_eigenvectors );
-    }
+    CV_CALL( model = cvCreatePcaModel( avg, eigenvalues, eigenvectors,
+                                       CV_MAT_TYPE( samples->type ) ) );
+    CV_CALL( cvPcaModelDiffs( model, samples, probs, normalize, logprob ) );
     __END__;
+    cvReleasePcaModel( &model );
 }
 
 /**
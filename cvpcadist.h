@@ -16,6 +16,7 @@
 #include <iostream>
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include "cvpcamodel.h"
 
 #ifndef CV_PCADIST_INCLUDED
 #define CV_PCADIST_INCLUDED
@@ -37,6 +38,12 @@ cvPcaDist( const CvMat* sample, const CvMat* avg,
  * @param eigenvectors        M x D or D x M (automatically adjusted) eigen vectors
  * @param dists               1 x N computed distances
  *
+ * Each call creates and releases a CvPcaModel (a copy of the mean,
+ * converted eigenvectors and workspaces). To compute distances to the
+ * same subspace repeatedly, create a CvPcaModel once and use
+ * cvPcaModelScore instead.
+ *
+ * @see cvPcaModelScore to compute with DIFS and DFFS at once
  * @see CVAPI(void) cvCalcPCA( const CvArr* data, CvArr* avg, CvArr* eigenvalues, CvArr* eigenvectors, int flags );
  * @see CVAPI(void) cvProjectPCA( const CvArr* data, const CvArr* avg, const CvArr* eigenvectors, CvArr* result );
  * @see CVAPI(void) cvBackProjectPCA( const CvArr* proj, const CvArr* avg,const CvArr* eigenvects, CvArr* result );
@@ -45,56 +52,18 @@ CVAPI(void)
 cvMatPcaDist( const CvMat* samples, const CvMat* avg, 
               const CvMat* eigenvectors, CvMat* dists )
 {
-    int D = samples->rows;
-    int N = samples->cols;
-    int M = (eigenvectors->rows == D) ? eigenvectors->cols : eigenvectors->rows;
-    int type = samples->type;
-    int d, n;
-    CvMat *_eigenvectors; // cvProjectPCA requires M x D vec
-    CvMat *proj = cvCreateMat( N, M, type );
-    CvMat *subproj, subprojhdr;
-    CvMat *samples0 = cvCreateMat( D, N, type ); // mean subtracted samples
-    CvMat *subsamples0, subsamples0hdr;
-    CvMat *_proj;
+    CvPcaModel* model = NULL;
     CV_FUNCNAME( "cvMatPcaDist" );
     __BEGIN__;
     CV_ASSERT( CV_IS_MAT(samples) );
     CV_ASSERT( CV_IS_MAT(avg) );
-    CV_ASSERT( CV_IS_MAT(eigenvectors) );
-    CV_ASSERT( D == eigenvectors->rows || D == eigenvectors->cols );
-    CV_ASSERT( D == avg->rows && 1 == avg->cols );
-    CV_ASSERT( 1 == dists->rows && N == dists->cols );
-    if( D == eigenvectors->rows ) { // support transpose
-        _eigenvectors = cvCreateMat( M, D, type );
-        cvT( eigenvectors, _eigenvectors );
-    } else {
-        _eigenvectors = (CvMat*)eigenvectors;
-    }
-    
-    //cvProjectPCA( samples, avg, _eigenvectors, proj );
-    for( n = 0; n < N; n++ ) { // want mean subtracted samples for laster too
-        for( d = 0; d < D; d++ ) {
-            cvmSet( samples0, d, n, cvmGet( samples, d, n ) - cvmGet( avg, d, 0 ) );
-        }
-    }
-    _proj = cvCreateMat( M, N, type );
-    cvMatMul( _eigenvectors, samples0, _proj );
-    cvT( _proj, proj );
-    cvReleaseMat( &_proj );
-
-    // distance from feature space
-    for( n = 0; n < N; n++ ) {
-        subsamples0 = cvGetCol( samples0, &subsamples0hdr, n );
-        subproj = cvGetRow( proj, &subprojhdr, n );
-        cvmSet( dists, 0, n, pow(cvNorm( subsamples0, NULL, CV_L2 ),2) - pow(cvNorm( subproj, NULL, CV_L2 ),2) );
-    }
+    CV_ASSERT( samples->rows == avg->rows && 1 == avg->cols );
 
-    cvReleaseMat( &proj );
-    cvReleaseMat( &samples0 );
-    if( D == eigenvectors->rows ) {
-        cvReleaseMat( &_eigenvectors );
-    }
+    CV_CALL( model = cvCreatePcaModel( avg, NULL, eigenvectors,
+                                       CV_MAT_TYPE( samples->type ) ) );
+    CV_CALL( cvPcaModelScore( model, samples, NULL, NULL, dists, NULL ) );
     __END__;
+    cvReleasePcaModel( &model );
 }
 
 /**
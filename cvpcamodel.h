@@ -0,0 +1,740 @@
+/** @file */
+/* Copyright (c) 2008, Naotoshi Seo. All rights reserved.
+ *
+ * The program is free to use for non-commercial academic purposes,
+ * but for course works, you must understand what is going inside to
+ * use. The program can be used, modified, or re-distributed for any
+ * purposes only if you or one of your group understand not only
+ * programming codes but also theory and math behind (if any).
+ * Please contact the authors if you are interested in using the
+ * program without meeting the above conditions.
+*/
+
+#include "cv.h"
+#include "cvaux.h"
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <float.h>
+
+#ifndef CV_PCAMODEL_INCLUDED
+#define CV_PCAMODEL_INCLUDED
+
+/**
+ * PCA subspace model
+ *
+ * Holds the quantities of a PCA subspace which do not depend on samples
+ * so that samples can be scored repeatedly (e.g., every frame) without
+ * recomputing them, and workspaces which are reused while the number
+ * of samples does not grow.
+ */
+typedef struct CvPcaModel {
+    int D;             /**< Dimension of samples */
+    int M;             /**< Number of principal components */
+    int nEig;          /**< Number of eigenvalues, 0 if not given */
+    int type;          /**< CV_32FC1 or CV_64FC1. Type of computation */
+    CvMat* avg;        /**< D x 1 mean vector */
+    CvMat* eigenvectors; /**< M x D eigen vectors */
+    CvMat* inv_sqrt_lambda; /**< M x 1. 1 / sqrt( eigenvalue ).
+                               NULL if eigenvalues are not given */
+    double rho;        /**< Mean of the residual eigenvalues (M..nEig-1),
+                          0 if nEig == M */
+    double normterm;   /**< Log of the normalization term of the
+                          Gaussian density */
+    double num_samples; /**< (Effective) number of samples the subspace
+                           was estimated from. Required by cvUpdatePcaModel */
+    // workspaces, so that a model must not be shared by concurrent calls
+    int capacity;      /**< Number of samples the workspaces can hold */
+    CvMat* samples0;   /**< D x capacity. Mean subtracted samples */
+    CvMat* proj;       /**< M x capacity. Projected samples */
+    CvMat* sqsums;     /**< 3 x capacity CV_64FC1. Column sums of squares */
+} CvPcaModel;
+
+#ifndef NO_DOXYGEN
+CVAPI(CvPcaModel*)
+cvCreatePcaModel( const CvMat* avg, const CvMat* eigenvalues,
+                  const CvMat* eigenvectors, int type, double num_samples );
+CVAPI(void) cvReleasePcaModel( CvPcaModel** model );
+CVAPI(void)
+cvPcaModelScore( CvPcaModel* model, const CvMat* samples, CvMat* difs,
+                 CvMat* dffs, CvMat* dists, CvMat* logprobs );
+CVAPI(void)
+cvPcaModelDiffs( CvPcaModel* model, const CvMat* samples, CvMat* probs,
+                 int normalize, bool logprob );
+CVAPI(int)
+cvPcaModelProgressiveDiffs( CvPcaModel* model, const CvMat* samples,
+                            CvMat* logprobs, double threshold, int normalize );
+CVAPI(void)
+cvUpdatePcaModel( CvPcaModel* model, const CvMat* samples, double forget );
+#endif
+
+/**
+ * Compute the normalization term from eigenvalues and rho
+ *
+ * @param model
+ */
+CV_INLINE void icvPcaModelNormTerm( CvPcaModel* model )
+{
+    int d, M = model->M;
+    model->normterm = 0;
+    for( d = 0; d < M; d++ ) {
+        model->normterm -= log( model->inv_sqrt_lambda->data.db[d] );
+    }
+    if( M > 0 ) {
+        model->normterm += log(2*M_PI)*(M/2.0);
+    }
+    if( model->nEig > M ) {
+        model->normterm += log(2*M_PI*model->rho) * ((model->nEig - M)/2.0);
+    }
+}
+
+/**
+ * Create PCA subspace model
+ *
+ * @param avg                 D x 1 mean vector
+ * @param eigenvalues         nEig x 1 eigen values. NULL is allowed
+ *                            if only reconstruction distances are required
+ * @param eigenvectors        M x D or D x M (automatically adjusted) eigen vectors
+ * @param type                CV_32FC1 or CV_64FC1. Type of computation.
+ *                            Samples of the same type are not converted.
+ * @param num_samples         Number of samples the subspace was computed
+ *                            from. Required to update the model
+ * @return CvPcaModel*
+ * @see cvCalcPCA
+ */
+CVAPI(CvPcaModel*)
+cvCreatePcaModel( const CvMat* avg, const CvMat* eigenvalues,
+                  const CvMat* eigenvectors, int type CV_DEFAULT(CV_64FC1),
+                  double num_samples CV_DEFAULT(0) )
+{
+    CvPcaModel* model = NULL;
+    int D = avg->rows;
+    int M = (eigenvectors->rows == D) ? eigenvectors->cols : eigenvectors->rows;
+    int nEig = eigenvalues ? eigenvalues->rows : 0;
+    int d;
+    CV_FUNCNAME( "cvCreatePcaModel" );
+    __BEGIN__;
+    CV_ASSERT( CV_IS_MAT(avg) );
+    CV_ASSERT( eigenvalues == NULL || CV_IS_MAT(eigenvalues) );
+    CV_ASSERT( CV_IS_MAT(eigenvectors) );
+    CV_ASSERT( 1 == avg->cols );
+    CV_ASSERT( D == eigenvectors->rows || D == eigenvectors->cols );
+    CV_ASSERT( eigenvalues == NULL || M <= nEig );
+    CV_ASSERT( type == CV_32FC1 || type == CV_64FC1 );
+
+    model = (CvPcaModel*) cvAlloc( sizeof( CvPcaModel ) );
+    model->D = D;
+    model->M = M;
+    model->nEig = nEig;
+    model->type = type;
+    model->num_samples = num_samples;
+    model->avg = cvCreateMat( D, 1, type );
+    cvConvert( avg, model->avg );
+    model->eigenvectors = cvCreateMat( M, D, type );
+    if( D == eigenvectors->rows ) {
+        CvMat* tmp = cvCreateMat( M, D, eigenvectors->type );
+        cvT( eigenvectors, tmp );
+        cvConvert( tmp, model->eigenvectors );
+        cvReleaseMat( &tmp );
+    } else {
+        cvConvert( eigenvectors, model->eigenvectors );
+    }
+
+    // distance in feature space
+    model->normterm = 0;
+    model->rho = 0;
+    model->inv_sqrt_lambda = NULL;
+    model->capacity = 0;
+    model->samples0 = NULL;
+    model->proj = NULL;
+    model->sqsums = NULL;
+    if( eigenvalues == NULL ) EXIT;
+    model->inv_sqrt_lambda = cvCreateMat( MAX( M, 1 ), 1, CV_64FC1 );
+    for( d = 0; d < M; d++ ) {
+        cvmSet( model->inv_sqrt_lambda, d, 0, 1.0 / sqrt( cvmGet( eigenvalues, d, 0 ) ) );
+    }
+
+    // distance from feature space
+    if( nEig > M ) {
+        for( d = M; d < nEig; d++ ) {
+            model->rho += cvmGet( eigenvalues, d, 0 );
+        }
+        model->rho /= ( nEig - M );
+    }
+    icvPcaModelNormTerm( model );
+    __END__;
+    return model;
+}
+
+/**
+ * Release PCA subspace model
+ *
+ * @param model
+ */
+CVAPI(void) cvReleasePcaModel( CvPcaModel** _model )
+{
+    CvPcaModel* model = NULL;
+    CV_FUNCNAME( "cvReleasePcaModel" );
+    __BEGIN__;
+    model = *_model;
+    if( !model ) EXIT;
+    CV_CALL( cvReleaseMat( &model->avg ) );
+    CV_CALL( cvReleaseMat( &model->eigenvectors ) );
+    if( model->inv_sqrt_lambda != NULL )
+        CV_CALL( cvReleaseMat( &model->inv_sqrt_lambda ) );
+    if( model->samples0 != NULL )
+        CV_CALL( cvReleaseMat( &model->samples0 ) );
+    if( model->proj != NULL )
+        CV_CALL( cvReleaseMat( &model->proj ) );
+    if( model->sqsums != NULL )
+        CV_CALL( cvReleaseMat( &model->sqsums ) );
+    CV_CALL( cvFree( _model ) );
+    __END__;
+}
+
+/**
+ * Grow the workspaces to hold N samples
+ *
+ * @param model
+ * @param N
+ */
+CV_INLINE void icvPcaModelReserve( CvPcaModel* model, int N )
+{
+    if( N <= model->capacity ) return;
+    if( model->samples0 != NULL ) cvReleaseMat( &model->samples0 );
+    if( model->proj != NULL ) cvReleaseMat( &model->proj );
+    if( model->sqsums != NULL ) cvReleaseMat( &model->sqsums );
+    model->capacity = N;
+    model->samples0 = cvCreateMat( model->D, N, model->type );
+    model->proj = cvCreateMat( MAX( model->M, 1 ), N, model->type );
+    model->sqsums = cvCreateMat( 3, N, CV_64FC1 );
+}
+
+/**
+ * Subtract the mean from samples
+ *
+ * @param model
+ * @param samples  D x N sample vectors
+ * @param samples0 D x N mean subtracted samples in the type of the model (output)
+ */
+CV_INLINE void
+icvPcaModelSubMean( const CvPcaModel* model, const CvMat* samples,
+                    CvMat* samples0 )
+{
+    int D = model->D, N = samples->cols;
+    int d, n;
+    double mean;
+    if( CV_MAT_TYPE( samples->type ) != model->type )
+        cvConvert( samples, samples0 );
+    for( d = 0; d < D; d++ ) {
+        const CvMat* src = CV_MAT_TYPE( samples->type ) == model->type ? samples : samples0;
+        const uchar* srow = src->data.ptr + d * src->step;
+        uchar* drow = samples0->data.ptr + d * samples0->step;
+        mean = cvmGet( model->avg, d, 0 );
+        if( model->type == CV_32FC1 ) {
+            float fmean = (float) mean;
+            for( n = 0; n < N; n++ )
+                ((float*)drow)[n] = ((const float*)srow)[n] - fmean;
+        } else {
+            for( n = 0; n < N; n++ )
+                ((double*)drow)[n] = ((const double*)srow)[n] - mean;
+        }
+    }
+}
+
+/**
+ * Subtract the mean from samples and project them onto the subspace
+ *
+ * @param model
+ * @param samples  D x N sample vectors
+ * @param samples0 D x N mean subtracted samples (output)
+ * @param proj     M x N projected samples (output)
+ */
+CV_INLINE void
+icvPcaModelProject( const CvPcaModel* model, const CvMat* samples,
+                    CvMat* samples0, CvMat* proj )
+{
+    icvPcaModelSubMean( model, samples, samples0 );
+    if( model->M > 0 )
+        cvMatMul( model->eigenvectors, samples0, proj );
+}
+
+/**
+ * Sum of squares of each column of a matrix, optionally row scaled
+ *
+ * @param mat    rows x N, CV_32FC1 or CV_64FC1
+ * @param scale  rows x 1 CV_64FC1 scales of rows or NULL
+ * @param sums   N sums (output)
+ */
+CV_INLINE void
+icvPcaColSqSum( const CvMat* mat, const CvMat* scale, double* sums )
+{
+    int r, n, N = mat->cols;
+    double s, v;
+    for( n = 0; n < N; n++ ) sums[n] = 0;
+    for( r = 0; r < mat->rows; r++ ) {
+        const uchar* row = mat->data.ptr + r * mat->step;
+        s = scale ? scale->data.db[r] : 1.0;
+        s *= s;
+        if( CV_MAT_DEPTH( mat->type ) == CV_32F ) {
+            for( n = 0; n < N; n++ ) {
+                v = ((const float*)row)[n];
+                sums[n] += s * v * v;
+            }
+        } else {
+            for( n = 0; n < N; n++ ) {
+                v = ((const double*)row)[n];
+                sums[n] += s * v * v;
+            }
+        }
+    }
+}
+
+/**
+ * Score samples with a PCA subspace model from a single projection
+ *
+ * Any of the outputs may be NULL, and only what is required for
+ * the requested outputs is computed. Samples are projected once
+ * in the type of the model, so CV_32FC1 samples are not converted
+ * with a CV_32FC1 model.
+ *
+ * @param model               PCA subspace model
+ * @param samples             D x N sample vectors
+ * @param difs                1 x N distance-in-feature-space,
+ *                            sum of (projection / sqrt(eigenvalue))^2
+ * @param dffs                1 x N distance-from-feature-space,
+ *                            reconstruction distance / rho
+ * @param dists               1 x N reconstruction distances, i.e.,
+ *                            squared reconstruction errors as cvMatPcaDist
+ * @param logprobs            1 x N log likelihoods with the normalization
+ *                            term as cvMatPcaDiffs( normalize = 1 )
+ * @see cvMatPcaDiffs
+ * @see cvMatPcaDist
+ */
+CVAPI(void)
+cvPcaModelScore( CvPcaModel* model, const CvMat* samples, CvMat* difs,
+                 CvMat* dffs, CvMat* dists, CvMat* logprobs )
+{
+    int D = model->D, M = model->M, N = samples->cols;
+    int n;
+    bool need_difs = ( difs != NULL || logprobs != NULL );
+    bool need_dffs = ( dffs != NULL || logprobs != NULL ) && model->nEig > M;
+    bool need_dist = ( dists != NULL || need_dffs );
+    double *_difs = NULL, *sqnorm = NULL, *sqproj = NULL;
+    double dist;
+    CvMat samples0, proj;
+    CV_FUNCNAME( "cvPcaModelScore" );
+    __BEGIN__;
+    CV_ASSERT( CV_IS_MAT(samples) );
+    CV_ASSERT( D == samples->rows );
+    CV_ASSERT( difs == NULL || ( 1 == difs->rows && N == difs->cols ) );
+    CV_ASSERT( dffs == NULL || ( 1 == dffs->rows && N == dffs->cols ) );
+    CV_ASSERT( dists == NULL || ( 1 == dists->rows && N == dists->cols ) );
+    CV_ASSERT( logprobs == NULL || ( 1 == logprobs->rows && N == logprobs->cols ) );
+    if( need_difs || dffs != NULL ) {
+        CV_ASSERT( model->inv_sqrt_lambda != NULL ); // eigenvalues are required
+    }
+
+    icvPcaModelReserve( model, N );
+    cvGetCols( model->samples0, &samples0, 0, N );
+    cvGetCols( model->proj, &proj, 0, N );
+    icvPcaModelProject( model, samples, &samples0, &proj );
+
+    _difs  = model->sqsums->data.db;
+    sqnorm = (double*)( model->sqsums->data.ptr + model->sqsums->step );
+    sqproj = (double*)( model->sqsums->data.ptr + 2 * model->sqsums->step );
+    for( n = 0; n < N; n++ ) _difs[n] = sqnorm[n] = sqproj[n] = 0;
+    if( M > 0 && need_difs ) {
+        icvPcaColSqSum( &proj, model->inv_sqrt_lambda, _difs );
+    }
+    if( need_dist ) {
+        icvPcaColSqSum( &samples0, NULL, sqnorm );
+        if( M > 0 ) icvPcaColSqSum( &proj, NULL, sqproj );
+    }
+
+    for( n = 0; n < N; n++ ) {
+        dist = sqnorm[n] - sqproj[n];
+        if( difs != NULL ) cvmSet( difs, 0, n, _difs[n] );
+        if( dists != NULL ) cvmSet( dists, 0, n, dist );
+        if( need_dffs ) {
+            dist /= model->rho;
+        } else {
+            dist = 0;
+        }
+        if( dffs != NULL ) cvmSet( dffs, 0, n, dist );
+        if( logprobs != NULL ) {
+            cvmSet( logprobs, 0, n, _difs[n] / (-2) + dist / (-2) - model->normterm );
+        }
+    }
+    __END__;
+}
+
+/**
+ * PCA Distance "in" and "from" feature space with a PCA subspace model
+ *
+ * Same with cvMatPcaDiffs, but the mean subtraction, one matrix
+ * multiplication and column reductions are all that are computed
+ * per call.
+ *
+ * @param model               PCA subspace model
+ * @param samples             D x N sample vectors
+ * @param probs               1 x N computed likelihood probabilities
+ * @param normalize           Compute normalization term or not
+ *                            0 - nothing
+ *                            1 - normalization term
+ *                            2 - normalize so that sum becomes 1.0
+ * @param logprob             Log probability or not
+ * @see cvMatPcaDiffs
+ * @see cvPcaModelScore
+ */
+CVAPI(void)
+cvPcaModelDiffs( CvPcaModel* model, const CvMat* samples, CvMat* probs,
+                 int normalize CV_DEFAULT(1), bool logprob CV_DEFAULT(false) )
+{
+    int N = samples->cols;
+    int n;
+    CV_FUNCNAME( "cvPcaModelDiffs" );
+    __BEGIN__;
+    CV_ASSERT( 1 == probs->rows && N == probs->cols );
+
+    CV_CALL( cvPcaModelScore( model, samples, NULL, NULL, NULL, probs ) );
+    if( normalize != 1 ) {
+        cvAddS( probs, cvScalar( model->normterm ), probs );
+    }
+
+    // normalization and so on
+    if( normalize == 2 ) {
+        double minval, maxval;
+        cvMinMaxLoc( probs, &minval, &maxval );
+        cvSubS( probs, cvScalar( maxval ), probs );
+    }
+    if( !logprob || normalize == 2 ) {
+        for( n = 0; n < N; n++ ) {
+            cvmSet( probs, 0, n, exp(cvmGet( probs, 0, n )) );
+        }
+        if( normalize == 2 ) {
+            CvScalar sumprob = cvSum( probs );
+            cvScale( probs, probs, 1.0 / sumprob.val[0] );
+        }
+    }
+    if( logprob && normalize == 2 ) {
+        for( n = 0; n < N; n++ ) {
+            cvmSet( probs, 0, n, log(cvmGet( probs, 0, n )) );
+        }
+    }
+    __END__;
+}
+
+
+/**
+ * Move the columns of a matrix whose ids are not negative to the front
+ *
+ * @param mat    rows x N, CV_32FC1 or CV_64FC1. May contain ids as a row
+ * @param ids    N ids, negative for columns to drop
+ * @param N      number of columns
+ * @return int   number of columns kept
+ */
+CV_INLINE int icvPcaCompactCols( CvMat* mat, const double* ids, int N )
+{
+    int r, i, j = 0;
+    for( r = 0; r < mat->rows; r++ ) {
+        uchar* row = mat->data.ptr + r * mat->step;
+        if( CV_MAT_DEPTH( mat->type ) == CV_32F ) {
+            for( i = 0, j = 0; i < N; i++ )
+                if( ids[i] >= 0 ) ((float*)row)[j++] = ((float*)row)[i];
+        } else {
+            for( i = 0, j = 0; i < N; i++ )
+                if( ids[i] >= 0 ) ((double*)row)[j++] = ((double*)row)[i];
+        }
+    }
+    return j;
+}
+
+/**
+ * PCA Distance "in" and "from" feature space with early termination
+ *
+ * Samples are projected onto eigenvectors in stages of the leading
+ * 1, 2, 4, 8, ... components (eigenvalues are descending as cvCalcPCA
+ * gives), each stage by one matrix multiplication over the samples
+ * still scored. After k components, the remaining cost is at least
+ * (residual energy) / (k-th eigenvalue) because no later eigenvalue
+ * nor rho is larger, which gives an upper bound of the final log
+ * likelihood, and at most (residual energy) / rho (or the last
+ * eigenvalue without rho), which gives a lower bound. Between stages,
+ * scoring of a sample stops once its upper bound falls below the best
+ * lower bound so far by more than threshold, and the upper bound is
+ * stored instead. Such samples are less likely than the best by a
+ * factor of exp(-threshold) at least, so they are negligible after
+ * normalization for a large enough threshold. The others are scored
+ * exactly as cvPcaModelDiffs.
+ *
+ * The workspaces of the model are used, so nothing is allocated once
+ * they hold N samples.
+ *
+ * @param model               PCA subspace model
+ * @param samples             D x N sample vectors
+ * @param logprobs            1 x N log likelihoods, or their upper bounds
+ *                            for samples terminated early
+ * @param threshold           Log likelihood margin from the best.
+ *                            Nothing terminates if DBL_MAX
+ * @param normalize           Compute normalization term or not
+ *                            0 - nothing
+ *                            1 - normalization term
+ * @return int                The number of samples terminated early
+ * @see cvPcaModelDiffs
+ */
+CVAPI(int)
+cvPcaModelProgressiveDiffs( CvPcaModel* model, const CvMat* samples,
+                            CvMat* logprobs, double threshold,
+                            int normalize CV_DEFAULT(1) )
+{
+    int D = model->D, M = model->M, N = samples->cols;
+    int i, k, k1, r, num_active = N, num_terminated = 0;
+    bool has_dffs = model->nEig > M;
+    double normterm = ( normalize == 1 ) ? model->normterm : 0;
+    double best = -DBL_MAX;
+    double *difs = NULL, *residual = NULL, *ids = NULL;
+    double s, p, inv_lambda_next, inv_lambda_max, lower, upper, logprob;
+    const uchar* row;
+    CvMat samples0, proj, eigenvectors, sqsums;
+    CV_FUNCNAME( "cvPcaModelProgressiveDiffs" );
+    __BEGIN__;
+    CV_ASSERT( CV_IS_MAT(samples) );
+    CV_ASSERT( D == samples->rows );
+    CV_ASSERT( 1 == logprobs->rows && N == logprobs->cols );
+    CV_ASSERT( model->inv_sqrt_lambda != NULL ); // eigenvalues are required
+    CV_ASSERT( CV_MAT_DEPTH( samples->type ) == CV_32F || 
+               CV_MAT_DEPTH( samples->type ) == CV_64F );
+    CV_ASSERT( normalize == 0 || normalize == 1 );
+
+    // mean subtracted samples and their energies
+    icvPcaModelReserve( model, N );
+    cvGetCols( model->samples0, &samples0, 0, N );
+    icvPcaModelSubMean( model, samples, &samples0 );
+    difs     = model->sqsums->data.db;
+    residual = (double*)( model->sqsums->data.ptr + model->sqsums->step );
+    ids      = (double*)( model->sqsums->data.ptr + 2 * model->sqsums->step );
+    icvPcaColSqSum( &samples0, NULL, residual );
+    for( i = 0; i < N; i++ ) {
+        difs[i] = 0;
+        ids[i] = i;
+    }
+    if( has_dffs ) {
+        inv_lambda_max = 1.0 / model->rho;
+    } else if( M > 0 ) {
+        s = model->inv_sqrt_lambda->data.db[M-1];
+        inv_lambda_max = s * s;
+    } else {
+        inv_lambda_max = 0;
+    }
+
+    for( k = 0; k < M && num_active > 0; k = k1 ) {
+        // bound the final log likelihoods from k components
+        s = model->inv_sqrt_lambda->data.db[k];
+        inv_lambda_next = has_dffs ? s * s : 0;
+        for( i = 0; i < num_active; i++ ) {
+            lower = ( difs[i] + MAX( residual[i], 0 ) * inv_lambda_max ) / (-2) - normterm;
+            best = MAX( best, lower );
+        }
+        for( i = 0; i < num_active; i++ ) {
+            upper = ( difs[i] + MAX( residual[i], 0 ) * inv_lambda_next ) / (-2) - normterm;
+            if( upper < best - threshold ) {
+                cvmSet( logprobs, 0, (int)ids[i], upper );
+                ids[i] = -1;
+                num_terminated++;
+            }
+        }
+        if( num_active > N - num_terminated ) {
+            cvGetCols( model->samples0, &samples0, 0, num_active );
+            cvGetCols( model->sqsums, &sqsums, 0, num_active );
+            icvPcaCompactCols( &samples0, ids, num_active );
+            num_active = icvPcaCompactCols( &sqsums, ids, num_active );
+            if( num_active == 0 ) break;
+        }
+
+        // project the rest onto the next stage of components at once
+        k1 = MIN( M, MAX( 2 * k, 1 ) );
+        cvGetRows( model->eigenvectors, &eigenvectors, k, k1 );
+        cvGetCols( model->samples0, &samples0, 0, num_active );
+        cvGetSubRect( model->proj, &proj, cvRect( 0, 0, num_active, k1 - k ) );
+        cvMatMul( &eigenvectors, &samples0, &proj );
+        for( r = 0; r < k1 - k; r++ ) {
+            row = proj.data.ptr + r * proj.step;
+            s = model->inv_sqrt_lambda->data.db[k + r];
+            s *= s;
+            if( model->type == CV_32FC1 ) {
+                for( i = 0; i < num_active; i++ ) {
+                    p = ((const float*)row)[i];
+                    difs[i] += p * p * s;
+                    residual[i] -= p * p;
+                }
+            } else {
+                for( i = 0; i < num_active; i++ ) {
+                    p = ((const double*)row)[i];
+                    difs[i] += p * p * s;
+                    residual[i] -= p * p;
+                }
+            }
+        }
+    }
+
+    // the rest are scored with all the components
+    for( i = 0; i < num_active; i++ ) {
+        logprob = ( difs[i] + ( has_dffs ? MAX( residual[i], 0 ) / model->rho : 0 ) ) / (-2) - normterm;
+        cvmSet( logprobs, 0, (int)ids[i], logprob );
+    }
+    __END__;
+    return num_terminated;
+}
+
+/**
+ * Fold new samples into a PCA subspace model incrementally
+ *
+ * Sequential Karhunen-Loeve with the mean update of [1]. The old
+ * subspace is represented by its singular values sqrt( num_samples *
+ * eigenvalue ), new samples and the mean shift are decomposed into the
+ * part in the subspace and the orthonormalized residual, and only a
+ * (M + N + 1) x (M + N + 1) matrix is decomposed by SVD. The cost is
+ * O(D (M + N)^2), independent of the number of samples seen so far.
+ *
+ * The number of principal components M is kept. The number of
+ * eigenvalues nEig is kept as well, and rho becomes the discarded
+ * energy (the old residual energy plus the energy of the new singular
+ * values beyond M) averaged over the nEig - M residual eigenvalues.
+ *
+ * @param model               PCA subspace model with eigenvalues and
+ *                            num_samples
+ * @param samples             D x N new sample vectors
+ * @param forget              Forgetting factor in (0, 1]. The old
+ *                            singular values are scaled by this and the
+ *                            old number of samples too, so that 1 means
+ *                            no forgetting
+ * @see cvCalcPCA
+ *
+ * References
+ * @verbatim
+ *   [1] @ARTICLE{Ross08incremental,
+ *     author = {David A. Ross and Jongwoo Lim and Ruei-Sung Lin and Ming-Hsuan Yang},
+ *     title = {Incremental Learning for Robust Visual Tracking},
+ *     journal = {International Journal of Computer Vision},
+ *     year = {2008},
+ *     volume = {77},
+ *     pages = {125--141}
+ *   }
+ * @endverbatim
+ */
+CVAPI(void)
+cvUpdatePcaModel( CvPcaModel* model, const CvMat* samples,
+                  double forget CV_DEFAULT(1.0) )
+{
+    int D = model->D, M = model->M, N = samples->cols;
+    int K = M + N + 1;
+    int d, i, j, k;
+    double n, fn, n2, scale, norm, orig_norm, dot, energy;
+    double *mean = NULL;
+    CvMat *B = NULL, *P = NULL, *stack = NULL, *R = NULL, *W = NULL, *U = NULL;
+    CvMat *newvec = NULL;
+    CvMat Bhdr, eigvec, Q, Ucols;
+    CV_FUNCNAME( "cvUpdatePcaModel" );
+    __BEGIN__;
+    CV_ASSERT( CV_IS_MAT(samples) );
+    CV_ASSERT( D == samples->rows && N > 0 );
+    CV_ASSERT( M > 0 && model->inv_sqrt_lambda != NULL ); // eigenvalues are required
+    CV_ASSERT( model->num_samples > 0 );
+    CV_ASSERT( 0 < forget && forget <= 1 );
+
+    n  = model->num_samples;
+    fn = forget * n;
+    n2 = fn + N;
+
+    // mean subtracted new samples and the mean shift
+    CV_CALL( mean = (double*) cvAlloc( D * sizeof( double ) ) );
+    CV_CALL( B = cvCreateMat( D, N + 1, CV_64FC1 ) );
+    CV_CALL( cvConvert( samples, cvGetCols( B, &Bhdr, 0, N ) ) );
+    scale = sqrt( fn * N / n2 );
+    for( d = 0; d < D; d++ ) {
+        double* row = (double*)( B->data.ptr + d * B->step );
+        mean[d] = 0;
+        for( j = 0; j < N; j++ ) mean[d] += row[j];
+        mean[d] /= N;
+        for( j = 0; j < N; j++ ) row[j] -= mean[d];
+        row[N] = scale * ( mean[d] - cvmGet( model->avg, d, 0 ) );
+    }
+
+    // [ old eigenvectors; orthonormalized residual ] as K x D rows
+    CV_CALL( stack = cvCreateMat( K, D, CV_64FC1 ) );
+    cvGetRows( stack, &eigvec, 0, M );
+    cvGetRows( stack, &Q, M, K );
+    cvConvert( model->eigenvectors, &eigvec );
+    CV_CALL( P = cvCreateMat( M, N + 1, CV_64FC1 ) );
+    cvMatMul( &eigvec, B, P );
+    cvGEMM( P, &eigvec, -1, B, 1, &Q, CV_GEMM_A_T + CV_GEMM_C_T );
+
+    // R = [ forget * diag(sigma), P; 0, Q' * residual ]
+    CV_CALL( R = cvCreateMat( K, K, CV_64FC1 ) );
+    cvZero( R );
+    for( i = 0; i < M; i++ ) {
+        cvmSet( R, i, i, forget * sqrt( n ) / model->inv_sqrt_lambda->data.db[i] );
+        for( j = 0; j <= N; j++ ) {
+            cvmSet( R, i, M + j, cvmGet( P, i, j ) );
+        }
+    }
+    for( j = 0; j <= N; j++ ) { // modified Gram-Schmidt
+        double* qj = (double*)( Q.data.ptr + j * Q.step );
+        orig_norm = 0;
+        for( d = 0; d < D; d++ ) orig_norm += qj[d] * qj[d];
+        for( i = 0; i < j; i++ ) {
+            const double* qi = (const double*)( Q.data.ptr + i * Q.step );
+            dot = 0;
+            for( d = 0; d < D; d++ ) dot += qi[d] * qj[d];
+            for( d = 0; d < D; d++ ) qj[d] -= dot * qi[d];
+            cvmSet( R, M + i, M + j, dot );
+        }
+        norm = 0;
+        for( d = 0; d < D; d++ ) norm += qj[d] * qj[d];
+        if( norm > DBL_EPSILON * orig_norm && norm > 0 ) {
+            norm = sqrt( norm );
+            for( d = 0; d < D; d++ ) qj[d] /= norm;
+            cvmSet( R, M + j, M + j, norm );
+        } else { // already spanned
+            for( d = 0; d < D; d++ ) qj[d] = 0;
+        }
+    }
+
+    // rotate the subspace by the left singular vectors of R
+    CV_CALL( W = cvCreateMat( K, 1, CV_64FC1 ) );
+    CV_CALL( U = cvCreateMat( K, K, CV_64FC1 ) );
+    CV_CALL( cvSVD( R, W, U, NULL, 0 ) );
+    CV_CALL( newvec = cvCreateMat( M, D, CV_64FC1 ) );
+    cvGetCols( U, &Ucols, 0, M );
+    cvGEMM( &Ucols, stack, 1, NULL, 0, newvec, CV_GEMM_A_T );
+    cvConvert( newvec, model->eigenvectors );
+
+    // eigenvalues and the residual
+    for( i = 0; i < M; i++ ) {
+        model->inv_sqrt_lambda->data.db[i] = 
+            sqrt( n2 ) / MAX( W->data.db[i], DBL_EPSILON * W->data.db[0] );
+    }
+    if( model->nEig > M ) {
+        energy = forget * forget * n * model->rho * ( model->nEig - M );
+        for( k = M; k < K; k++ ) {
+            energy += W->data.db[k] * W->data.db[k];
+        }
+        model->rho = energy / ( n2 * ( model->nEig - M ) );
+    }
+    for( d = 0; d < D; d++ ) {
+        cvmSet( model->avg, d, 0, ( fn * cvmGet( model->avg, d, 0 ) + N * mean[d] ) / n2 );
+    }
+    model->num_samples = n2;
+    icvPcaModelNormTerm( model );
+    __END__;
+    cvFree( &mean );
+    cvReleaseMat( &B );
+    cvReleaseMat( &P );
+    cvReleaseMat( &stack );
+    cvReleaseMat( &R );
+    cvReleaseMat( &W );
+    cvReleaseMat( &U );
+    cvReleaseMat( &newvec );
+}
+
+#endif
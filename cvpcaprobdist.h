@@ -23,6 +23,9 @@
 #include "cvlogsum.h"
 
 #ifndef NO_DOXYGEN
+CVAPI(void)
+cvPcaModelProbDist( CvPcaModel* model, const CvMat* samples, double sqsigma,
+                    CvMat* probs, int normalize, bool logprob );
 CVAPI(void) 
 cvMatPcaProbDist( const CvMat* samples, const CvMat* avg, 
                   const CvMat* eigenvectors, double sqsigma, CvMat* probs,
@@ -35,10 +38,14 @@ cvPcaProbDist( const CvMat* sample, const CvMat* avg,
 
 /**
  * Probabilistic model of Distance from PCA subspace with Gaussian
+ * with a PCA subspace model
  *
+ * Same with cvMatPcaProbDist, but the model is not created per call.
+ * Distances are computed into probs directly, so nothing is allocated
+ * once the workspaces of the model hold N samples.
+ *
+ * @param model               PCA subspace model. Eigenvalues are not required
  * @param samples             D x N sample vectors
- * @param avg                 D x 1 mean vector
- * @param eigenvectors        M x D or D x M (automatically adjusted) eigen vectors
  * @param sqsigma             A scalar representing sigma^2, i.e, variances
  *                            of distribution of reconstruction errors.
  *                            Estimate in training data. 
@@ -48,32 +55,22 @@ cvPcaProbDist( const CvMat* sample, const CvMat* avg,
  *                            1 - normalization term
  *                            2 - normalize so that sum becomes 1.0
  * @param logprob             Log probability or not
- *
- * @see CVAPI(void) cvCalcPCA( const CvArr* data, CvArr* avg, CvArr* eigenvalues, CvArr* eigenvectors, int flags );
- * @see CVAPI(void) cvProjectPCA( const CvArr* data, const CvArr* avg, const CvArr* eigenvectors, CvArr* result );
- * @see CVAPI(void) cvBackProjectPCA( const CvArr* proj, const CvArr* avg,const CvArr* eigenvects, CvArr* result );
- * @see cvMatPcaDist
+ * @see cvMatPcaProbDist
+ * @see cvPcaModelScore
  */
-CVAPI(void) 
-cvMatPcaProbDist( const CvMat* samples, const CvMat* avg, 
-                  const CvMat* eigenvectors, double sqsigma, CvMat* probs,
-                  int normalize CV_DEFAULT(1), bool logprob CV_DEFAULT(false) )
+CVAPI(void)
+cvPcaModelProbDist( CvPcaModel* model, const CvMat* samples, double sqsigma,
+                    CvMat* probs, int normalize CV_DEFAULT(1),
+                    bool logprob CV_DEFAULT(false) )
 {
-    int D = samples->rows;
     int N = samples->cols;
-    int type = samples->type;
-    CvMat *dists = cvCreateMat( 1, N, type );
-    CV_FUNCNAME( "cvMatPcaProbDist" );
+    CV_FUNCNAME( "cvPcaModelProbDist" );
     __BEGIN__;
-    CV_ASSERT( CV_IS_MAT(samples) );
-    CV_ASSERT( CV_IS_MAT(avg) );
-    CV_ASSERT( CV_IS_MAT(eigenvectors) );
-    CV_ASSERT( D == eigenvectors->rows || D == eigenvectors->cols );
-    CV_ASSERT( D == avg->rows && 1 == avg->cols );
+    CV_ASSERT( CV_IS_MAT(probs) );
     CV_ASSERT( 1 == probs->rows && N == probs->cols );
 
-    cvMatPcaDist( samples, avg, eigenvectors, dists );
-    cvScale( dists, probs, -1/(2*sqsigma) );
+    CV_CALL( cvPcaModelScore( model, samples, NULL, NULL, probs, NULL ) );
+    cvScale( probs, probs, -1/(2*sqsigma) );
 
     if( normalize == 1 )
     {
@@ -89,11 +86,56 @@ cvMatPcaProbDist( const CvMat* samples, const CvMat* avg,
     {
         cvExp( probs, probs );
     }
-    
-    cvReleaseMat( &dists );
     __END__;
 }
 
+/**
+ * Probabilistic model of Distance from PCA subspace with Gaussian
+ *
+ * Each call creates and releases a CvPcaModel. To compute probabilities
+ * against the same subspace repeatedly, create a CvPcaModel once and
+ * use cvPcaModelProbDist instead.
+ *
+ * @param samples             D x N sample vectors
+ * @param avg                 D x 1 mean vector
+ * @param eigenvectors        M x D or D x M (automatically adjusted) eigen vectors
+ * @param sqsigma             A scalar representing sigma^2, i.e, variances
+ *                            of distribution of reconstruction errors.
+ *                            Estimate in training data. 
+ * @param probs               1 x N computed likelihood probabilities
+ * @param normalize           Compute normalization term or not
+ *                            0 - nothing
+ *                            1 - normalization term
+ *                            2 - normalize so that sum becomes 1.0
+ * @param logprob             Log probability or not
+ *
+ * @see CVAPI(void) cvCalcPCA( const CvArr* data, CvArr* avg, CvArr* eigenvalues, CvArr* eigenvectors, int flags );
+ * @see CVAPI(void) cvProjectPCA( const CvArr* data, const CvArr* avg, const CvArr* eigenvectors, CvArr* result );
+ * @see CVAPI(void) cvBackProjectPCA( const CvArr* proj, const CvArr* avg,const CvArr* eigenvects, CvArr* result );
+ * @see cvMatPcaDist
+ * @see cvPcaModelProbDist
+ */
+CVAPI(void) 
+cvMatPcaProbDist( const CvMat* samples, const CvMat* avg, 
+                  const CvMat* eigenvectors, double sqsigma, CvMat* probs,
+                  int normalize CV_DEFAULT(1), bool logprob CV_DEFAULT(false) )
+{
+    CvPcaModel* model = NULL;
+    CV_FUNCNAME( "cvMatPcaProbDist" );
+    __BEGIN__;
+    CV_ASSERT( CV_IS_MAT(samples) );
+    CV_ASSERT( CV_IS_MAT(avg) );
+    CV_ASSERT( CV_IS_MAT(eigenvectors) );
+    CV_ASSERT( samples->rows == avg->rows && 1 == avg->cols );
+
+    CV_CALL( model = cvCreatePcaModel( avg, NULL, eigenvectors,
+                                       CV_MAT_TYPE( samples->type ) ) );
+    CV_CALL( cvPcaModelProbDist( model, samples, sqsigma, probs,
+                                 normalize, logprob ) );
+    __END__;
+    cvReleasePcaModel( &model );
+}
+
 /**
  * Distance between sample and PCA subspace, i.e, reconstruction error
  * Probabiliticlly model with Gaussian
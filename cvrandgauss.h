@@ -36,11 +36,9 @@
  */
 CV_INLINE double cvRandGauss( CvRNG* rng, double sigma )
 {
-    CvMat* mat = cvCreateMat( 1, 1, CV_64FC1 );
     double var = 0;
-    cvRandArr( rng, mat, CV_RAND_NORMAL, cvRealScalar(0), cvRealScalar(sigma) );
-    var = cvmGet( mat, 0, 0 );
-    cvReleaseMat( &mat );
+    CvMat mat = cvMat( 1, 1, CV_64FC1, &var );
+    cvRandArr( rng, &mat, CV_RAND_NORMAL, cvRealScalar(0), cvRealScalar(sigma) );
     return var;
 }
 /*
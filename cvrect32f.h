@@ -196,12 +196,12 @@ CvRect32f cvRect32fFromBox32f( CvBox32f box )
     l.y = ( 2 * box.cy + 1 - box.height ) / 2.0;
     if( box.angle != 0.0 )
     {
-        CvMat* R = cvCreateMat( 2, 3, CV_32FC1 );
-        cv2DRotationMatrix( cvPoint2D32f( box.cx, box.cy ), box.angle, 1.0, R );
+        float r[6];
+        CvMat R = cvMat( 2, 3, CV_32FC1, r );
+        cv2DRotationMatrix( cvPoint2D32f( box.cx, box.cy ), box.angle, 1.0, &R );
         l = cvPoint2D32f (
-            cvmGet( R, 0, 0 ) * l.x + cvmGet( R, 0, 1 ) * l.y + cvmGet( R, 0, 2 ),
-            cvmGet( R, 1, 0 ) * l.x + cvmGet( R, 1, 1 ) * l.y + cvmGet( R, 1, 2 ) );
-        cvReleaseMat( &R );
+            r[0] * l.x + r[1] * l.y + r[2],
+            r[3] * l.x + r[4] * l.y + r[5] );
     }
     return cvRect32f( l.x, l.y, box.width, box.height, box.angle );
 }
@@ -0,0 +1,84 @@
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#pragma comment(lib, "cv.lib")
+#pragma comment(lib, "cxcore.lib")
+#pragma comment(lib, "cvaux.lib")
+#pragma comment(lib, "highgui.lib")
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cv.h"
+#include "cvaux.h"
+#include "cxcore.h"
+#include "highgui.h"
+#include "cvcropimageroi.h"
+#include "cvcropresizeimageroi.h"
+
+#include <cxxtest/TestSuite.h>
+
+class CvCropResizeImageROITest : public CxxTest::TestSuite
+{
+public:
+    // Mean and max absolute difference between cvCropResizeImageROI and
+    // cvCropImageROI followed by cvResize( CV_INTER_AREA )
+    void compare( const IplImage* img, CvRect32f rect32f, CvSize size,
+                  double* meandiff, double* maxdiff )
+    {
+        CvRect rect = cvRectFromRect32f( rect32f );
+        IplImage *crop = cvCreateImage( cvSize( rect.width, rect.height ), img->depth, img->nChannels );
+        IplImage *ref = cvCreateImage( size, img->depth, img->nChannels );
+        CvMat *dst = cvCreateMat( size.height, size.width, CV_8UC3 );
+        cvCropImageROI( img, crop, rect32f );
+        cvResize( crop, ref, CV_INTER_AREA );
+        cvCropResizeImageROI( img, dst, rect32f );
+
+        *meandiff = *maxdiff = 0;
+        for( int y = 0; y < size.height; y++ ) {
+            for( int x = 0; x < size.width; x++ ) {
+                CvScalar a = cvGet2D( ref, y, x ), b = cvGet2D( dst, y, x );
+                for( int ch = 0; ch < 3; ch++ ) {
+                    double diff = fabs( a.val[ch] - b.val[ch] );
+                    *meandiff += diff;
+                    *maxdiff = MAX( *maxdiff, diff );
+                }
+            }
+        }
+        *meandiff /= size.width * size.height * 3;
+        cvReleaseMat( &dst );
+        cvReleaseImage( &ref );
+        cvReleaseImage( &crop );
+    }
+
+    void testAxisAligned()
+    {
+        IplImage *img = cvLoadImage( "lena.png" );
+        double meandiff, maxdiff;
+        TS_ASSERT( img != NULL );
+        // exact pixels averaged 2 x 2, only 8U rounding differs
+        compare( img, cvRect32f( 64, 80, 96, 64, 0 ), cvSize( 48, 32 ), &meandiff, &maxdiff );
+        TS_ASSERT( maxdiff <= 1 );
+        TS_ASSERT( meandiff < 0.5 );
+        compare( img, cvRect32f( 20, 30, 120, 90, 0 ), cvSize( 40, 30 ), &meandiff, &maxdiff );
+        TS_ASSERT( maxdiff <= 1 );
+        TS_ASSERT( meandiff < 0.5 );
+        cvReleaseImage( &img );
+    }
+
+    void testRotated()
+    {
+        IplImage *img = cvLoadImage( "lena.png" );
+        double meandiff, maxdiff;
+        TS_ASSERT( img != NULL );
+        // the same bilinear samples, but cvCropImageROI rounds each of
+        // them to 8U before averaging
+        compare( img, cvRect32f( 128, 60, 80, 60, 30 ), cvSize( 40, 30 ), &meandiff, &maxdiff );
+        TS_ASSERT( maxdiff <= 2 );
+        TS_ASSERT( meandiff < 0.5 );
+        compare( img, cvRect32f( 100, 100, 90, 60, -45 ), cvSize( 30, 20 ), &meandiff, &maxdiff );
+        TS_ASSERT( maxdiff <= 2 );
+        TS_ASSERT( meandiff < 0.5 );
+        cvReleaseImage( &img );
+    }
+
+};
@@ -32,5 +32,9 @@ public:
         TS_ASSERT_DELTA( color.val[0], 175, 0.00001 );
         color = cvGet2DInter( &mat, -0.4, 1.5 );
         TS_ASSERT_DELTA( color.val[0], 150, 0.00001 );
+        color = cvGet2DInter( &mat, 0, 1.25 );
+        TS_ASSERT_DELTA( color.val[0], 125, 0.00001 );
+        color = cvGet2DInter( &mat, 1.75, 1 );
+        TS_ASSERT_DELTA( color.val[0], 87.5, 0.00001 );
     }
 };
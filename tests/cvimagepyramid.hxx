@@ -0,0 +1,80 @@
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#pragma comment(lib, "cv.lib")
+#pragma comment(lib, "cxcore.lib")
+#pragma comment(lib, "cvaux.lib")
+#pragma comment(lib, "highgui.lib")
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cv.h"
+#include "cvaux.h"
+#include "cxcore.h"
+#include "highgui.h"
+#include "cvimagepyramid.h"
+
+#include <cxxtest/TestSuite.h>
+
+class CvImagePyramidTest : public CxxTest::TestSuite
+{
+public:
+    void testReleaseKeepsOriginal()
+    {
+        IplImage *img = cvCreateImage( cvSize( 64, 48 ), IPL_DEPTH_8U, 3 );
+        char *data = img->imageData;
+        cvSet( img, cvScalar( 10, 20, 30 ) );
+
+        // level 0 borrows the pixels of img
+        CvImagePyramid *pyramid = cvCreateImagePyramid( img, 3 );
+        TS_ASSERT_EQUALS( pyramid->levels, 3 );
+        TS_ASSERT( pyramid->shared );
+        TS_ASSERT_EQUALS( pyramid->images[0]->imageData, data );
+        TS_ASSERT_EQUALS( pyramid->images[2]->width, 16 );
+        TS_ASSERT_EQUALS( pyramid->images[2]->height, 12 );
+        cvReleaseImagePyramid( &pyramid );
+        TS_ASSERT( pyramid == NULL );
+
+        // img is still owned and usable by the caller
+        TS_ASSERT_EQUALS( img->imageData, data );
+        TS_ASSERT_DELTA( cvGet2D( img, 47, 63 ).val[2], 30, 1e-9 );
+        cvSet( img, cvScalar( 1, 2, 3 ) );
+        TS_ASSERT_DELTA( cvGet2D( img, 0, 0 ).val[0], 1, 1e-9 );
+
+        // a single level (observe_pyramid = 0) is the borrowed image only
+        pyramid = cvCreateImagePyramid( img, 1 );
+        cvReleaseImagePyramid( &pyramid );
+        TS_ASSERT_DELTA( cvGet2D( img, 10, 10 ).val[1], 2, 1e-9 );
+
+        // gray conversion owns its level 0
+        pyramid = cvCreateImagePyramid( img, 2, CV_CROPRESIZE_GRAY );
+        TS_ASSERT( !pyramid->shared );
+        TS_ASSERT_EQUALS( pyramid->images[0]->nChannels, 1 );
+        cvReleaseImagePyramid( &pyramid );
+        TS_ASSERT_DELTA( cvGet2D( img, 10, 10 ).val[2], 3, 1e-9 );
+
+        cvReleaseImage( &img );
+    }
+
+    void testCropResizeImagePyramidROI()
+    {
+        IplImage *img = cvCreateImage( cvSize( 128, 128 ), IPL_DEPTH_8U, 1 );
+        cvSet( img, cvScalar( 100 ) );
+        CvImagePyramid *pyramid = cvCreateImagePyramid( img, 0 );
+        TS_ASSERT_EQUALS( pyramid->levels, 8 );
+
+        // a flat image stays flat at any level
+        CvMat *patch = cvCreateMat( 8, 8, CV_64FC1 );
+        cvCropResizeImagePyramidROI( pyramid, patch, cvRect32f( 32, 32, 64, 64, 0 ) );
+        for( int i = 0; i < 8; i++ ) {
+            for( int j = 0; j < 8; j++ ) {
+                TS_ASSERT_DELTA( cvmGet( patch, i, j ), 100, 1e-9 );
+            }
+        }
+
+        cvReleaseMat( &patch );
+        cvReleaseImagePyramid( &pyramid );
+        cvReleaseImage( &img );
+    }
+
+};
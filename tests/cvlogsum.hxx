@@ -34,5 +34,10 @@ public:
         cvLog( &mat, &mat );
         CvScalar logsum = cvLogSum( &mat );
         TS_ASSERT_DELTA( exp( logsum.val[0] ),  7.67, 0.0001 );
+
+        double w[12];
+        CvMat workspace = cvMat( D, N, CV_64FC1, w );
+        logsum = cvLogSum( &mat, &workspace );
+        TS_ASSERT_DELTA( exp( logsum.val[0] ),  7.67, 0.0001 );
     }
 };
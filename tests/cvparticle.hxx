@@ -0,0 +1,339 @@
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#pragma comment(lib, "cv.lib")
+#pragma comment(lib, "cxcore.lib")
+#pragma comment(lib, "cvaux.lib")
+#pragma comment(lib, "highgui.lib")
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cv.h"
+#include "cvaux.h"
+#include "cxcore.h"
+#include "highgui.h"
+#include "cvparticle.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <cxxtest/TestSuite.h>
+
+class CvParticleTest : public CxxTest::TestSuite
+{
+public:
+    void testResampleMultiplicity()
+    {
+        const int N = 20;
+        int methods[] = { CV_PARTICLE_RESAMPLE_SYSTEMATIC,
+                          CV_PARTICLE_RESAMPLE_STRATIFIED,
+                          CV_PARTICLE_RESAMPLE_RESIDUAL };
+        double weights[N], total = 0;
+        int count[N];
+        for( int i = 0; i < N; i++ ) {
+            weights[i] = ( i % 4 == 0 ) ? 0 : i + 0.37; // some zero weights
+            total += weights[i];
+        }
+
+        CvParticle *p = cvCreateParticle( 1, N );
+        for( int m = 0; m < 3; m++ ) {
+            cvParticleSetResample( p, methods[m] );
+            for( int trial = 0; trial < 50; trial++ ) {
+                // the state is the id of the particle before resampling
+                for( int i = 0; i < N; i++ ) {
+                    cvmSet( p->particles, 0, i, i );
+                    cvmSet( p->weights, 0, i, weights[i] );
+                    count[i] = 0;
+                }
+                cvParticleResample( p );
+                TS_ASSERT_EQUALS( p->num_particles, N );
+                for( int i = 0; i < N; i++ ) {
+                    count[(int) cvmGet( p->particles, 0, i )]++;
+                    TS_ASSERT_DELTA( cvmGet( p->weights, 0, i ), 1.0 / N, 1e-12 );
+                }
+                for( int i = 0; i < N; i++ ) {
+                    double expected = N * weights[i] / total;
+                    int lo = (int) floor( expected ), hi = (int) ceil( expected );
+                    if( methods[m] == CV_PARTICLE_RESAMPLE_SYSTEMATIC ) {
+                        TS_ASSERT( count[i] >= lo && count[i] <= hi );
+                    } else if( methods[m] == CV_PARTICLE_RESAMPLE_STRATIFIED ) {
+                        TS_ASSERT( count[i] >= lo - 1 && count[i] <= hi + 1 );
+                    } else { // residual: deterministic copies plus at most one
+                        TS_ASSERT( count[i] >= lo && count[i] <= lo + 1 );
+                    }
+                    if( weights[i] == 0 ) TS_ASSERT_EQUALS( count[i], 0 );
+                }
+            }
+        }
+        cvReleaseParticle( &p );
+    }
+
+    void testThreadIndependence()
+    {
+        const int N = 5 * CV_PARTICLE_CHUNK + 17; // a partial last chunk
+        double b[] = { 0, 100, 0,
+                       0,  50, 0,
+                       0, 360, 1 };
+        double sd[] = { 5, 2, 30 };
+        CvMat bound = cvMat( 3, 3, CV_64FC1, b );
+        CvMat std = cvMat( 3, 1, CV_64FC1, sd );
+        CvParticle *p[2];
+
+        for( int k = 0; k < 2; k++ ) {
+#ifdef _OPENMP
+            omp_set_num_threads( k == 0 ? 1 : 4 );
+#endif
+            p[k] = cvCreateParticle( 3, N );
+            cvParticleSetBound( p[k], &bound );
+            cvParticleSetNoise( p[k], cvRNG(12345), &std );
+            cvParticleInit( p[k] );
+            for( int t = 0; t < 3; t++ )
+                cvParticleTransition( p[k] );
+        }
+#ifdef _OPENMP
+        omp_set_num_threads( omp_get_num_procs() );
+#endif
+        for( int s = 0; s < 3; s++ ) {
+            TS_ASSERT( memcmp( p[0]->particles->data.ptr + s * p[0]->particles->step,
+                               p[1]->particles->data.ptr + s * p[1]->particles->step,
+                               N * sizeof( float ) ) == 0 );
+        }
+        cvReleaseParticle( &p[0] );
+        cvReleaseParticle( &p[1] );
+    }
+
+    void testEffectiveSize()
+    {
+        const int N = 50;
+        for( int logweight = 0; logweight < 2; logweight++ ) {
+            CvParticle *p = cvCreateParticle( 1, N, logweight != 0 );
+            double one = logweight ? 0 : 1, zero = logweight ? -1000 : 0;
+
+            // uniform (as created)
+            TS_ASSERT_DELTA( cvParticleGetEffectiveSize( p ), N, 1e-9 );
+
+            // all the mass on one particle
+            for( int i = 0; i < N; i++ )
+                cvmSet( p->weights, 0, i, i == 7 ? one : zero );
+            TS_ASSERT_DELTA( cvParticleGetEffectiveSize( p ), 1, 1e-9 );
+            TS_ASSERT_DELTA( cvParticleNormalize( p ), 1, 1e-9 );
+            TS_ASSERT_DELTA( p->ess, 1, 1e-9 );
+
+            // weights 1 and 2 alternately. ESS = (1.5N)^2 / (2.5N) = 0.9N
+            cvParticleSetResampleThreshold( p, 0.5 );
+            for( int i = 0; i < N; i++ ) {
+                cvmSet( p->particles, 0, i, i );
+                cvmSet( p->weights, 0, i, logweight ? log( 1.0 + i % 2 ) : 1.0 + i % 2 );
+            }
+            TS_ASSERT_EQUALS( cvParticleResampleAdaptive( p ), 0 );
+            TS_ASSERT_DELTA( p->ess, 0.9 * N, 1e-9 );
+            for( int i = 0; i < N; i++ ) {
+                TS_ASSERT_EQUALS( cvmGet( p->particles, 0, i ), i );
+                TS_ASSERT_DELTA( cvmGet( p->weights, 0, i ), 
+                                 logweight ? log( 1.0 + i % 2 ) : 1.0 + i % 2, 1e-12 );
+            }
+
+            // below the threshold
+            for( int i = 0; i < N; i++ )
+                cvmSet( p->weights, 0, i, i == 7 ? one : zero );
+            TS_ASSERT_EQUALS( cvParticleResampleAdaptive( p ), 1 );
+            TS_ASSERT_DELTA( p->ess, N, 1e-9 );
+            TS_ASSERT_DELTA( cvParticleGetEffectiveSize( p ), N, 1e-9 );
+            for( int i = 0; i < N; i++ )
+                TS_ASSERT_EQUALS( cvmGet( p->particles, 0, i ), 7 );
+            cvReleaseParticle( &p );
+        }
+    }
+
+    void testKLDSampling()
+    {
+        const int N = 2000;
+        double b[] = { 0, 100, 0,
+                       0, 100, 0 };
+        CvMat bound = cvMat( 2, 3, CV_64FC1, b );
+        CvParticle *p = cvCreateParticle( 2, N );
+        cvParticleSetBound( p, &bound );
+        cvParticleSetKLD( p, NULL, 0.05, 0.01, 10 ); // 10 x 10 bins
+
+        // spread over all the bins
+        for( int i = 0; i < N; i++ ) {
+            cvmSet( p->particles, 0, i, ( i % 40 ) * 2.5 + 1 );
+            cvmSet( p->particles, 1, i, ( i / 40 % 40 ) * 2.5 + 1 );
+        }
+        cvParticleResample( p );
+        int spread = p->num_particles;
+        TS_ASSERT( spread > 100 && spread <= N );
+
+        // concentrated in one bin
+        for( int i = 0; i < p->num_particles; i++ ) {
+            cvmSet( p->particles, 0, i, 50 + ( i % 10 ) * 0.9 );
+            cvmSet( p->particles, 1, i, 50 + ( i % 7 ) * 0.9 );
+        }
+        cvParticleResample( p );
+        TS_ASSERT( p->num_particles < spread );
+        TS_ASSERT_EQUALS( p->num_particles, p->kld_min_particles );
+        TS_ASSERT_EQUALS( p->particles->cols, p->num_particles );
+        TS_ASSERT_EQUALS( p->weights->cols, p->num_particles );
+        for( int i = 0; i < p->num_particles; i++ ) {
+            TS_ASSERT( cvmGet( p->particles, 0, i ) >= 50 && cvmGet( p->particles, 0, i ) < 60 );
+            TS_ASSERT_DELTA( cvmGet( p->weights, 0, i ), 1.0 / p->num_particles, 1e-12 );
+        }
+
+        // the bound exceeds the capacity
+        cvParticleSetKLD( p, NULL, 0.005, 0.01, 10 );
+        cvParticleSetNumParticles( p, N );
+        for( int i = 0; i < N; i++ ) {
+            cvmSet( p->particles, 0, i, ( i % 40 ) * 2.5 + 1 );
+            cvmSet( p->particles, 1, i, ( i / 40 % 40 ) * 2.5 + 1 );
+        }
+        cvParticleResample( p );
+        TS_ASSERT_EQUALS( p->num_particles, p->max_particles );
+        cvReleaseParticle( &p );
+    }
+
+    void testStructuredDynamics()
+    {
+        const int N = 2 * CV_PARTICLE_CHUNK + 5;
+        double b[] = { 0, 100, 0,
+                       0,  50, 1,
+                      -5,   5, 0,
+                      -5,   5, 0 };
+        double sd[] = { 20, 8, 3, 3 }; // wraps by one period at most
+        double d[3][16] = { { 1, 0, 0, 0,      // identity
+                              0, 1, 0, 0,
+                              0, 0, 1, 0,
+                              0, 0, 0, 1 },
+                            { 1, 0, 0, 0,      // diagonal
+                              0, 1, 0, 0,
+                              0, 0, 0.9, 0,
+                              0, 0, 0, 0.9 },
+                            { 1, 0, 1, 0,      // sparse, constant velocity
+                              0, 1, 0, 1,
+                              0, 0, 1, 0,
+                              0, 0, 0, 1 } };
+        int types[] = { CV_PARTICLE_DYNAMICS_IDENTITY,
+                        CV_PARTICLE_DYNAMICS_DIAGONAL,
+                        CV_PARTICLE_DYNAMICS_SPARSE };
+        CvMat bound = cvMat( 4, 3, CV_64FC1, b );
+        CvMat std = cvMat( 4, 1, CV_64FC1, sd );
+
+        for( int m = 0; m < 3; m++ ) {
+            CvMat dynamics = cvMat( 4, 4, CV_64FC1, d[m] );
+            CvParticle *p[2];
+            for( int k = 0; k < 2; k++ ) {
+                p[k] = cvCreateParticle( 4, N );
+                cvParticleSetDynamics( p[k], &dynamics );
+                cvParticleSetBound( p[k], &bound );
+                cvParticleSetNoise( p[k], cvRNG(4321), &std );
+                cvParticleInit( p[k] );
+            }
+            TS_ASSERT_EQUALS( p[0]->dynamics_type, types[m] );
+            p[1]->dynamics_type = CV_PARTICLE_DYNAMICS_DENSE; // matrix multiplication
+
+            for( int t = 0; t < 3; t++ ) {
+                cvParticleTransition( p[0] );
+                cvParticleTransition( p[1] );
+                for( int s = 0; s < 4; s++ ) {
+                    double period = b[s * 3 + 1] - b[s * 3];
+                    for( int i = 0; i < N; i++ ) {
+                        double v = cvmGet( p[0]->particles, s, i );
+                        double diff = fabs( v - cvmGet( p[1]->particles, s, i ) );
+                        if( b[s * 3 + 2] ) diff = MIN( diff, period - diff ); // wrapped
+                        TS_ASSERT_DELTA( diff, 0, 1e-3 );
+                        TS_ASSERT( v >= b[s * 3] && v <= b[s * 3 + 1] );
+                    }
+                }
+            }
+            cvReleaseParticle( &p[0] );
+            cvReleaseParticle( &p[1] );
+        }
+    }
+
+    void testMeanCov()
+    {
+        const int N = 500, S = 3;
+        CvRNG rng = cvRNG(99);
+        CvMat *mean = cvCreateMat( S, 1, CV_64FC1 );
+        CvMat *cov = cvCreateMat( S, S, CV_64FC1 );
+        double w[N], refmean[S], refcov[S][S], sumw = 0;
+
+        for( int logweight = 0; logweight < 2; logweight++ ) {
+            CvParticle *p = cvCreateParticle( S, N, logweight != 0 );
+            for( int i = 0; i < N; i++ ) {
+                cvmSet( p->particles, 0, i, 100 + 10 * cvRandReal( &rng ) );
+                cvmSet( p->particles, 1, i, -3 + cvRandReal( &rng ) );
+                cvmSet( p->particles, 2, i, cvmGet( p->particles, 0, i ) * 0.5 +
+                                            cvRandReal( &rng ) ); // correlated
+                if( logweight == 0 ) // unnormalized, some zero
+                    w[i] = ( i % 7 == 0 ) ? 0 : 5 * cvRandReal( &rng ) + 0.01;
+                cvmSet( p->weights, 0, i, logweight ? ( w[i] > 0 ? log( w[i] ) : -1000 ) : w[i] );
+            }
+
+            // two-pass reference
+            sumw = 0;
+            for( int i = 0; i < N; i++ ) sumw += w[i];
+            for( int s = 0; s < S; s++ ) {
+                refmean[s] = 0;
+                for( int i = 0; i < N; i++ )
+                    refmean[s] += w[i] * cvmGet( p->particles, s, i );
+                refmean[s] /= sumw;
+            }
+            for( int s = 0; s < S; s++ ) {
+                for( int t = 0; t < S; t++ ) {
+                    refcov[s][t] = 0;
+                    for( int i = 0; i < N; i++ )
+                        refcov[s][t] += w[i] * ( cvmGet( p->particles, s, i ) - refmean[s] ) *
+                                               ( cvmGet( p->particles, t, i ) - refmean[t] );
+                    refcov[s][t] /= sumw;
+                }
+            }
+
+            cvParticleGetMeanCov( p, mean, cov );
+            for( int s = 0; s < S; s++ ) {
+                TS_ASSERT_DELTA( cvmGet( mean, s, 0 ), refmean[s], 1e-6 * ( 1 + fabs( refmean[s] ) ) );
+                for( int t = 0; t < S; t++ )
+                    TS_ASSERT_DELTA( cvmGet( cov, s, t ), refcov[s][t], 1e-6 * ( 1 + fabs( refcov[s][t] ) ) );
+            }
+            cvReleaseParticle( &p );
+        }
+        cvReleaseMat( &mean );
+        cvReleaseMat( &cov );
+    }
+
+    void testFindDuplicates()
+    {
+        const int N = 7, S = 6;
+        double states[N][S] = { { 10,   20,   30,   40,  0,   1 },
+                                { 10,   20,   30,   40,  0,   1 },   // duplicate of 0
+                                { 10.2, 19.9, 30.1, 40,  0,   1 },   // near 0
+                                { 10.6, 20,   30,   40,  0,   1 },   // rounds apart
+                                { 10,   20,   30,   40,  0,   5 },   // ignored state differs
+                                { 10.6, 20,   30,   40,  0,   1 },   // duplicate of 3
+                                { 10,   20,   30,   40, -0.2, 1 } }; // -0 and 0
+        double q[] = { 1, 1, 1, 1, 1, 0 };
+        int quantized[] = { 0, 0, 0, 3, 0, 3, 0 };
+        int exact[] = { 0, 0, 2, 3, 4, 3, 6 };
+        CvMat quantum = cvMat( S, 1, CV_64FC1, q );
+        CvMat *origins = cvCreateMat( 1, N, CV_32SC1 );
+        CvParticle *p = cvCreateParticle( S, N );
+        for( int i = 0; i < N; i++ )
+            for( int s = 0; s < S; s++ )
+                cvmSet( p->particles, s, i, states[i][s] );
+
+        for( int view = 0; view < 2; view++ ) {
+            // a view without the hashtable workspace allocates per call
+            CvMat *hashtable = p->hashtable;
+            if( view ) p->hashtable = NULL;
+            TS_ASSERT_EQUALS( cvParticleFindDuplicates( p, &quantum, origins ), 2 );
+            for( int i = 0; i < N; i++ )
+                TS_ASSERT_EQUALS( origins->data.i[i], quantized[i] );
+            TS_ASSERT_EQUALS( cvParticleFindDuplicates( p, NULL, origins ), 5 );
+            for( int i = 0; i < N; i++ )
+                TS_ASSERT_EQUALS( origins->data.i[i], exact[i] );
+            p->hashtable = hashtable;
+        }
+        cvReleaseParticle( &p );
+        cvReleaseMat( &origins );
+    }
+
+};
@@ -0,0 +1,212 @@
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#pragma comment(lib, "cv.lib")
+#pragma comment(lib, "cxcore.lib")
+#pragma comment(lib, "cvaux.lib")
+#pragma comment(lib, "highgui.lib")
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cv.h"
+#include "cvaux.h"
+#include "cxcore.h"
+#include "highgui.h"
+#include "cvparticlefilter.h"
+#include "cvparticlebank.h"
+
+#include <cxxtest/TestSuite.h>
+
+// x, y, dx, dy (constant velocity)
+struct CvParticleTestModel {
+    enum { num_states = 4 };
+    static double dynamics( int i, int j ) { return i == j || j == i + 2; }
+    static bool circular( int i ) { return false; }
+};
+
+// x, angle
+struct CvParticleTestAngleModel {
+    enum { num_states = 2 };
+    static double dynamics( int i, int j ) { return i == j; }
+    static bool circular( int i ) { return i == 1; }
+};
+
+class CvParticleFilterTest : public CxxTest::TestSuite
+{
+public:
+    void testSetDynamicsOnView()
+    {
+        CvParticleFilter<CvParticleTestModel> pf( 100 );
+        TS_ASSERT( pf.particle()->dynamics_index != NULL );
+        TS_ASSERT_EQUALS( pf.particle()->dynamics_type, CV_PARTICLE_DYNAMICS_SPARSE );
+
+        // as cvParticleStateConfig( pf.particle(), ... ) does
+        double d[] = { 1, 0, 0, 0,
+                       0, 1, 0, 0,
+                       0, 0, 1, 0,
+                       0, 0, 0, 1 };
+        CvMat dynamics = cvMat( 4, 4, CV_64FC1, d );
+        cvParticleSetDynamics( pf.particle(), &dynamics );
+        TS_ASSERT_EQUALS( pf.particle()->dynamics_type, CV_PARTICLE_DYNAMICS_IDENTITY );
+        pf.init();
+        pf.transition();
+        pf.normalize();
+        pf.resample();
+    }
+
+    void testSetDynamicsOnBankTarget()
+    {
+        CvParticleBank *bank = cvCreateParticleBank( 3, 4, 50, false );
+        CvParticle *p = cvParticleBankTarget( bank, 1 );
+        TS_ASSERT( p->dynamics_index != NULL );
+        TS_ASSERT_EQUALS( p->dynamics_type, CV_PARTICLE_DYNAMICS_IDENTITY );
+
+        double d[] = { 2, 0, 0, 0,
+                       0, 2, 0, 0,
+                       0, 0, 1, 0,
+                       0, 0, 0, 1 };
+        CvMat dynamics = cvMat( 4, 4, CV_64FC1, d );
+        cvParticleSetDynamics( p, &dynamics );
+        TS_ASSERT_EQUALS( p->dynamics_type, CV_PARTICLE_DYNAMICS_DIAGONAL );
+        TS_ASSERT_DELTA( cvmGet( bank->dynamics, 0, 0 ), 2, 1e-9 );
+        cvParticleBankSetDynamics( bank, &dynamics );
+        TS_ASSERT_EQUALS( cvParticleBankTarget( bank, 0 )->dynamics_type,
+                          CV_PARTICLE_DYNAMICS_DIAGONAL );
+        cvReleaseParticleBank( &bank );
+    }
+
+    void testCircularMeanAgrees()
+    {
+        double states[] = { 1, 2, 3, 
+                            350, 20, 5 };
+        double weights[] = { 0.25, 0.25, 0.5 };
+        double b[] = { 0, 0, 0,
+                       0, 360, 1 };
+        CvMat bound = cvMat( 2, 3, CV_64FC1, b );
+        CvMat *mean = cvCreateMat( 2, 1, CV_64FC1 );
+
+        CvParticle *p = cvCreateParticle( 2, 3 );
+        cvParticleSetBound( p, &bound );
+        for( int s = 0; s < 2; s++ ) {
+            for( int i = 0; i < 3; i++ ) {
+                cvmSet( p->particles, s, i, states[s * 3 + i] );
+                cvmSet( p->weights, 0, i, weights[i] );
+            }
+        }
+        cvParticleGetMean( p, mean );
+        TS_ASSERT_DELTA( cvmGet( mean, 0, 0 ), 2.25, 1e-6 );
+        TS_ASSERT_DELTA( cvmGet( mean, 1, 0 ), 5, 1e-4 );
+
+        CvParticleFilter<CvParticleTestAngleModel, double> pf( 3 );
+        cvParticleSetBound( pf.particle(), &bound );
+        for( int s = 0; s < 2; s++ ) {
+            for( int i = 0; i < 3; i++ ) {
+                cvmSet( pf.particle()->particles, s, i, states[s * 3 + i] );
+                cvmSet( pf.particle()->weights, 0, i, weights[i] );
+            }
+        }
+        pf.getMean( mean );
+        TS_ASSERT_DELTA( cvmGet( mean, 0, 0 ), 2.25, 1e-6 );
+        TS_ASSERT_DELTA( cvmGet( mean, 1, 0 ), 5, 1e-4 );
+        cvParticleGetMean( pf.particle(), mean );
+        TS_ASSERT_DELTA( cvmGet( mean, 1, 0 ), 5, 1e-4 );
+
+        CvParticleBank *bank = cvCreateParticleBank( 2, 2, 3, false );
+        CvMat *means = cvCreateMat( 2, 2, CV_64FC1 );
+        cvParticleBankSetBound( bank, &bound );
+        for( int t = 0; t < 2; t++ ) {
+            CvParticle *target = cvParticleBankTarget( bank, t );
+            for( int s = 0; s < 2; s++ ) {
+                for( int i = 0; i < 3; i++ ) {
+                    cvmSet( target->particles, s, i, states[s * 3 + i] );
+                    cvmSet( target->weights, 0, i, weights[i] );
+                }
+            }
+        }
+        cvParticleBankGetMean( bank, means );
+        for( int t = 0; t < 2; t++ ) {
+            TS_ASSERT_DELTA( cvmGet( means, 0, t ), 2.25, 1e-6 );
+            TS_ASSERT_DELTA( cvmGet( means, 1, t ), 5, 1e-4 );
+        }
+
+        cvReleaseMat( &means );
+        cvReleaseParticleBank( &bank );
+        cvReleaseParticle( &p );
+        cvReleaseMat( &mean );
+    }
+
+    void testAgreesWithCvParticle()
+    {
+        const int N = 2 * CV_PARTICLE_CHUNK + 37;
+        double b[] = {   0, 320, 0,
+                         0, 240, 0,
+                       -10,  10, 0,
+                       -10,  10, 0 };
+        double sd[] = { 3, 3, 1, 1 };
+        double d[] = { 1, 0, 0, 0,
+                       0, 1, 0, 0,
+                       0, 0, 1, 0,
+                       0, 0, 0, 1 };
+        CvMat bound = cvMat( 4, 3, CV_64FC1, b );
+        CvMat std = cvMat( 4, 1, CV_64FC1, sd );
+        CvMat dynamics = cvMat( 4, 4, CV_64FC1, d );
+        CvMat *mean1 = cvCreateMat( 4, 1, CV_64FC1 );
+        CvMat *mean2 = cvCreateMat( 4, 1, CV_64FC1 );
+        CvParticleFilter<CvParticleTestModel> pf( N );
+        CvParticle *p[2];
+        p[0] = cvCreateParticle( 4, N );
+        p[1] = pf.particle();
+        for( int k = 0; k < 2; k++ ) {
+            cvParticleSetBound( p[k], &bound );
+            cvParticleSetNoise( p[k], cvRNG(777), &std );
+            cvParticleSetResample( p[k], CV_PARTICLE_RESAMPLE_STRATIFIED );
+        }
+        cvParticleSetDynamics( p[0], pf.particle()->dynamics );
+        cvParticleInit( p[0] );
+        pf.init();
+
+        // model dynamics, then dynamics and per particle stds set on the view
+        for( int t = 0; t < 6; t++ ) {
+            if( t == 3 ) {
+                for( int k = 0; k < 2; k++ ) {
+                    cvParticleSetDynamics( p[k], &dynamics );
+                    p[k]->stds = cvCreateMat( 4, N, CV_32FC1 );
+                    for( int i = 0; i < N; i++ )
+                        for( int s = 0; s < 4; s++ )
+                            cvmSet( p[k]->stds, s, i, 0.5 + ( i % 5 ) );
+                }
+            }
+            cvParticleTransition( p[0] );
+            pf.transition();
+            for( int s = 0; s < 4; s++ ) {
+                TS_ASSERT( memcmp( p[0]->particles->data.ptr + s * p[0]->particles->step,
+                                   p[1]->particles->data.ptr + s * p[1]->particles->step,
+                                   N * sizeof( float ) ) == 0 );
+            }
+
+            // unnormalized weights
+            for( int k = 0; k < 2; k++ ) {
+                for( int i = 0; i < N; i++ ) {
+                    double dx = cvmGet( p[k]->particles, 0, i ) - 160;
+                    cvmSet( p[k]->weights, 0, i, 3 * exp( -dx * dx / 2000 ) );
+                }
+            }
+            cvParticleGetMean( p[0], mean1 );
+            pf.getMean( mean2 );
+            for( int s = 0; s < 4; s++ )
+                TS_ASSERT_DELTA( cvmGet( mean1, s, 0 ), cvmGet( mean2, s, 0 ), 1e-4 );
+
+            cvParticleResample( p[0] );
+            pf.resample();
+            for( int s = 0; s < 4; s++ ) {
+                TS_ASSERT( memcmp( p[0]->particles->data.ptr + s * p[0]->particles->step,
+                                   p[1]->particles->data.ptr + s * p[1]->particles->step,
+                                   N * sizeof( float ) ) == 0 );
+            }
+        }
+        cvReleaseParticle( &p[0] );
+        cvReleaseMat( &mean1 );
+        cvReleaseMat( &mean2 );
+    }
+
+};
@@ -0,0 +1,333 @@
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#pragma comment(lib, "cv.lib")
+#pragma comment(lib, "cxcore.lib")
+#pragma comment(lib, "cvaux.lib")
+#pragma comment(lib, "highgui.lib")
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cv.h"
+#include "cvaux.h"
+#include "cxcore.h"
+#include "highgui.h"
+#include "cvpcamodel.h"
+#include "cvpcadiffs.h"
+#include "cvpcadist.h"
+#include "cvxmat.h"
+
+#include <cxxtest/TestSuite.h>
+
+// Batch PCA of the data weighted as cvUpdatePcaModel does [Ross08]: deviations
+// of old samples from their mean scaled by forget, deviations of new samples
+// from theirs, and the mean shift scaled by sqrt( forget * n * N / n2 ).
+// Each weighted deviation y is given as +-y / sqrt(2), so that the scatter of
+// the 2K columns is sum y y'. eigenvalues are of the scatter / n2
+static void
+icvWeightedPCA( const CvMat* old, const CvMat* samples, double forget,
+                CvMat* eigenvalues, CvMat* eigenvectors )
+{
+    int D = old->rows, n = old->cols, N = samples->cols, K = n + N + 1;
+    double fn = forget * n, n2 = fn + N;
+    CvMat *data = cvCreateMat( D, 2 * K, CV_64FC1 );
+    CvMat *avg = cvCreateMat( D, 1, CV_64FC1 );
+    for( int d = 0; d < D; d++ ) {
+        double m = 0, mnew = 0, y;
+        for( int j = 0; j < n; j++ ) m += cvmGet( old, d, j ) / n;
+        for( int j = 0; j < N; j++ ) mnew += cvmGet( samples, d, j ) / N;
+        for( int k = 0; k < K; k++ ) {
+            if( k < n )
+                y = forget * ( cvmGet( old, d, k ) - m );
+            else if( k < n + N )
+                y = cvmGet( samples, d, k - n ) - mnew;
+            else
+                y = sqrt( fn * N / n2 ) * ( mnew - m );
+            cvmSet( data, d, 2 * k, y / sqrt( 2.0 ) );
+            cvmSet( data, d, 2 * k + 1, -y / sqrt( 2.0 ) );
+        }
+    }
+    cvCalcPCA( data, avg, eigenvalues, eigenvectors, CV_PCA_DATA_AS_COL );
+    cvScale( eigenvalues, eigenvalues, 2.0 * K / n2 );
+    cvReleaseMat( &avg );
+    cvReleaseMat( &data );
+}
+
+// D = 4 dimensional data of N = 3 samples, and 2 samples to score
+static double pca_data[] = { 
+    0.4854,    0.9157,    0.0357,
+    0.8003,    0.7922,    0.8491,
+    0.1419,    0.9595,    0.9340,
+    0.4218,    0.6557,    0.6787
+};
+static double pca_samples[] = { 
+    0.478933, 0,
+    0.813867, 0,
+    0.678467, 0,
+    0.585400, 0
+};
+
+class CvPcaModelTest : public CxxTest::TestSuite
+{
+public:
+    enum { D = 4, N = 3 };
+    CvMat mat, mat2;   // pca_data and pca_samples
+    CvMat *avg, *eigenvalues, *eigenvectors; // PCA of mat
+    CvMat *mat2_32f, *avg32f, *eigenvalues32f, *eigenvectors32f; // CV_32FC1 copies
+
+    void setUp()
+    {
+        mat = cvMat( D, N, CV_64FC1, pca_data );
+        mat2 = cvMat( D, 2, CV_64FC1, pca_samples );
+        avg = cvCreateMat( D, 1, CV_64FC1 );
+        eigenvalues = cvCreateMat( MIN(D,N-1), 1, CV_64FC1 );
+        eigenvectors = cvCreateMat( MIN(D, N-1), D, CV_64FC1 );
+        cvCalcPCA( &mat, avg, eigenvalues, eigenvectors, CV_PCA_DATA_AS_COL );
+
+        mat2_32f = cvCreateMat( D, 2, CV_32FC1 );
+        avg32f = cvCreateMat( D, 1, CV_32FC1 );
+        eigenvalues32f = cvCreateMat( MIN(D,N-1), 1, CV_32FC1 );
+        eigenvectors32f = cvCreateMat( MIN(D, N-1), D, CV_32FC1 );
+        cvConvert( &mat2, mat2_32f );
+        cvConvert( avg, avg32f );
+        cvConvert( eigenvalues, eigenvalues32f );
+        cvConvert( eigenvectors, eigenvectors32f );
+    }
+
+    void tearDown()
+    {
+        cvReleaseMat( &eigenvectors32f );
+        cvReleaseMat( &eigenvalues32f );
+        cvReleaseMat( &avg32f );
+        cvReleaseMat( &mat2_32f );
+        cvReleaseMat( &eigenvectors );
+        cvReleaseMat( &eigenvalues );
+        cvReleaseMat( &avg );
+    }
+
+    void testPcaModelDiffs()
+    {
+        CvMat *loglikeli = cvCreateMat( 1, 2, CV_64FC1 );
+        CvPcaModel *model = cvCreatePcaModel( avg, eigenvalues, eigenvectors, CV_64FC1 );
+        cvPcaModelDiffs( model, &mat2, loglikeli, 1, true );
+
+        TS_ASSERT_DELTA( cvmGet( loglikeli, 0, 0 ), 0.107349, 0.00001 );
+        TS_ASSERT_DELTA( cvmGet( loglikeli, 0, 1 ), -2.7749, 0.001 );
+
+        // reuse with fewer samples
+        CvMat mat3, *loglikeli1 = cvCreateMat( 1, 1, CV_64FC1 );
+        cvGetCols( &mat2, &mat3, 1, 2 );
+        cvPcaModelDiffs( model, &mat3, loglikeli1, 1, true );
+        TS_ASSERT_DELTA( cvmGet( loglikeli1, 0, 0 ), -2.7749, 0.001 );
+        cvReleasePcaModel( &model );
+
+        // float computation
+        model = cvCreatePcaModel( avg, eigenvalues, eigenvectors, CV_32FC1 );
+        cvPcaModelDiffs( model, &mat2, loglikeli, 1, true );
+        TS_ASSERT_DELTA( cvmGet( loglikeli, 0, 0 ), 0.107349, 0.0001 );
+        TS_ASSERT_DELTA( cvmGet( loglikeli, 0, 1 ), -2.7749, 0.001 );
+        cvReleasePcaModel( &model );
+
+        cvReleaseMat( &loglikeli1 );
+        cvReleaseMat( &loglikeli );
+    }
+
+
+    void testPcaModelScore()
+    {
+        int n;
+        // one principal component and one residual eigenvalue
+        CvMat subvectors;
+        cvGetRows( eigenvectors32f, &subvectors, 0, 1 );
+
+        CvMat *difs = cvCreateMat( 1, 2, CV_32FC1 );
+        CvMat *dffs = cvCreateMat( 1, 2, CV_32FC1 );
+        CvMat *dists = cvCreateMat( 1, 2, CV_32FC1 );
+        CvMat *logprobs = cvCreateMat( 1, 2, CV_32FC1 );
+        CvMat *expected = cvCreateMat( 1, 2, CV_32FC1 );
+        CvPcaModel *model = cvCreatePcaModel( avg32f, eigenvalues32f, &subvectors, CV_32FC1 );
+        cvPcaModelScore( model, mat2_32f, difs, dffs, dists, logprobs );
+
+        cvMatPcaDist( mat2_32f, avg32f, &subvectors, expected );
+        for( n = 0; n < 2; n++ ) {
+            TS_ASSERT_DELTA( cvmGet( dists, 0, n ), cvmGet( expected, 0, n ), 0.0001 );
+            TS_ASSERT_DELTA( cvmGet( dffs, 0, n ), cvmGet( dists, 0, n ) / model->rho, 0.0001 );
+        }
+        cvMatPcaDiffs( mat2_32f, avg32f, eigenvalues32f, &subvectors, expected, 1, true );
+        for( n = 0; n < 2; n++ ) {
+            TS_ASSERT_DELTA( cvmGet( logprobs, 0, n ), cvmGet( expected, 0, n ), 0.0001 );
+            TS_ASSERT_DELTA( cvmGet( logprobs, 0, n ), 
+                             -( cvmGet( difs, 0, n ) + cvmGet( dffs, 0, n ) ) / 2 - model->normterm,
+                             0.0001 );
+        }
+
+        // only distances without eigenvalues
+        cvReleasePcaModel( &model );
+        model = cvCreatePcaModel( avg32f, NULL, &subvectors, CV_32FC1 );
+        cvPcaModelScore( model, mat2_32f, NULL, NULL, expected, NULL );
+        for( n = 0; n < 2; n++ ) {
+            TS_ASSERT_DELTA( cvmGet( expected, 0, n ), cvmGet( dists, 0, n ), 0.0001 );
+        }
+        cvReleasePcaModel( &model );
+
+        cvReleaseMat( &expected );
+        cvReleaseMat( &logprobs );
+        cvReleaseMat( &dists );
+        cvReleaseMat( &dffs );
+        cvReleaseMat( &difs );
+    }
+
+
+    void testPcaModelProgressiveDiffs()
+    {
+        CvMat *loglikeli = cvCreateMat( 1, 2, CV_64FC1 );
+        CvPcaModel *model = cvCreatePcaModel( avg, eigenvalues, eigenvectors, CV_64FC1 );
+
+        // no termination
+        TS_ASSERT_EQUALS( cvPcaModelProgressiveDiffs( model, &mat2, loglikeli, DBL_MAX, 1 ), 0 );
+        TS_ASSERT_DELTA( cvmGet( loglikeli, 0, 0 ), 0.107349, 0.00001 );
+        TS_ASSERT_DELTA( cvmGet( loglikeli, 0, 1 ), -2.7749, 0.001 );
+
+        // the second is less likely than the first by more than 1
+        TS_ASSERT_EQUALS( cvPcaModelProgressiveDiffs( model, &mat2, loglikeli, 1, 1 ), 1 );
+        TS_ASSERT_DELTA( cvmGet( loglikeli, 0, 0 ), 0.107349, 0.00001 );
+        TS_ASSERT( cvmGet( loglikeli, 0, 1 ) >= -2.7749 - 0.001 );
+        TS_ASSERT( cvmGet( loglikeli, 0, 1 ) < 0.107349 - 1 );
+
+        cvReleasePcaModel( &model );
+        cvReleaseMat( &loglikeli );
+    }
+
+    void testPcaModelProgressiveMatchesDiffs()
+    {
+        // samples farther and farther from the mean toward mat2
+        enum { S = 8 };
+        CvMat *samples = cvCreateMat( D, S, CV_64FC1 );
+        CvMat *probs = cvCreateMat( 1, S, CV_64FC1 );
+        CvMat *loglikeli = cvCreateMat( 1, S, CV_64FC1 );
+        for( int n = 0; n < S; n++ ) {
+            for( int d = 0; d < D; d++ ) {
+                double mean = cvmGet( avg, d, 0 );
+                cvmSet( samples, d, n, mean + 0.5 * n * ( cvmGet( &mat2, d, n % 2 ) - mean ) );
+            }
+        }
+
+        // without and with the distance from feature space
+        CvMat eigenvector;
+        cvGetRows( eigenvectors, &eigenvector, 0, 1 );
+        const CvMat* vectors[] = { eigenvectors, &eigenvector };
+        for( int i = 0; i < 2; i++ ) {
+            CvPcaModel *model = cvCreatePcaModel( avg, eigenvalues, vectors[i], CV_64FC1 );
+            cvPcaModelDiffs( model, samples, probs, 1, true );
+            int terminated = cvPcaModelProgressiveDiffs( model, samples, loglikeli, 1, 1 );
+            TS_ASSERT( terminated > 0 );
+
+            double minval, best;
+            int exact = 0;
+            cvMinMaxLoc( probs, &minval, &best );
+            for( int n = 0; n < S; n++ ) {
+                double logprob = cvmGet( probs, 0, n ), bound = cvmGet( loglikeli, 0, n );
+                if( fabs( bound - logprob ) < 1e-9 ) {
+                    exact++;
+                } else { // an upper bound of a sample less likely than the best
+                    TS_ASSERT( bound > logprob );
+                    TS_ASSERT( bound < best - 1 );
+                }
+            }
+            TS_ASSERT_EQUALS( exact, S - terminated );
+            cvReleasePcaModel( &model );
+        }
+        cvReleaseMat( &loglikeli );
+        cvReleaseMat( &probs );
+        cvReleaseMat( &samples );
+    }
+
+
+    void testUpdatePcaModel()
+    {
+        CvPcaModel *model = cvCreatePcaModel( avg, eigenvalues, eigenvectors, CV_64FC1, N );
+
+        // a sample at the mean only shrinks the variances
+        cvUpdatePcaModel( model, avg, 1.0 );
+        TS_ASSERT_DELTA( model->num_samples, N + 1, 1e-9 );
+        for( int d = 0; d < D; d++ ) {
+            TS_ASSERT_DELTA( cvmGet( model->avg, d, 0 ), cvmGet( avg, d, 0 ), 1e-9 );
+        }
+        for( int i = 0; i < model->M; i++ ) {
+            double lambda = 1.0 / pow( cvmGet( model->inv_sqrt_lambda, i, 0 ), 2 );
+            TS_ASSERT_DELTA( lambda, cvmGet( eigenvalues, i, 0 ) * N / ( N + 1 ), 1e-9 );
+            double dot = 0;
+            for( int d = 0; d < D; d++ ) {
+                dot += cvmGet( model->eigenvectors, i, d ) * cvmGet( eigenvectors, i, d );
+            }
+            TS_ASSERT_DELTA( fabs( dot ), 1.0, 1e-9 );
+        }
+
+        // forgetting weights the new sample more
+        CvMat *sample = cvCreateMat( D, 1, CV_64FC1 );
+        cvSet( sample, cvScalar( 1.0 ) );
+        cvUpdatePcaModel( model, sample, 0.5 );
+        TS_ASSERT_DELTA( model->num_samples, ( N + 1 ) * 0.5 + 1, 1e-9 );
+        for( int d = 0; d < D; d++ ) {
+            TS_ASSERT_DELTA( cvmGet( model->avg, d, 0 ), 
+                             ( cvmGet( avg, d, 0 ) * ( N + 1 ) * 0.5 + 1.0 ) / model->num_samples, 
+                             1e-9 );
+        }
+
+        cvReleasePcaModel( &model );
+        cvReleaseMat( &sample );
+
+        // forget < 1 agrees with batch PCA of the weighted data
+        double b[] = {
+            0.2,    0.9,
+            0.5,    0.1,
+            0.7,    0.3,
+            0.4,    0.8
+        };
+        CvMat samples = cvMat( D, 2, CV_64FC1, b );
+        double forget = 0.6, n2 = forget * N + 2;
+        CvMat *batchvalues = cvCreateMat( D, 1, CV_64FC1 );
+        CvMat *batchvectors = cvCreateMat( D, D, CV_64FC1 );
+        icvWeightedPCA( &mat, &samples, forget, batchvalues, batchvectors );
+
+        model = cvCreatePcaModel( avg, eigenvalues, eigenvectors, CV_64FC1, N );
+        cvUpdatePcaModel( model, &samples, forget );
+        TS_ASSERT_DELTA( model->num_samples, n2, 1e-9 );
+        for( int d = 0; d < D; d++ ) {
+            TS_ASSERT_DELTA( cvmGet( model->avg, d, 0 ), 
+                             ( forget * N * cvmGet( avg, d, 0 ) + b[d * 2] + b[d * 2 + 1] ) / n2,
+                             1e-9 );
+        }
+        for( int i = 0; i < model->M; i++ ) {
+            double lambda = 1.0 / pow( cvmGet( model->inv_sqrt_lambda, i, 0 ), 2 );
+            TS_ASSERT_DELTA( lambda, cvmGet( batchvalues, i, 0 ), 1e-9 );
+            double dot = 0;
+            for( int d = 0; d < D; d++ ) {
+                dot += cvmGet( model->eigenvectors, i, d ) * cvmGet( batchvectors, i, d );
+            }
+            TS_ASSERT_DELTA( fabs( dot ), 1.0, 1e-6 );
+        }
+        cvReleasePcaModel( &model );
+
+        // nEig > M: the subspace is truncated so that only the total
+        // variance is kept, with the discarded energy moved into rho
+        CvMat eigenvector;
+        cvGetRows( eigenvectors, &eigenvector, 0, 1 );
+        model = cvCreatePcaModel( avg, eigenvalues, &eigenvector, CV_64FC1, N );
+        TS_ASSERT_EQUALS( model->M, 1 );
+        TS_ASSERT_EQUALS( model->nEig, 2 );
+        TS_ASSERT_DELTA( model->rho, cvmGet( eigenvalues, 1, 0 ), 1e-9 );
+        cvUpdatePcaModel( model, &samples, forget );
+        double lambda = 1.0 / pow( cvmGet( model->inv_sqrt_lambda, 0, 0 ), 2 );
+        TS_ASSERT( lambda <= cvmGet( batchvalues, 0, 0 ) + 1e-9 );
+        TS_ASSERT_DELTA( lambda + model->rho, cvSum( batchvalues ).val[0], 1e-9 );
+        TS_ASSERT_DELTA( model->normterm, 
+                         log( 2 * M_PI ) - log( cvmGet( model->inv_sqrt_lambda, 0, 0 ) )
+                         + log( model->rho ) / 2, 1e-9 );
+
+        cvReleasePcaModel( &model );
+        cvReleaseMat( &batchvectors );
+        cvReleaseMat( &batchvalues );
+    }
+
+};
@@ -48,5 +48,14 @@ public:
 
         TS_ASSERT_DELTA( cvmGet( probs, 0, 0 ), 0.398942, 0.00001 );
         TS_ASSERT_DELTA( cvmGet( probs, 0, 1 ), 0.264696, 0.00001 );
+
+        // the same with a model kept across calls
+        CvPcaModel *model = cvCreatePcaModel( avg, NULL, eigenvectors, CV_64FC1 );
+        for( int i = 0; i < 2; i++ ) {
+            cvPcaModelProbDist( model, &mat2, 1.0, probs, 1, false );
+            TS_ASSERT_DELTA( cvmGet( probs, 0, 0 ), 0.398942, 0.00001 );
+            TS_ASSERT_DELTA( cvmGet( probs, 0, 1 ), 0.264696, 0.00001 );
+        }
+        cvReleasePcaModel( &model );
     }
 };
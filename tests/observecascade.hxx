@@ -0,0 +1,114 @@
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#pragma comment(lib, "cv.lib")
+#pragma comment(lib, "cxcore.lib")
+#pragma comment(lib, "cvaux.lib")
+#pragma comment(lib, "highgui.lib")
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include "cv.h"
+#include "cvaux.h"
+#include "cxcore.h"
+#include "highgui.h"
+#include "cvparticle/observecascade.h"
+
+#include <cxxtest/TestSuite.h>
+
+// Measurements of particle ids which need neither particles nor frames
+static int num_expensive = 0; // number of particles measured expensively
+
+static void icvCheapId( const CvParticle*, const IplImage*,
+                        const int* ids, int num_ids, double* loglikelis )
+{
+    for( int n = 0; n < num_ids; n++ ) loglikelis[n] = ids[n];
+}
+
+static void icvExpensiveLinear( const CvParticle*, const IplImage*,
+                                const int* ids, int num_ids, double* loglikelis )
+{
+    num_expensive += num_ids;
+    for( int n = 0; n < num_ids; n++ ) loglikelis[n] = 2 * ids[n] + 1;
+}
+
+static void icvExpensiveNegative( const CvParticle*, const IplImage*,
+                                  const int* ids, int num_ids, double* loglikelis )
+{
+    num_expensive += num_ids;
+    for( int n = 0; n < num_ids; n++ ) loglikelis[n] = -ids[n];
+}
+
+class CvObserveCascadeTest : public CxxTest::TestSuite
+{
+public:
+    enum { N = 10 };
+    int ids[N];
+    double loglikelis[N];
+
+    void setUp()
+    {
+        // shuffled, so that ranking matters
+        for( int n = 0; n < N; n++ ) ids[n] = ( n * 3 ) % N;
+        num_expensive = 0;
+    }
+
+    void tearDown()
+    {
+        icvObserveCascadeFinalize();
+    }
+
+    void testCalibration()
+    {
+        // the top half survives; the others follow the fitted 2 * cheap + 1
+        TS_ASSERT_EQUALS( icvObserveCascade( NULL, NULL, ids, N, icvCheapId, icvExpensiveLinear,
+                                             0.5, DBL_MAX, loglikelis ), N / 2 );
+        TS_ASSERT_EQUALS( num_expensive, N / 2 );
+        for( int n = 0; n < N; n++ )
+            TS_ASSERT_DELTA( loglikelis[n], 2 * ids[n] + 1, 1e-9 );
+
+        // survivors by the threshold too, and the buffers are reused
+        TS_ASSERT_EQUALS( icvObserveCascade( NULL, NULL, ids, N, icvCheapId, icvExpensiveLinear,
+                                             0.1, 3, loglikelis ), N - 3 );
+        TS_ASSERT_EQUALS( cascade_capacity, (int)N );
+        for( int n = 0; n < N; n++ )
+            TS_ASSERT_DELTA( loglikelis[n], 2 * ids[n] + 1, 1e-9 );
+    }
+
+    void testNoSlope()
+    {
+        // negatively correlated, and a single survivor
+        double ratios[] = { 0.3, 0.1 };
+        for( int i = 0; i < 2; i++ ) {
+            int num_survivors = icvObserveCascade( NULL, NULL, ids, N, icvCheapId,
+                                                   icvExpensiveNegative, ratios[i],
+                                                   DBL_MAX, loglikelis );
+            double miny = DBL_MAX, rejected = 0;
+            TS_ASSERT_EQUALS( num_survivors, cvCeil( ratios[i] * N ) );
+            for( int n = 0; n < N; n++ ) {
+                if( ids[n] >= N - num_survivors ) {
+                    TS_ASSERT_DELTA( loglikelis[n], -ids[n], 1e-9 );
+                    miny = MIN( miny, loglikelis[n] );
+                }
+            }
+            // all the rejected together weigh less than the least survivor
+            for( int n = 0; n < N; n++ ) {
+                if( ids[n] < N - num_survivors ) {
+                    TS_ASSERT( loglikelis[n] < miny );
+                    rejected += exp( loglikelis[n] - miny );
+                }
+            }
+            TS_ASSERT( rejected < 1 );
+        }
+    }
+
+    void testCheapOnly()
+    {
+        TS_ASSERT_EQUALS( icvObserveCascade( NULL, NULL, ids, N, icvCheapId, icvExpensiveLinear,
+                                             0, DBL_MAX, loglikelis ), 0 );
+        TS_ASSERT_EQUALS( num_expensive, 0 );
+        for( int n = 0; n < N; n++ )
+            TS_ASSERT_EQUALS( loglikelis[n], (double)ids[n] );
+    }
+};
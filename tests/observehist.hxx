@@ -0,0 +1,110 @@
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#pragma comment(lib, "cv.lib")
+#pragma comment(lib, "cxcore.lib")
+#pragma comment(lib, "cvaux.lib")
+#pragma comment(lib, "highgui.lib")
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cv.h"
+#include "cvaux.h"
+#include "cxcore.h"
+#include "highgui.h"
+#include "cvparticle/state1.h"
+#include "cvparticle/observehist.h"
+
+#include <cxxtest/TestSuite.h>
+
+class CvObserveHistTest : public CxxTest::TestSuite
+{
+public:
+    // Normalized histogram of the pixels [x1, x2) x [y1, y2) counted one by one
+    void bruteHistogram( const IplImage* img, int x1, int y1, int x2, int y2, double* hist )
+    {
+        int num_bins = icvHistNumBins( img ), total = 0;
+        for( int b = 0; b < num_bins; b++ ) hist[b] = 0;
+        for( int y = y1; y < y2; y++ ) {
+            for( int x = x1; x < x2; x++ ) {
+                CvScalar pix = cvGet2D( img, y, x );
+                int bin = 0;
+                for( int c = img->nChannels - 1; c >= 0; c-- )
+                    bin = bin * hist_bins + ( (int)pix.val[c] * hist_bins >> 8 );
+                hist[bin]++;
+                total++;
+            }
+        }
+        for( int b = 0; b < num_bins; b++ ) hist[b] /= total;
+    }
+
+    void testBoxHistogram()
+    {
+        // odd size so that the last cells are partial
+        IplImage *img = cvCreateImage( cvSize( 33, 21 ), IPL_DEPTH_8U, 3 );
+        for( int y = 0; y < img->height; y++ )
+            for( int x = 0; x < img->width; x++ )
+                cvSet2D( img, y, x, cvScalar( ( x * 37 + y * 11 ) % 256,
+                                              ( x * x + 3 * y ) % 256,
+                                              ( x * y * 7 ) % 256 ) );
+        int num_bins = icvHistNumBins( img );
+        double *hist = new double[num_bins], *ref = new double[num_bins];
+
+        // boxes on the cell grid (hist_cell = 2), the others clipped by the frame
+        icvObserveHistInitialize( img, cvBox32f( 10, 11, 12, 10 ) );
+        bruteHistogram( img, 4, 6, 16, 16, ref );
+        for( int b = 0; b < num_bins; b++ )
+            TS_ASSERT_DELTA( cvmGet( reference_hist, 0, b ), ref[b], 1e-12 );
+
+        TS_ASSERT( icvBoxHistogram( cvBox32f( 30, 19, 12, 10 ), hist ) );
+        bruteHistogram( img, 24, 14, 33, 21, ref );
+        for( int b = 0; b < num_bins; b++ )
+            TS_ASSERT_DELTA( hist[b], ref[b], 1e-12 );
+
+        TS_ASSERT( icvBoxHistogram( cvBox32f( 2, 3, 8, 10 ), hist ) );
+        bruteHistogram( img, 0, 0, 6, 8, ref );
+        for( int b = 0; b < num_bins; b++ )
+            TS_ASSERT_DELTA( hist[b], ref[b], 1e-12 );
+
+        TS_ASSERT( !icvBoxHistogram( cvBox32f( 50, 10, 8, 8 ), hist ) );
+
+        icvObserveHistFinalize();
+        delete[] hist;
+        delete[] ref;
+        cvReleaseImage( &img );
+    }
+
+    void testInscribedBox()
+    {
+        // a square turned by 45 degrees holds a square of side / sqrt(2)
+        CvBox32f box = icvInscribedBox( cvBox32f( 5, 6, 20, 20, 45 ) );
+        TS_ASSERT_DELTA( box.cx, 5, 1e-6 );
+        TS_ASSERT_DELTA( box.cy, 6, 1e-6 );
+        TS_ASSERT_DELTA( box.width, 20 / sqrt( 2.0 ), 1e-4 );
+        TS_ASSERT_DELTA( box.height, 20 / sqrt( 2.0 ), 1e-4 );
+
+        // inside the rotated box and as large as the largest of any aspect
+        // ratio, whose half sizes a, b satisfy a|cos| + b|sin| <= w/2 and
+        // a|sin| + b|cos| <= h/2
+        double sizes[][2] = { { 40, 20 }, { 20, 40 }, { 40, 36 }, { 30, 4 } };
+        double angles[] = { 10, 30, 60, 100, -135 };
+        for( int i = 0; i < 4; i++ ) {
+            for( int j = 0; j < 5; j++ ) {
+                double w = sizes[i][0], h = sizes[i][1];
+                double c = fabs( cos( angles[j] * M_PI / 180 ) );
+                double s = fabs( sin( angles[j] * M_PI / 180 ) );
+                box = icvInscribedBox( cvBox32f( 0, 0, (float)w, (float)h, (float)angles[j] ) );
+                double a = box.width / 2, b = box.height / 2;
+                TS_ASSERT( a * c + b * s <= w / 2 + 1e-4 );
+                TS_ASSERT( a * s + b * c <= h / 2 + 1e-4 );
+
+                double best = 0;
+                for( double r = 0.01; r < 100; r *= 1.01 ) {
+                    double ar = MIN( w / 2 / ( c + r * s ), h / 2 / ( s + r * c ) );
+                    best = MAX( best, ar * ar * r );
+                }
+                TS_ASSERT( a * b >= best * ( 1 - 1e-3 ) );
+            }
+        }
+    }
+};